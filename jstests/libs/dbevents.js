@@ -26,6 +26,11 @@ var testPubSubDataEvents = function(subscriber, publisher) {
     var eventSub = subscriber.pubsub.subscribeToChanges();
     var res, msg;
 
+    // a subscriber's watch reaches the other members of its replica set asynchronously
+    if (subscriber !== publisher) {
+        sleep(1000);
+    }
+
 
 
     // inserts:
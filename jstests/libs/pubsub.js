@@ -53,6 +53,19 @@ var onlyGotMessage = function(res, subscription, channel, msg) {
 var msg1 = {a:1};
 var msg2 = {a:2};
 
+// Waits until each node in conns publishes to numMongoses mongoses other than itself.
+// Mongoses and shards find the mongoses they publish to through config.mongos, which each
+// mongos pings once it has started.
+var awaitMongosPeers = function(conns, numMongoses) {
+    conns.forEach(function(conn) {
+        assert.soon(function() {
+            var links = conn.getDB('admin').serverStatus().pubsub.links;
+            return links.mongosPeers !== undefined && links.mongosPeers.length == numMongoses;
+        }, conn.host + ' did not find ' + numMongoses + ' mongoses to publish to',
+        3 * 60 * 1000);
+    });
+}
+
 
 var selfWorks = function(db) {
 
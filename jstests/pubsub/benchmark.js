@@ -107,3 +107,140 @@ var poll = function(_messageSize, _host, _port) {
 
     printStats(stats);
 }
+
+/**
+ * Use benchRun to measure messages published/second with an increasing number of messages
+ * published per command, from 1 to 1000
+ */
+var publishBatch = function(_messageSize) {
+
+    var messageSize = _messageSize || "light";
+    var message;
+    if (messageSize == "light")
+        message = lightMessage;
+    else if (messageSize == "heavy")
+        message = heavyMessage;
+    else{
+        print("unknown message size " + messageSize);
+        return;
+    }
+
+    var batchStats = {};
+    var batchSizes = [1, 10, 100, 1000];
+    for (var i=0; i<batchSizes.length; i++) {
+        var batchSize = batchSizes[i];
+        var messages = [];
+        for (var j=0; j<batchSize; j++)
+            messages.push({ message : message });
+
+        var ops = [{ op: "command", ns: "test", command: { publish: "A", messages: messages } }];
+        var res = benchRun({ ops: ops, host: db.getMongo().host, seconds: timeSecs, parallel: 1 });
+        batchStats[batchSize] = res["averageCommandsPerSecond"] * batchSize;
+    }
+
+    print("batchSize\tmessages/second");
+    for (var batchSize in batchStats)
+        print(batchSize + "\t" + batchStats[batchSize]);
+}
+
+/**
+ * Use benchRun to measure inserts/second with database event notifications off, on with no
+ * subscriber watching the collection, and on with a subscriber watching it, with an increasing
+ * number of inserting clients
+ */
+var insertDataEvents = function(_messageSize) {
+
+    var messageSize = _messageSize || "light";
+    var doc;
+    if (messageSize == "light")
+        doc = lightMessage;
+    else if (messageSize == "heavy")
+        doc = heavyMessage;
+    else{
+        print("unknown message size " + messageSize);
+        return;
+    }
+
+    var eventStats = { off : {}, unwatched : {}, watched : {} };
+    for (var setting in eventStats) {
+        assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                               publishDataEvents : setting != "off" }));
+        var eventSub = setting == "watched" ? db.dataEventsBenchmark.subscribeToChanges() : null;
+
+        for (var numParallel = 1; numParallel <= maxClients; numParallel *= 2) {
+            db.dataEventsBenchmark.drop();
+            var ops = [{ op: "insert", ns: db.dataEventsBenchmark.getFullName(), doc: doc }];
+            var res = benchRun({ ops: ops,
+                                 host: db.getMongo().host,
+                                 seconds: timeSecs,
+                                 parallel: numParallel });
+            eventStats[setting][numParallel] = res["insert"];
+        }
+
+        if (eventSub)
+            eventSub.unsubscribe();
+    }
+    db.dataEventsBenchmark.drop();
+    assert.commandWorked(db.adminCommand({ setParameter : 1, publishDataEvents : false }));
+
+    print("numClients\tinserts/second events off\tinserts/second unwatched" +
+          "\tinserts/second watched");
+    for (var numParallel in eventStats["off"])
+        print(numParallel + "\t" + eventStats["off"][numParallel] + "\t" +
+              eventStats["unwatched"][numParallel] + "\t" + eventStats["watched"][numParallel]);
+}
+
+/**
+ * Use benchRun to measure publishes/second across a sharded cluster with an increasing
+ * number of mongoses, from 1 to 4, with one publishing client and one subscription per
+ * mongos. Every message reaches every mongos and is routed to its subscription, whose filter
+ * discards it so that the subscription's queue does not grow.
+ */
+var clusterPublish = function(_messageSize) {
+
+    load("jstests/libs/pubsub.js");
+
+    var messageSize = _messageSize || "light";
+    if (messageSize != "light" && messageSize != "heavy") {
+        print("unknown message size " + messageSize);
+        return;
+    }
+
+    var preSync = 'load("jstests/pubsub/helpers.js");' +
+        'var ops = [{ op: "command", ns: "test", command: { publish: "A", message: ' +
+        messageSize + 'Message } }];' +
+        'var benchArgs = {ops: ops, host: db.getMongo().host, seconds: timeSecs, parallel: 1};';
+    var postSync = 'var res = (benchRun(benchArgs));' +
+                   '$res["averageCommandsPerSecond"]$';
+
+    var clusterStats = {};
+    for (var numMongoses = 1; numMongoses <= 4; numMongoses *= 2) {
+        var st = new ShardingTest({ name: "pubsubClusterBenchmark",
+                                    mongos: numMongoses,
+                                    shards: 1,
+                                    config: 1 });
+        var mongoses = [];
+        for (var i = 0; i < numMongoses; i++)
+            mongoses.push(st["s" + i]);
+        awaitMongosPeers(mongoses, numMongoses - 1);
+
+        var subs = mongoses.map(function(mongos) {
+            return mongos.getDB("test").PS().subscribe("A", { nothing : 1 });
+        });
+
+        var runner = new SynchronizedRunner();
+        parseAddresses(mongoses.map(function(mongos) { return mongos.host; })).forEach(
+            function(addr) {
+                runner.addJob(new SynchronizedJob(addr.host, addr.port, preSync, postSync));
+            });
+        runner.start();
+        clusterStats[numMongoses] = sum(runner.returnVals);
+
+        subs.forEach(function(sub) { sub.unsubscribe(); });
+        st.stop();
+    }
+
+    print("numMongoses\tpublishes/second");
+    for (var numMongoses in clusterStats)
+        print(numMongoses + "\t" + clusterStats[numMongoses]);
+}
@@ -0,0 +1,64 @@
+var ps = db.PS();
+
+var kInvalidPattern = 18584;
+var kPatternStartAt = 18585;
+var kPublishToPattern = 18586;
+
+var res = db.runCommand({ subscribe : "orders.**.eu" });
+assert.commandFailed(res);
+assert.eq(res.code, kInvalidPattern);
+
+res = db.runCommand({ subscribe : "orders.*", startAt : new Date(0) });
+assert.commandFailed(res);
+assert.eq(res.code, kPatternStartAt);
+
+res = db.runCommand({ publish : "orders.*", message : { a : 1 } });
+assert.commandFailed(res);
+assert.eq(res.code, kPublishToPattern);
+
+// patterns match whole segments
+var anyRegion = ps.subscribe("orders.*.eu");
+var anyDepth = ps.subscribe("orders.**");
+var filtered = ps.subscribe("orders.*.eu", { count : { $gte : 1 } }, { count : 1 });
+var prefix = ps.subscribe("orders");
+
+ps.publish("orders.books.eu", { count : 0, body : "a" });
+ps.publish("orders.books.eu", { count : 1, body : "b" });
+ps.publish("orders.books.europe", { count : 2, body : "c" });
+ps.publish("ordersArchive.books.eu", { count : 3, body : "d" });
+ps.publish("orders.books.eu.west", { count : 4, body : "e" });
+ps.publish("orders", { count : 5, body : "f" });
+sleep(500);
+
+res = anyRegion.poll(1000);
+var msgs = res["messages"][anyRegion.getId().str];
+assert.eq(Object.keySet(msgs), ["orders.books.eu"]);
+assert.eq(msgs["orders.books.eu"].length, 2);
+
+res = anyDepth.poll(1000);
+msgs = res["messages"][anyDepth.getId().str];
+assert.eq(Object.keySet(msgs).sort(),
+          ["orders.books.eu", "orders.books.eu.west", "orders.books.europe"]);
+
+// filters and projections apply to pattern subscriptions
+res = filtered.poll(1000);
+msgs = res["messages"][filtered.getId().str]["orders.books.eu"];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0]["count"], 1);
+assert.eq(msgs[0]["body"], undefined);
+
+// prefix subscriptions are unchanged
+res = prefix.poll(1000);
+msgs = res["messages"][prefix.getId().str];
+assert.eq(Object.keySet(msgs).length, 5);
+
+// wildcards do not match reserved channels
+var wildcard = ps.subscribe("*");
+ps.publish("single", { a : 1 });
+sleep(500);
+res = wildcard.poll(1000);
+assert.eq(Object.keySet(res["messages"][wildcard.getId().str]), ["single"]);
+
+[anyRegion, anyDepth, filtered, prefix, wildcard].forEach(function(sub) {
+    sub.unsubscribe();
+});
@@ -8,6 +8,9 @@ var db0 = st.s0.getDB('test');
 var db1 = st.s1.getDB('test');
 var db2 = st.s2.getDB('test');
 
+// each mongos publishes to the others once it finds them in config.mongos
+awaitMongosPeers([st.s0, st.s1, st.s2], 2);
+
 // Each mongos can communicate with itself
 assert(selfWorks(db0));
 assert(selfWorks(db1));
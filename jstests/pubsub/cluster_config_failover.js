@@ -13,6 +13,9 @@ var db0 = st.s0.getDB('test');
 var db1 = st.s1.getDB('test');
 var db2 = st.s2.getDB('test');
 
+// each mongos publishes to the others once it finds them in config.mongos
+awaitMongosPeers([st.s0, st.s1, st.s2], 2);
+
 var testMongoses = function(db0, db1, db2) {
     // Each mongos can communicate with itself
     assert(selfWorks(db0));
@@ -34,8 +37,14 @@ try {
 
 testMongoses(db0, db1, db2);
 
-// // stop second config server
-// st.c1.getDB('admin').runCommand({ shutdown: 1 });
-// testMongoses(db0, db1, db2);
+// stop the config server with the highest port, which used to relay all messages between
+// the mongoses. they publish to each other directly, so it is not needed.
+try {
+    st.c2.getDB('admin').runCommand({ shutdown: 1 });
+} catch(err) {
+    print("\n\n\n\nShut down config2: " + err + "\n\n\n\n");
+}
+
+testMongoses(db0, db1, db2);
 
 st.stop();
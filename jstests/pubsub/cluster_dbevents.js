@@ -9,6 +9,16 @@ var db0 = st.s0.getDB('test');
 var db1 = st.s1.getDB('test');
 var db2 = st.s2.getDB('test');
 
+// each mongos publishes to the others once it finds them in config.mongos. a shard starts
+// publishing data events to the mongoses once its first write through a mongos makes it
+// aware that it is a shard.
+awaitMongosPeers([st.s0, st.s1, st.s2], 2);
+[db0, db1, db2].forEach(function(db) {
+    assert.writeOK(db.pubsub.insert({ warmup: 1 }));
+});
+assert.writeOK(db0.pubsub.remove({ warmup: 1 }));
+awaitMongosPeers([st.getServer('test')], 3);
+
 // each mongos can communicate with itself
 testPubSubDataEvents(db0);
 testPubSubDataEvents(db1);
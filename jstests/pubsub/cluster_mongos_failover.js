@@ -13,6 +13,9 @@ var db0 = st.s0.getDB('test');
 var db1 = st.s1.getDB('test');
 var db2 = st.s2.getDB('test');
 
+// each mongos publishes to the others once it finds them in config.mongos
+awaitMongosPeers([st.s0, st.s1, st.s2], 2);
+
 // Each mongos can communicate with itself
 assert(selfWorks(db0));
 assert(selfWorks(db1));
@@ -36,12 +39,14 @@ assert(selfWorks(db2));
 // restart both mongoses
 st.restartMongos(0);
 db0 = st.s0.getDB('test');
+awaitMongosPeers([st.s0], 2);
 assert(selfWorks(db0));
 assert(selfWorks(db2));
 assert(pairWorks(db0, db2));
 
 st.restartMongos(1);
 db1 = st.s1.getDB('test');
+awaitMongosPeers([st.s1], 2);
 
 assert(selfWorks(db0));
 assert(selfWorks(db1));
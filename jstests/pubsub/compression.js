@@ -0,0 +1,41 @@
+var ps = db.PS();
+
+var channel = "compression_test";
+var sub = ps.subscribe(channel);
+
+function linkStats() {
+    return db.serverStatus().pubsub.links;
+}
+
+assert.commandWorked(db.adminCommand({ setParameter : 1, pubsubCompression : true }));
+assert.commandWorked(db.adminCommand({ setParameter : 1, pubsubCompressionThreshold : 1024 }));
+
+var before = linkStats();
+
+// a large, repetitive message is compressed on the way out and restored on the way in
+var body = new Array(10001).join("abcdefghij");
+ps.publish(channel, { body : body });
+
+// a message below the threshold is sent as is
+ps.publish(channel, { body : "small" });
+sleep(500);
+
+var res = sub.poll(1000);
+var msgs = res["messages"][sub.getId().str][channel];
+assert.eq(msgs.length, 2);
+assert.eq(msgs[0]["body"], body);
+assert.eq(msgs[1]["body"], "small");
+
+var after = linkStats();
+assert.eq(after.send.messages - before.send.messages, 2);
+assert.eq(after.send.compressedMessages - before.send.compressedMessages, 1);
+var sentBytes = after.send.bytes - before.send.bytes;
+var sentWireBytes = after.send.wireBytes - before.send.wireBytes;
+assert.gt(sentBytes, body.length);
+assert.lt(sentWireBytes, sentBytes / 10);
+
+assert.eq(after.receive.compressedMessages - before.receive.compressedMessages, 1);
+assert.eq(after.receive.bytes - before.receive.bytes, sentBytes);
+
+assert.commandWorked(db.adminCommand({ setParameter : 1, pubsubCompression : false }));
+sub.unsubscribe();
@@ -0,0 +1,44 @@
+var ps = db.PS();
+
+// subscribe with a cursor
+var res = db.runCommand({ subscribe: "A", cursor: {} });
+assert.commandWorked(res);
+assert.neq(res["cursor"], undefined);
+assert.eq(res["cursor"]["firstBatch"].length, 0);
+assert.eq(res["cursor"]["ns"], db.getName() + ".A");
+var cursor = new DBCommandCursor(db.getMongo(), res, 2);
+
+// the cursor argument must be an object
+assert.commandFailed(db.runCommand({ subscribe: "A", cursor: 1 }));
+
+// publish
+for(var i=0; i<5; i++){
+    ps.publish("A", { body : "hello", count : i });
+    sleep(1);
+}
+
+// wait for all messages to be routed
+sleep(500);
+
+// messages are returned in order through getMore
+for(var i=0; i<5; i++){
+    assert(cursor.hasNext());
+    var doc = cursor.next();
+    assert.eq(doc["channel"], "A");
+    assert.eq(doc["message"]["count"], i);
+}
+
+// messages are not also returned by poll once read through the cursor
+var pollRes = ps.poll(res["subscriptionId"]);
+assert.eq(Object.keys(pollRes["messages"]).length, 0);
+
+// the shell helper exposes the same cursor
+var sub = ps.subscribe("B", null, null, { cursor: {} });
+ps.publish("B", { body : "hello" });
+sleep(500);
+assert.eq(sub.getCursor().next()["message"]["body"], "hello");
+
+// unsubscribing closes the cursor
+sub.unsubscribe();
+assert.throws(function() { sub.getCursor().hasNext(); });
+ps.unsubscribe(res["subscriptionId"]);
@@ -0,0 +1,71 @@
+// Make sure to start a mongod with --setParameter publishDataEvents=1
+
+var ps = db.PS();
+
+var watched = db.dbevents_scoped_watched;
+var unwatched = db.dbevents_scoped_unwatched;
+watched.drop();
+unwatched.drop();
+
+// only inserts into the watched collection are published
+var insertSub = ps.subscribe('$events', {db: db.getName(),
+                                         collection: watched.getName(),
+                                         type: 'insert'});
+
+assert.writeOK(watched.insert({_id: 1}));
+assert.writeOK(watched.update({_id: 1}, {$set: {a: 1}}));
+assert.writeOK(unwatched.insert({_id: 1}));
+assert.writeOK(watched.remove({_id: 1}));
+
+sleep(500);
+var res = insertSub.poll(1000);
+var msgs = res.messages[insertSub.getId().str]['$events'];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0].collection, watched.getName());
+assert.eq(msgs[0].type, 'insert');
+insertSub.unsubscribe();
+
+// watching a whole database does not cover its system collections
+var dbSub = db.subscribeToChanges();
+
+assert.writeOK(db.system.js.save({_id: 'dbevents_scoped', value: function() {}}));
+assert.writeOK(unwatched.insert({_id: 2}));
+assert.writeOK(db.system.js.remove({_id: 'dbevents_scoped'}));
+
+sleep(500);
+res = dbSub.poll(1000);
+msgs = res.messages[dbSub.getId().str]['$events'];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0].collection, unwatched.getName());
+dbSub.unsubscribe();
+
+// naming a system collection publishes its events, but only to the subscriptions naming it
+var allSub = ps.subscribe('$events');
+var systemSub = ps.subscribe('$events', {db: db.getName(), collection: 'system.js'});
+
+assert.writeOK(db.system.js.save({_id: 'dbevents_scoped', value: function() {}}));
+assert.writeOK(unwatched.insert({_id: 3}));
+
+sleep(500);
+res = allSub.poll(1000);
+msgs = res.messages[allSub.getId().str]['$events'];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0].collection, unwatched.getName());
+
+res = systemSub.poll(1000);
+msgs = res.messages[systemSub.getId().str]['$events'];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0].collection, 'system.js');
+
+assert.writeOK(db.system.js.remove({_id: 'dbevents_scoped'}));
+allSub.unsubscribe();
+systemSub.unsubscribe();
+
+// the channel watches are announced on is reserved
+var kReservedChannel = 18571;
+var cmdRes = db.runCommand({publish: '$watches', message: {}});
+assert.commandFailed(cmdRes);
+assert.eq(cmdRes.code, kReservedChannel);
+
+watched.drop();
+unwatched.drop();
@@ -0,0 +1,51 @@
+// Make sure to start a mongod with --setParameter publishDataEvents=1
+
+var coll = db.dbevents_update_format;
+coll.drop();
+
+var eventSub = coll.subscribeToChanges('update');
+
+// polls the single update event published since the last poll
+var pollUpdate = function() {
+    var res;
+    assert.soon(function() {
+        res = eventSub.poll();
+        return res.messages[eventSub.getId().str] !== undefined;
+    });
+    var msgs = res.messages[eventSub.getId().str]['$events'];
+    assert.eq(msgs.length, 1);
+    assert.eq(msgs[0].type, 'update');
+    return msgs[0].doc;
+}
+
+var bigString = new Array(1024).join('x');
+assert.writeOK(coll.insert({_id: 1, big: bigString, a: 0}));
+
+// the default format carries the old and new documents
+assert.commandWorked(db.adminCommand({setParameter: 1, dataEventUpdateFormat: 'full'}));
+assert.writeOK(coll.update({_id: 1}, {$set: {a: 1}}));
+assert.eq(pollUpdate(), {old: {_id: 1, big: bigString, a: 0},
+                         new: {_id: 1, big: bigString, a: 1}});
+
+// delta carries the _id and the oplog entry of the update only
+assert.commandWorked(db.adminCommand({setParameter: 1, dataEventUpdateFormat: 'delta'}));
+assert.writeOK(coll.update({_id: 1}, {$set: {a: 2}}));
+assert.eq(pollUpdate(), {_id: 1, delta: {$set: {a: 2}}});
+
+// deltaAndNew adds the new document
+assert.commandWorked(db.adminCommand({setParameter: 1, dataEventUpdateFormat: 'deltaAndNew'}));
+assert.writeOK(coll.update({_id: 1}, {$inc: {a: 1}}));
+assert.eq(pollUpdate(), {_id: 1, delta: {$set: {a: 3}}, new: {_id: 1, big: bigString, a: 3}});
+
+// replacements are described by the new document, as in the oplog
+assert.commandWorked(db.adminCommand({setParameter: 1, dataEventUpdateFormat: 'delta'}));
+assert.writeOK(coll.update({_id: 1}, {b: 1}));
+assert.eq(pollUpdate(), {_id: 1, delta: {_id: 1, b: 1}});
+
+assert.commandFailed(db.adminCommand({setParameter: 1, dataEventUpdateFormat: 'diff'}));
+var res = db.adminCommand({getParameter: 1, dataEventUpdateFormat: 1});
+assert.eq(res.dataEventUpdateFormat, 'delta');
+
+assert.commandWorked(db.adminCommand({setParameter: 1, dataEventUpdateFormat: 'full'}));
+eventSub.unsubscribe();
+coll.drop();
@@ -0,0 +1,59 @@
+var ps = db.PS();
+
+var channel = "durable_channel_test";
+db.getSiblingDB("local").getCollection("pubsub." + channel).drop();
+ps.createDurableChannel(channel, 1024 * 1024);
+
+var kNotDurable = 18574;
+var res = db.runCommand({ subscribe : "not_durable", startAt : new Date(0) });
+assert.commandFailed(res);
+assert.eq(res.code, kNotDurable);
+
+// published messages are stored unchanged under an _id in publication order, keeping
+// their own _id
+for (var i = 0; i < 5; i++)
+    ps.publish(channel, { _id : "msg" + i, count : i });
+
+var stored = db.getSiblingDB("local").getCollection("pubsub." + channel);
+assert.soon(function() { return stored.count() == 5; });
+var ids = stored.find().sort({ _id : 1 }).map(function(doc) {
+    assert.eq(doc.msg._id, "msg" + doc.msg.count);
+    return doc._id;
+});
+
+// a subscription starting at a date reads the stored messages, then live ones
+var fromDate = ps.subscribe(channel, undefined, undefined, { startAt : new Date(0) });
+res = fromDate.poll(1000);
+var msgs = res["messages"][fromDate.getId().str][channel];
+var storedIds = res["storedIds"][fromDate.getId().str][channel];
+assert.eq(msgs.length, 5);
+for (var i = 0; i < 5; i++) {
+    assert.eq(msgs[i], { _id : "msg" + i, count : i });
+    assert.eq(storedIds[i], ids[i]);
+}
+
+// a subscription resuming after a message id only reads the messages after it
+var resumed = ps.subscribe(channel, { count : { $gte : 3 } }, undefined, { startAt : ids[2] });
+res = resumed.poll(1000);
+msgs = res["messages"][resumed.getId().str][channel];
+assert.eq(msgs.length, 2);
+assert.eq(msgs[0]["count"], 3);
+assert.eq(msgs[1]["count"], 4);
+
+// once caught up, messages are delivered as they are published, and only once, with the
+// _id they were stored under
+ps.publish(channel, { _id : "msg5", count : 5 });
+assert.soon(function() { return stored.count() == 6; });
+var lastId = stored.find().sort({ _id : -1 }).next()._id;
+sleep(500);
+[fromDate, resumed].forEach(function(sub) {
+    res = sub.poll(1000);
+    msgs = res["messages"][sub.getId().str][channel];
+    assert.eq(msgs.length, 1);
+    assert.eq(msgs[0], { _id : "msg5", count : 5 });
+    assert.eq(res["storedIds"][sub.getId().str][channel][0], lastId);
+});
+
+fromDate.unsubscribe();
+resumed.unsubscribe();
+stored.drop();
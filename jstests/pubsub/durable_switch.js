@@ -0,0 +1,44 @@
+var ps = db.PS();
+
+var channel = "durable_switch_test";
+var stored = db.getSiblingDB("local").getCollection("pubsub." + channel);
+stored.drop();
+ps.createDurableChannel(channel, 16 * 1024 * 1024);
+
+// messages stored before the subscription starts
+var kStored = 2000;
+var kTotal = 4000;
+for (var i = 0; i < kStored; i++)
+    ps.publish(channel, { count : i });
+assert.soon(function() { return stored.count() == kStored; });
+
+// keep publishing while the subscription reads the stored messages and switches to
+// delivery as they are published
+var shell = startParallelShell('var ps = db.PS();' +
+                               'for (var i = ' + kStored + '; i < ' + kTotal + '; i++)' +
+                               '    ps.publish("' + channel + '", { count : i });',
+                               db.getMongo().port);
+
+// every message is received once, in order
+var sub = ps.subscribe(channel, undefined, undefined, { startAt : new Date(0) });
+var next = 0;
+assert.soon(function() {
+    var res = sub.poll(1000);
+    var msgs = res["messages"][sub.getId().str];
+    if (msgs !== undefined) {
+        msgs[channel].forEach(function(msg) {
+            assert.eq(msg["count"], next);
+            next++;
+        });
+    }
+    return next == kTotal;
+}, "received " + next + " of " + kTotal + " messages", 60 * 1000);
+shell();
+
+// and nothing is delivered again after the last one
+sleep(500);
+var res = sub.poll();
+assert.eq(res["messages"][sub.getId().str], undefined);
+
+sub.unsubscribe();
+stored.drop();
@@ -0,0 +1,37 @@
+var ps = db.PS();
+var ids = db.getSiblingDB("pubsub_ephemeral").ids;
+ids.drop();
+
+// a client subscribes with and without ephemeral, then disconnects
+var shell = startParallelShell(
+    'var ephemeral = db.runCommand({ subscribe : "E", ephemeral : true });' +
+    'var lasting = db.runCommand({ subscribe : "E", ephemeral : false });' +
+    'db.getSiblingDB("pubsub_ephemeral").ids.insert({ ephemeral : ephemeral.subscriptionId,' +
+    '                                                 lasting : lasting.subscriptionId });',
+    db.getMongo().port);
+shell();
+
+var doc = ids.findOne();
+assert.neq(doc, null);
+
+// the ephemeral subscription is removed with the connection, the other one is kept
+assert.soon(function() {
+    var res = ps.poll(doc.ephemeral);
+    return res["errors"] !== undefined &&
+           res["errors"][doc.ephemeral.str] === "Subscription not found.";
+});
+var res = ps.poll(doc.lasting);
+assert.eq(res["errors"], undefined);
+
+// ephemeral subscriptions on this connection are kept while it is open
+var sub = ps.subscribe("E", null, null, { ephemeral : true });
+ps.publish("E", { a : 1 });
+assert.soon(function() {
+    res = sub.poll();
+    return res["messages"][sub.getId().str] !== undefined;
+});
+
+assert.commandFailed(db.runCommand({ subscribe : "E", ephemeral : 1 }));
+
+ps.unsubscribe([doc.lasting, sub.getId()]);
+ids.drop();
@@ -0,0 +1,27 @@
+var ps = db.PS();
+
+var idle = ps.subscribe("idle", null, null, { idleTimeout : 500 });
+var active = ps.subscribe("idle", null, null, { idleTimeout : 500 });
+var lasting = ps.subscribe("idle", null, null, { idleTimeout : 60 * 1000 });
+
+// a subscription that keeps being polled is not removed
+var start = new Date();
+while (new Date() - start < 2000) {
+    var res = active.poll();
+    assert.eq(res["errors"], undefined);
+    sleep(100);
+}
+
+// one that is not polled for its idle timeout is removed soon after
+var res = idle.poll();
+assert.eq(res["errors"][idle.getId().str], "Subscription not found.");
+
+// a longer idle timeout is not reached yet
+res = lasting.poll();
+assert.eq(res["errors"], undefined);
+
+// invalid idle timeouts
+assert.commandFailed(db.runCommand({ subscribe : "idle", idleTimeout : 0 }));
+assert.commandFailed(db.runCommand({ subscribe : "idle", idleTimeout : "500" }));
+
+ps.unsubscribe([active.getId(), lasting.getId()]);
@@ -0,0 +1,93 @@
+var ps = db.PS();
+
+var heavy = ps.subscribe("heavy");
+var light = ps.subscribe("light");
+var ids = [heavy.getId(), light.getId()];
+
+for(var i=0; i<20; i++)
+    ps.publish("heavy", { body : "hello", count : i });
+for(var i=0; i<2; i++)
+    ps.publish("light", { body : "hello", count : i });
+
+// wait for all messages to be routed
+sleep(500);
+
+// the limit is shared between the subscriptions, so the light one is not starved
+var res = ps.poll(ids, 1000, null, { maxMessages : 6 });
+var heavyMsgs = res["messages"][heavy.getId().str]["heavy"];
+var lightMsgs = res["messages"][light.getId().str]["light"];
+assert.eq(lightMsgs.length, 2);
+assert.eq(heavyMsgs.length, 4);
+for(var i=0; i<4; i++)
+    assert.eq(heavyMsgs[i]["count"], i);
+
+// messages past the limit stay queued, in order
+res = heavy.poll(1000, null, { maxBytes : 100 });
+heavyMsgs = res["messages"][heavy.getId().str]["heavy"];
+assert.eq(heavyMsgs.length, 2);
+assert.eq(heavyMsgs[0]["count"], 4);
+assert.eq(heavyMsgs[1]["count"], 5);
+
+// the first message is returned even if it alone is larger than maxBytes
+res = heavy.poll(1000, null, { maxBytes : 10 });
+heavyMsgs = res["messages"][heavy.getId().str]["heavy"];
+assert.eq(heavyMsgs.length, 1);
+assert.eq(heavyMsgs[0]["count"], 6);
+
+// 0 is unlimited
+res = heavy.poll(1000, null, { maxMessages : 0, maxBytes : 0 });
+heavyMsgs = res["messages"][heavy.getId().str]["heavy"];
+assert.eq(heavyMsgs.length, 13);
+assert.eq(heavyMsgs[12]["count"], 19);
+var heavySeqs = res["seqs"][heavy.getId().str]["heavy"];
+
+// messages returned again by afterSeq count against maxBytes, and a queued message too large
+// for what they leave is not returned with them
+ps.publish("heavy", { body : "hello", count : 20 });
+sleep(500);
+var afterSeq = { heavy : heavySeqs[10] };
+res = heavy.poll(1000, afterSeq, { maxBytes : 100 });
+heavyMsgs = res["messages"][heavy.getId().str]["heavy"];
+assert.eq(heavyMsgs.length, 2);
+assert.eq(heavyMsgs[0]["count"], 18);
+assert.eq(heavyMsgs[1]["count"], 19);
+
+res = heavy.poll(1000);
+heavyMsgs = res["messages"][heavy.getId().str]["heavy"];
+assert.eq(heavyMsgs.length, 1);
+assert.eq(heavyMsgs[0]["count"], 20);
+
+// an oversized message on one of several subscriptions polled together is not starved by
+// the others' traffic. it is returned alone, by the poll after the one it did not fit in.
+var small1 = ps.subscribe("small1");
+var small2 = ps.subscribe("small2");
+var big = ps.subscribe("big");
+var pollIds = [small1.getId(), small2.getId(), big.getId()];
+var padding = new Array(1001).join("x");
+ps.publish("big", { body : padding });
+
+var bigPolls = [];
+for (var round = 0; round < 4; round++) {
+    for (var i = 0; i < 5; i++) {
+        ps.publish("small1", { body : "hello", count : i });
+        ps.publish("small2", { body : "hello", count : i });
+    }
+    sleep(500);
+
+    res = ps.poll(pollIds, 1000, null, { maxBytes : 200 });
+    var bigMsgs = res["messages"][big.getId().str];
+    if (bigMsgs) {
+        assert.eq(bigMsgs["big"].length, 1);
+        assert.eq(Object.keySet(res["messages"]).length, 1);
+        bigPolls.push(round);
+    }
+}
+assert.eq(bigPolls.length, 1);
+assert.lte(bigPolls[0], 1);
+ps.unsubscribe(pollIds);
+
+// invalid limits
+assert.commandFailed(db.runCommand({ poll : ids, maxMessages : "3" }));
+assert.commandFailed(db.runCommand({ poll : ids, maxBytes : -1 }));
+
+ps.unsubscribe(ids);
@@ -0,0 +1,46 @@
+var ps = db.PS();
+
+var subA = ps.subscribe("A");
+var subB = ps.subscribe("B");
+
+// publish a batch to the command's channel and to a channel given per message
+var messages = [];
+for(var i=0; i<5; i++)
+    messages.push({ message : { count : i } });
+messages.push({ message : { count : 5 }, channel : "B" });
+assert.commandWorked(db.runCommand({ publish : "A", messages : messages }));
+
+// wait for all messages to be routed
+sleep(500);
+
+// messages are delivered in batch order
+var res = subA.poll(1000);
+var msgs = res["messages"][subA.getId().str]["A"];
+assert.eq(msgs.length, 5);
+for(var i=0; i<5; i++)
+    assert.eq(msgs[i]["count"], i);
+
+res = subB.poll(1000);
+msgs = res["messages"][subB.getId().str]["B"];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0]["count"], 5);
+
+// the shell helper publishes arrays as batches
+ps.publish("A", [{ message : { count : 6 } }, { message : { count : 7 } }]);
+sleep(500);
+res = subA.poll(1000);
+assert.eq(res["messages"][subA.getId().str]["A"].length, 2);
+
+// a batch with an invalid member publishes nothing
+assert.commandFailed(db.runCommand({ publish : "A",
+                                     messages : [{ message : { count : 8 } }, { count : 9 }] }));
+assert.commandFailed(db.runCommand({ publish : "A",
+                                     messages : [{ message : {}, channel : "$events" }] }));
+assert.commandFailed(db.runCommand({ publish : "A", messages : {} }));
+assert.commandFailed(db.runCommand({ publish : "A", message : {}, messages : [] }));
+sleep(500);
+res = subA.poll();
+assert.eq(Object.keys(res["messages"]).length, 0);
+
+subA.unsubscribe();
+subB.unsubscribe();
@@ -0,0 +1,60 @@
+var ps = db.PS();
+
+// subscriptions with a queue limit of 3 messages under each overflow policy
+var subOldest = ps.subscribe("A", null, null, { maxQueueMessages: 3,
+                                                overflowPolicy: "dropOldest" });
+var subNewest = ps.subscribe("A", null, null, { maxQueueMessages: 3,
+                                                overflowPolicy: "dropNewest" });
+var subDisconnect = ps.subscribe("A", null, null, { maxQueueMessages: 3,
+                                                    overflowPolicy: "disconnect" });
+
+// subscription with a limit in bytes that fits a single message
+var subBytes = ps.subscribe("A", null, null, { maxQueueBytes: 60,
+                                               overflowPolicy: "dropNewest" });
+
+// publish
+for(var i=0; i<6; i++){
+    ps.publish("A", { body : "hello", count : i });
+    sleep(1);
+}
+
+// wait for all messages to be routed
+sleep(500);
+
+// the 3 newest messages are kept
+var res = subOldest.poll(1000);
+var msgs = res["messages"][subOldest.getId().str]["A"];
+assert.eq(msgs.length, 3);
+for(var i=0; i<3; i++)
+    assert.eq(msgs[i]["count"], i+3);
+assert.eq(res["droppedMessages"][subOldest.getId().str], 3);
+
+// the 3 oldest messages are kept
+res = subNewest.poll(1000);
+msgs = res["messages"][subNewest.getId().str]["A"];
+assert.eq(msgs.length, 3);
+for(var i=0; i<3; i++)
+    assert.eq(msgs[i]["count"], i);
+assert.eq(res["droppedMessages"][subNewest.getId().str], 3);
+
+// the dropped message count is reset once returned
+res = subNewest.poll();
+assert.eq(res["droppedMessages"], undefined);
+
+// the subscription is removed
+res = subDisconnect.poll(1000);
+assert.neq(res["errors"][subDisconnect.getId().str], undefined);
+res = subDisconnect.poll();
+assert.eq(res["errors"][subDisconnect.getId().str], "Subscription not found.");
+
+res = subBytes.poll(1000);
+msgs = res["messages"][subBytes.getId().str]["A"];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0]["count"], 0);
+assert.eq(res["droppedMessages"][subBytes.getId().str], 5);
+
+// invalid limits
+assert.commandFailed(db.runCommand({ subscribe: "A", maxQueueMessages: "3" }));
+assert.commandFailed(db.runCommand({ subscribe: "A", overflowPolicy: "dropAll" }));
+
+ps.unsubscribe([subOldest.getId(), subNewest.getId(), subBytes.getId()]);
@@ -0,0 +1,62 @@
+var ps = db.PS();
+
+var channel = "resume_seq_test_" + new ObjectId().str;
+var sub = ps.subscribe(channel);
+
+var kBadAfterSeq = 18582;
+var res = db.runCommand({ poll : sub.getId(), afterSeq : 1 });
+assert.commandFailed(res);
+assert.eq(res.code, kBadAfterSeq);
+
+// messages on a channel are numbered consecutively
+for (var i = 0; i < 5; i++)
+    ps.publish(channel, { count : i });
+sleep(500);
+
+res = sub.poll(1000);
+var msgs = res["messages"][sub.getId().str][channel];
+var seqs = res["seqs"][sub.getId().str][channel];
+assert.eq(msgs.length, 5);
+assert.eq(seqs.length, 5);
+for (var i = 1; i < 5; i++)
+    assert.eq(seqs[i], seqs[0] + i);
+
+// polling after a seq already returned returns the messages after it again, then new ones
+ps.publish(channel, { count : 5 });
+sleep(500);
+
+var afterSeq = {};
+afterSeq[channel] = seqs[2];
+res = sub.poll(1000, afterSeq);
+msgs = res["messages"][sub.getId().str][channel];
+var resumedSeqs = res["seqs"][sub.getId().str][channel];
+assert.eq(msgs.length, 3);
+assert.eq(msgs[0]["count"], 3);
+assert.eq(msgs[1]["count"], 4);
+assert.eq(msgs[2]["count"], 5);
+assert.eq(resumedSeqs, [seqs[3], seqs[4], seqs[0] + 5]);
+assert.eq(res["gaps"], undefined);
+
+// messages no longer in the replay buffer are reported as gaps
+assert.commandWorked(db.adminCommand({ setParameter : 1, pubsubReplayBufferBytes : 0 }));
+ps.publish(channel, { count : 6 });
+sleep(500);
+assert.commandWorked(db.adminCommand({ setParameter : 1,
+                                       pubsubReplayBufferBytes : 16 * 1024 * 1024 }));
+ps.publish(channel, { count : 7 });
+sleep(500);
+res = sub.poll(1000);
+assert.eq(res["messages"][sub.getId().str][channel].length, 2);
+
+afterSeq[channel] = seqs[0] + 5;
+res = sub.poll(0, afterSeq);
+var gaps = res["gaps"][sub.getId().str];
+assert.eq(gaps.length, 1);
+assert.eq(gaps[0]["channel"], channel);
+assert.eq(gaps[0]["from"], seqs[0] + 6);
+assert.eq(gaps[0]["to"], seqs[0] + 6);
+msgs = res["messages"][sub.getId().str][channel];
+assert.eq(msgs.length, 1);
+assert.eq(msgs[0]["count"], 7);
+
+sub.unsubscribe();
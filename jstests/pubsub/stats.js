@@ -0,0 +1,58 @@
+var ps = db.PS();
+
+var channel = "stats_test";
+var quiet = ps.subscribe(channel);
+var filtered = ps.subscribe(channel, { a : { $gt : 1 } });
+
+function pubsubStatus() {
+    return db.serverStatus().pubsub;
+}
+
+var before = pubsubStatus();
+assert.gte(before.subscriptions, 2);
+
+ps.publish(channel, { a : 1 });
+ps.publish(channel, { a : 2 });
+ps.publish(channel, { a : 3 });
+sleep(500);
+
+var after = pubsubStatus();
+assert.eq(after.published - before.published, 3);
+assert.gt(after.publishedBytes, before.publishedBytes);
+assert.eq(after.routed.messages - before.routed.messages, 3);
+// every message goes to the unfiltered subscription, two to the filtered one
+assert.eq(after.routed.deliveries - before.routed.deliveries, 5);
+assert.eq(after.routed.filtersEvaluated - before.routed.filtersEvaluated, 3);
+assert.eq(after.routed.filtersRejected - before.routed.filtersRejected, 1);
+
+// queued messages are listed per subscription, fullest first
+var res = db.runCommand({ pubsubStats : 1, subscriptions : 2 });
+assert.commandWorked(res);
+assert.eq(res.subscriptions.length, 2);
+assert.eq(res.subscriptions[0].subscriptionId, quiet.getId());
+assert.eq(res.subscriptions[0].channel, channel);
+assert.eq(res.subscriptions[0].queuedMessages, 3);
+assert.eq(res.subscriptions[1].queuedMessages, 2);
+
+var channelStats = res.channels[channel];
+assert.gte(channelStats.messages, 3);
+assert.gte(channelStats.filtersRejected, 1);
+
+var filterMessages = 0;
+res.filterMicros.forEach(function(bucket) { filterMessages += bucket.count; });
+assert.gte(filterMessages, 3);
+
+// returned messages are counted once polled
+var polled = quiet.poll(1000);
+assert.eq(polled["messages"][quiet.getId().str][channel].length, 3);
+assert.eq(pubsubStatus().returned - after.returned, 3);
+
+res = db.runCommand({ pubsubStats : 1, subscriptions : 2 });
+assert.eq(res.subscriptions[0].subscriptionId, filtered.getId());
+assert.eq(res.subscriptions[0].queuedMessages, 2);
+
+assert.commandFailed(db.runCommand({ pubsubStats : 1, channels : -1 }));
+assert.commandFailed(db.runCommand({ pubsubStats : 1, subscriptions : "all" }));
+
+quiet.unsubscribe();
+filtered.unsubscribe();
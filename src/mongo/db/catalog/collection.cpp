@@ -38,7 +38,7 @@
 #include "mongo/db/catalog/database.h"
 #include "mongo/db/catalog/index_create.h"
 #include "mongo/db/index/index_access_method.h"
-#include "mongo/db/pubsub_sendsock.h"
+#include "mongo/db/pubsub_data_events.h"
 #include "mongo/db/structure/catalog/namespace_details.h"
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/storage/extent.h"
@@ -191,15 +191,8 @@ namespace mongo {
         if ( status.isOK() ) {
             _details->paddingFits();
 
-            if (pubsubEnabled && publishDataEvents) {
-                BSONObj publishObject = BSON("db" << _ns.db() <<
-                                             "collection" << _ns.coll() <<
-                                             "type" << "insert" <<
-                                             "doc" << docToInsert);
-                bool success = PubSubSendSocket::publish("$events", publishObject);
-                if (!success)
-                    log() << "Error publishing DB event." << endl;
-            }
+            if (DataEvents::enabled(_ns, DataEventInterest::kInsert))
+                DataEvents::recordInsert(_ns, docToInsert);
         }
 
         return status;
@@ -222,15 +215,8 @@ namespace mongo {
         if ( !status.isOK() )
             return StatusWith<DiskLoc>( status );
 
-        if (pubsubEnabled && publishDataEvents) {
-            BSONObj publishObject = BSON("db" << _ns.db() <<
-                                         "collection" << _ns.coll() <<
-                                         "type" << "insert" <<
-                                         "doc" << doc);
-            bool success = PubSubSendSocket::publish("$events", publishObject);
-            if (!success)
-                log() << "Error publishing DB event." << endl;
-        }
+        if (DataEvents::enabled(_ns, DataEventInterest::kInsert))
+            DataEvents::recordInsert(_ns, doc);
 
         return loc;
     }
@@ -286,15 +272,8 @@ namespace mongo {
 
         BSONObj doc = docFor( loc );
 
-        if (pubsubEnabled && publishDataEvents) {
-            BSONObj publishObject = BSON("db" << _ns.db() <<
-                                         "collection" << _ns.coll() <<
-                                         "type" << "remove" <<
-                                         "doc" << doc);
-            bool success = PubSubSendSocket::publish("$events", publishObject);
-            if (!success)
-                log() << "Error publishing DB event." << endl;
-        }
+        if (DataEvents::enabled(_ns, DataEventInterest::kRemove))
+            DataEvents::recordRemove(_ns, doc);
 
         if ( deletedId ) {
             BSONElement e = doc["_id"];
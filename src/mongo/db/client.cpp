@@ -56,6 +56,7 @@
 #include "mongo/db/json.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/pagefault.h"
+#include "mongo/db/pubsub_sendsock.h"
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/s/chunk_version.h"
@@ -235,6 +236,9 @@ namespace mongo {
             clients.erase(this);
         }
 
+        if (pubsubConnectionClosed && port())
+            pubsubConnectionClosed(port()->connectionId());
+
         return false;
     }
 
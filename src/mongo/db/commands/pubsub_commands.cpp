@@ -36,9 +36,12 @@
 #include "mongo/db/auth/action_set.h"
 #include "mongo/db/auth/action_type.h"
 #include "mongo/db/auth/privilege.h"
+#include "mongo/db/client_basic.h"
 #include "mongo/db/commands.h"
+#include "mongo/db/commands/server_status.h"
 #include "mongo/db/pubsub.h"
 #include "mongo/db/pubsub_sendsock.h"
+#include "mongo/db/pubsub_stats.h"
 
 namespace mongo {
 
@@ -48,16 +51,77 @@ namespace mongo {
         const std::string kSubscriptionId = "subscriptionId";
         const std::string kPublishField = "publish";
         const std::string kMessageField = "message";
+        const std::string kMessagesField = "messages";
+        const std::string kChannelField = "channel";
         const std::string kSubscribeField = "subscribe";
         const std::string kFilterField = "filter";
         const std::string kProjectionField = "projection";
+        const std::string kMaxQueueMessagesField = "maxQueueMessages";
+        const std::string kMaxQueueBytesField = "maxQueueBytes";
+        const std::string kOverflowPolicyField = "overflowPolicy";
+        const std::string kIdleTimeoutField = "idleTimeout";
+        const std::string kEphemeralField = "ephemeral";
+        const std::string kCursorField = "cursor";
+        const std::string kStartAtField = "startAt";
         const std::string kPollField = "poll";
         const std::string kTimeoutField = "timeout";
+        const std::string kAfterSeqField = "afterSeq";
+        const std::string kMaxMessagesField = "maxMessages";
+        const std::string kMaxBytesField = "maxBytes";
+        const std::string kSeqsField = "seqs";
+        const std::string kStoredIdsField = "storedIds";
+        const std::string kGapsField = "gaps";
+        const std::string kFromField = "from";
+        const std::string kToField = "to";
         const std::string kMillisPolledField = "millisPolled";
         const std::string kPollAgainField = "pollAgain";
-        const std::string kMessagesField = "messages";
         const std::string kErrorField = "errors";
+        const std::string kDroppedMessagesField = "droppedMessages";
         const std::string kUnsubscribeField = "unsubscribe";
+        const std::string kChannelsField = "channels";
+        const std::string kSubscriptionsField = "subscriptions";
+
+        // default number of channels and subscriptions listed by pubsubStats
+        const long long kDefaultStatsEntries = 100;
+
+        // Helper method to append the pubsub section of serverStatus
+        void appendStatus(BSONObjBuilder* builder) {
+            builder->append(kSubscriptionsField,
+                            static_cast<long long>(PubSub::numSubscriptions()));
+            PubSubStats::appendTotals(builder);
+            PubSubSendSocket::appendLinkStats(builder);
+        }
+
+        // Helper method to read the number of entries pubsubStats lists for field
+        size_t statsEntries(const BSONObj& cmdObj, const std::string& field) {
+            BSONElement element = cmdObj[field];
+            if (element.eoo())
+                return kDefaultStatsEntries;
+
+            uassert(18587,
+                    mongoutils::str::stream() << "The " << field << " argument must be a "
+                                              << "non-negative number but was "
+                                              << element.toString(false),
+                    element.isNumber() && element.numberLong() >= 0);
+            return element.numberLong();
+        }
+
+        // Helper method to validate the channel of a publish. $events is reserved for
+        // database event notifications.
+        void validatePublishChannel(const std::string& channel) {
+            uassert(18555,
+                    mongoutils::str::stream() << "The \"$events\" channel is reserved for"
+                                              << "database event notifications.",
+                    !StringData(channel).startsWith("$events"));
+            uassert(18571,
+                    mongoutils::str::stream() << "The \"" << DataEventInterest::kAnnounceChannel
+                                              << "\" channel is reserved for internal use.",
+                    !StringData(channel).startsWith(DataEventInterest::kAnnounceChannel));
+            uassert(18586,
+                    mongoutils::str::stream() << "Cannot publish to " << channel << ", which "
+                                              << "is a channel pattern.",
+                    !ChannelPattern::isPattern(channel));
+        }
 
         // Helper method to validate single or array of SubscriptionId arguments
         void validate(BSONElement& element, std::set<OID>& oids) {
@@ -99,6 +163,16 @@ namespace mongo {
      *    publish: <string>, // name of channel to publish to.
      *    message: <Object>  // the body of the message to publish. Can have any format desired.
      * }
+     *
+     * or, to publish many messages at once:
+     * {
+     *    publish: <string>, // name of channel to publish to unless a message gives its own.
+     *    messages: <Array>  // messages to publish, in order. Each has format:
+     *        {
+     *           message: <Object>, // the body of the message to publish
+     *           [channel]: <string> // channel to publish this message to instead
+     *        }
+     * }
      */
     class PublishCommand : public Command {
     public:
@@ -120,7 +194,8 @@ namespace mongo {
         }
 
         virtual void help(stringstream &help) const {
-            help << "{ publish : <channel>, message : {} }";
+            help << "{ publish : <channel>, message : {} } or "
+                 << "{ publish : <channel>, messages : [ { message : {}, channel : <channel> } ] }";
         }
 
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg,
@@ -139,11 +214,10 @@ namespace mongo {
 
             string channel = channelElem.String();
 
-            // $events channel is reserved for DB events
-            uassert(18555,
-                    mongoutils::str::stream() << "The \"$events\" channel is reserved for"
-                                              << "database event notifications.",
-                    !StringData(channel).startsWith("$events"));
+            if (cmdObj.hasField(kMessagesField))
+                return publishBatch(channel, cmdObj);
+
+            validatePublishChannel(channel);
 
             // ensure that message argument exists
             uassert(18552,
@@ -168,6 +242,62 @@ namespace mongo {
             return true;
         }
 
+    private:
+        // The messages array form of publish. Every message is validated before any is
+        // published, so a batch with an invalid message publishes nothing.
+        bool publishBatch(const string& defaultChannel, const BSONObj& cmdObj) {
+            uassert(18566,
+                    "The publish command takes either a message or a messages argument, not both.",
+                    !cmdObj.hasField(kMessageField));
+
+            BSONElement messagesElem = cmdObj[kMessagesField];
+            uassert(18567,
+                    mongoutils::str::stream() << "The messages argument to the publish command "
+                                              << "must be an array but was a "
+                                              << typeName(messagesElem.type()),
+                    messagesElem.type() == mongo::Array);
+
+            std::vector<PubSubSendSocket::ChannelMessage> messages;
+            BSONObjIterator it(messagesElem.Obj());
+            while (it.more()) {
+                BSONElement entryElem = it.next();
+                uassert(18568,
+                        mongoutils::str::stream() << "Each member of the messages array must be "
+                                                  << "a document but found a "
+                                                  << typeName(entryElem.type()),
+                        entryElem.type() == mongo::Object);
+                BSONObj entry = entryElem.Obj();
+
+                string channel = defaultChannel;
+                if (entry.hasField(kChannelField)) {
+                    BSONElement channelElem = entry[kChannelField];
+                    uassert(18569,
+                            mongoutils::str::stream() << "The channel of a message in the "
+                                                      << "messages array must be a string but "
+                                                      << "was a "
+                                                      << typeName(channelElem.type()),
+                            channelElem.type() == mongo::String);
+                    channel = channelElem.String();
+                }
+                validatePublishChannel(channel);
+
+                BSONElement messageElem = entry[kMessageField];
+                uassert(18570,
+                        mongoutils::str::stream() << "Each member of the messages array must "
+                                                  << "have a message document but found a "
+                                                  << typeName(messageElem.type()),
+                        messageElem.type() == mongo::Object);
+
+                messages.push_back(std::make_pair(channel, messageElem.Obj()));
+            }
+
+            bool success = PubSubSendSocket::publish(messages);
+
+            uassert(18596, "Failed to publish message.", success);
+
+            return true;
+        }
+
     } publishCmd;
 
 
@@ -177,11 +307,27 @@ namespace mongo {
      * Format:
      * {
      *    subscribe: <string> // name of channel to subscribe to.
+     *    [filter]: <Object> // only receive messages matching this filter
+     *    [projection]: <Object> // fields of each message to receive
+     *    [maxQueueMessages]: <Number> // max messages queued between polls
+     *    [maxQueueBytes]: <Number> // max total size of messages queued between polls
+     *    [overflowPolicy]: <string> // "dropOldest", "dropNewest" or "disconnect"
+     *    [idleTimeout]: <Number> // milliseconds after which an unpolled subscription is removed
+     *    [ephemeral]: <Bool> // remove the subscription when this client connection closes
+     *    [cursor]: <Object> // also return a cursor that streams messages through getMore
+     *    [startAt]: <ObjectId|Date> // on a durable channel, first receive the stored messages
+     *                               // after this message _id or from this date
      * }
      *
      * Return value:
      * {
      *    subscriptionId: <ObjectId> // ID of subscription created
+     *    cursor: <Object> // returned if and only if a cursor was requested. Has format:
+     *        {
+     *           id: <NumberLong>, // cursor ID to pass to getMore and killCursors
+     *           ns: <string>, // <db>.<channel>
+     *           firstBatch: <Array> // always empty
+     *        }
      * }
      *
      */
@@ -205,7 +351,11 @@ namespace mongo {
         }
 
         virtual void help(stringstream &help) const {
-            help << "{ subscribe : <channel>, filter : <BSONObj>, projection : <BSONObj> }";
+            help << "{ subscribe : <channel>, filter : <BSONObj>, projection : <BSONObj>, "
+                 << "maxQueueMessages : <integer>, maxQueueBytes : <integer>, "
+                 << "overflowPolicy : <\"dropOldest\"|\"dropNewest\"|\"disconnect\">, "
+                 << "idleTimeout : <integer milliseconds>, ephemeral : <bool>, "
+                 << "cursor : {}, startAt : <ObjectId|Date> }";
         }
 
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg,
@@ -249,11 +399,105 @@ namespace mongo {
             }
 
 
+            // limits not given in the command are taken from the server parameters
+            SubscriptionLimits limits = SubscriptionLimits::defaults();
+            if (cmdObj.hasField(kMaxQueueMessagesField)) {
+                BSONElement maxElem = cmdObj[kMaxQueueMessagesField];
+                uassert(18561, mongoutils::str::stream() << "The maxQueueMessages argument to "
+                                                         << "the subscribe command must be a "
+                                                         << "number but was a "
+                                                         << typeName(maxElem.type()),
+                        maxElem.isNumber());
+                limits.maxMessages = maxElem.numberLong();
+            }
+
+            if (cmdObj.hasField(kMaxQueueBytesField)) {
+                BSONElement maxElem = cmdObj[kMaxQueueBytesField];
+                uassert(18562, mongoutils::str::stream() << "The maxQueueBytes argument to "
+                                                         << "the subscribe command must be a "
+                                                         << "number but was a "
+                                                         << typeName(maxElem.type()),
+                        maxElem.isNumber());
+                limits.maxBytes = maxElem.numberLong();
+            }
+
+            if (cmdObj.hasField(kOverflowPolicyField)) {
+                BSONElement policyElem = cmdObj[kOverflowPolicyField];
+                uassert(18563, mongoutils::str::stream() << "The overflowPolicy argument to "
+                                                         << "the subscribe command must be one "
+                                                         << "of \"dropOldest\", \"dropNewest\" "
+                                                         << "or \"disconnect\"",
+                        policyElem.type() == mongo::String &&
+                        SubscriptionLimits::parseOverflowPolicy(policyElem.String(),
+                                                                &limits.overflowPolicy));
+            }
+
+            if (cmdObj.hasField(kIdleTimeoutField)) {
+                BSONElement idleElem = cmdObj[kIdleTimeoutField];
+                uassert(18590, mongoutils::str::stream() << "The idleTimeout argument to the "
+                                                         << "subscribe command must be a "
+                                                         << "positive number",
+                        idleElem.isNumber() && idleElem.numberLong() > 0);
+                limits.idleTimeoutMillis = idleElem.numberLong();
+            }
+
+            long long connectionId = 0;
+            if (cmdObj.hasField(kEphemeralField)) {
+                BSONElement ephemeralElem = cmdObj[kEphemeralField];
+                uassert(18591, mongoutils::str::stream() << "The ephemeral argument to the "
+                                                         << "subscribe command must be a "
+                                                         << "boolean but was a "
+                                                         << typeName(ephemeralElem.type()),
+                        ephemeralElem.type() == mongo::Bool);
+
+                if (ephemeralElem.Bool()) {
+                    ClientBasic* client = ClientBasic::getCurrent();
+                    uassert(18592, "Ephemeral subscriptions require a client connection.",
+                            client && client->port());
+                    connectionId = client->port()->connectionId();
+                }
+            }
+
+            bool useCursor = false;
+            if (cmdObj.hasField(kCursorField)) {
+                BSONElement cursorElem = cmdObj[kCursorField];
+                uassert(18565, mongoutils::str::stream() << "The cursor argument to the "
+                                                         << "subscribe command must be an "
+                                                         << "object but was a "
+                                                         << typeName(cursorElem.type()),
+                        cursorElem.type() == mongo::Object);
+                useCursor = true;
+            }
+
+            BSONElement startAt;
+            if (cmdObj.hasField(kStartAtField)) {
+                startAt = cmdObj[kStartAtField];
+                uassert(18572, mongoutils::str::stream() << "The startAt argument to the "
+                                                         << "subscribe command must be an "
+                                                         << "ObjectId or Date but was a "
+                                                         << typeName(startAt.type()),
+                        startAt.type() == mongo::jstOID || startAt.type() == mongo::Date);
+            }
+
             // TODO: add secure access to this channel?
             // perhaps return an <oid, key> pair?
-            OID oid = PubSub::subscribe(channel, filter, projection);
+            OID oid = PubSub::subscribe(channel,
+                                        filter,
+                                        projection,
+                                        limits,
+                                        startAt,
+                                        connectionId);
             result.append(kSubscriptionId, oid);
 
+            if (useCursor) {
+                // messages are only ever returned by getMore, so the first batch is empty
+                BSONObjBuilder cursor(result.subobjStart(kCursorField));
+                cursor.append("id", PubSub::openCursor(oid));
+                cursor.append("ns", dbname + "." + channel);
+                cursor.appendArray("firstBatch", BSONObj());
+                cursor.done();
+            }
+
             return true;
         }
 
@@ -267,6 +511,13 @@ namespace mongo {
      * {
      *    subscriptionId: <ObjectId | Array>, // ID or IDs of subscriptions to poll on
      *    [timeout]: <Number>  // number of milliseconds to wait if there are no new messages.
+     *    [afterSeq]: <Object> // { channel: <Number> } last seq the client has seen on each
+     *                         // channel. Messages after it that were returned by an earlier
+     *                         // poll are returned again, ahead of new ones.
+     *    [maxMessages]: <Number> // most messages returned, shared fairly between the
+     *                            // subscriptions. 0 is unlimited.
+     *    [maxBytes]: <Number> // most total message bytes returned, unless the first message
+     *                         // alone is larger. 0 is unlimited.
      * }
      *
      * Return value:
@@ -283,6 +534,22 @@ namespace mongo {
      *           subscriptionId2: <string>,
      *           ...
      *        }
+     *    droppedMessages: <Object>, // returned if and only if any subscription dropped
+     *                               // messages because its queue limit was exceeded
+     *                               // since it was last polled. Has format:
+     *        {
+     *           subscriptionId: <Long>, // key is ID, value is number of messages dropped
+     *           ...
+     *        }
+     *    seqs: <Object>, // seq of each returned message, in the same layout as messages.
+     *    storedIds: <Object>, // returned if and only if any returned message is stored on a
+     *                         // durable channel. The _id it is stored under, or null, for
+     *                         // each returned message in the same layout as messages.
+     *    gaps: <Object>, // returned if and only if messages requested by afterSeq could not be
+     *                    // returned again because they left the replay buffer. Has format:
+     *        {
+     *           subscriptionId: [ { channel: <string>, from: <Long>, to: <Long> }, ... ]
+     *        }
      *    millisPolled: <Integer>, // number of milliseconds command waited before finding messages.
      *    [pollAgain]: <Bool> // returned as true only if poll gets no messages and times out.
      * }
@@ -307,7 +574,9 @@ namespace mongo {
         }
 
         virtual void help(stringstream &help) const {
-            help << "{ poll : <subscriptionId(s)>, timeout : <integer milliseconds> }";
+            help << "{ poll : <subscriptionId(s)>, timeout : <integer milliseconds>, "
+                 << "afterSeq : { <channel> : <seq> }, maxMessages : <integer>, "
+                 << "maxBytes : <integer> }";
         }
 
         bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg,
@@ -343,37 +612,116 @@ namespace mongo {
                 }
             }
 
+            std::map<std::string, unsigned long long> afterSeqs;
+            BSONElement afterSeqElem = cmdObj[kAfterSeqField];
+            if (!afterSeqElem.eoo()) {
+                uassert(18582,
+                        mongoutils::str::stream() << "The afterSeq argument must be an object "
+                                                  << "but was a "
+                                                  << typeName(afterSeqElem.type()),
+                        afterSeqElem.type() == Object);
+
+                BSONObjIterator it(afterSeqElem.Obj());
+                while (it.more()) {
+                    BSONElement seqElem = it.next();
+                    uassert(18583,
+                            mongoutils::str::stream() << "The afterSeq value for channel "
+                                                      << seqElem.fieldName()
+                                                      << " must be a non-negative number",
+                            seqElem.isNumber() && seqElem.numberLong() >= 0);
+                    afterSeqs[seqElem.fieldName()] = seqElem.numberLong();
+                }
+            }
+
+            // messages past the limits stay queued for the next poll
+            long long maxMessages = pubsubPollMaxMessages;
+            if (cmdObj.hasField(kMaxMessagesField)) {
+                BSONElement maxElem = cmdObj[kMaxMessagesField];
+                uassert(18588, mongoutils::str::stream() << "The maxMessages argument to the "
+                                                         << "poll command must be a "
+                                                         << "non-negative number",
+                        maxElem.isNumber() && maxElem.numberLong() >= 0);
+                maxMessages = maxElem.numberLong();
+            }
+
+            long long maxBytes = pubsubPollMaxBytes;
+            if (cmdObj.hasField(kMaxBytesField)) {
+                BSONElement maxElem = cmdObj[kMaxBytesField];
+                uassert(18589, mongoutils::str::stream() << "The maxBytes argument to the "
+                                                         << "poll command must be a "
+                                                         << "non-negative number",
+                        maxElem.isNumber() && maxElem.numberLong() >= 0);
+                maxBytes = maxElem.numberLong();
+            }
+
             long long millisPolled = 0;
             bool pollAgain = false;
             std::map<SubscriptionId, std::string> errors;
-            std::priority_queue<SubscriptionMessage> messages = PubSub::poll(oids,
-                                                                             timeout,
-                                                                             millisPolled,
-                                                                             pollAgain,
-                                                                             errors);
-
-            // serialize messages into BSON
-            BSONObjBuilder messagesBuilder;
-            while (!messages.empty()) {
-                SubscriptionMessage sm = messages.top();
-                SubscriptionId currId = sm.subscriptionId;
-                BSONObjBuilder channelBuilder;
-                while (!messages.empty() && sm.subscriptionId == currId) {
-                    std::string currChannel = sm.channel;
-                    BSONArrayBuilder arrayBuilder;
-                    while (sm.subscriptionId == currId && sm.channel == currChannel) {
-                        arrayBuilder.append(sm.message);
-                        messages.pop();
-                        if (messages.empty())
-                            break;
-                        sm = messages.top();
+            std::map<SubscriptionId, long long> droppedMessages;
+            std::map<SubscriptionId, std::vector<SequenceGap> > gaps;
+            std::vector<SubscriptionMessage> messages = PubSub::poll(oids,
+                                                                     timeout,
+                                                                     millisPolled,
+                                                                     pollAgain,
+                                                                     errors,
+                                                                     droppedMessages,
+                                                                     std::max(maxMessages, 0LL),
+                                                                     std::max(maxBytes, 0LL),
+                                                                     &afterSeqs,
+                                                                     &gaps);
+
+            // serialize messages straight into the reply. messages are grouped by
+            // subscription and channel, and their bodies are copied once, from the
+            // received zmq frame into the reply buffer. their seqs are collected alongside
+            // in the same layout, as are the ids of stored messages.
+            BSONObjBuilder seqsBuilder;
+            BSONObjBuilder storedIdsBuilder;
+            bool anyStored = false;
+            {
+                BSONObjBuilder messagesBuilder(result.subobjStart(kMessagesField));
+                std::vector<SubscriptionMessage>::const_iterator it = messages.begin();
+                while (it != messages.end()) {
+                    SubscriptionId currId = it->subscriptionId;
+                    BSONObjBuilder channelBuilder(
+                        messagesBuilder.subobjStart(currId.toString()));
+                    BSONObjBuilder channelSeqsBuilder(seqsBuilder.subobjStart(currId.toString()));
+                    BSONObjBuilder channelStoredIdsBuilder(
+                        storedIdsBuilder.subobjStart(currId.toString()));
+                    while (it != messages.end() && it->subscriptionId == currId) {
+                        const std::string& currChannel = it->channel();
+                        BSONArrayBuilder arrayBuilder(channelBuilder.subarrayStart(currChannel));
+                        BSONArrayBuilder seqArrayBuilder(
+                            channelSeqsBuilder.subarrayStart(currChannel));
+                        BSONArrayBuilder storedIdArrayBuilder(
+                            channelStoredIdsBuilder.subarrayStart(currChannel));
+                        while (it != messages.end() &&
+                               it->subscriptionId == currId &&
+                               it->channel() == currChannel) {
+                                arrayBuilder.append(it->message);
+                                seqArrayBuilder.append(static_cast<long long>(it->seq()));
+                                if (it->storedId().isSet()) {
+                                    storedIdArrayBuilder.append(it->storedId());
+                                    anyStored = true;
+                                }
+                                else {
+                                    storedIdArrayBuilder.appendNull();
+                                }
+                                it++;
+                        }
+                        arrayBuilder.done();
+                        seqArrayBuilder.done();
+                        storedIdArrayBuilder.done();
                     }
-                    channelBuilder.append(currChannel, arrayBuilder.arr());
+                    channelBuilder.done();
+                    channelSeqsBuilder.done();
+                    channelStoredIdsBuilder.done();
                 }
-                messagesBuilder.append(currId.toString(), channelBuilder.obj());
+                messagesBuilder.done();
             }
+            result.append(kSeqsField, seqsBuilder.obj());
+            if (anyStored)
+                result.append(kStoredIdsField, storedIdsBuilder.obj());
 
-            result.append(kMessagesField, messagesBuilder.obj());
             result.append(kMillisPolledField, millisPolled);
             if (pollAgain)
                 result.append(kPollAgainField, true);
@@ -388,6 +736,34 @@ namespace mongo {
                 result.append(kErrorField, errorBuilder.obj());
             }
 
+            if (droppedMessages.size() > 0) {
+                BSONObjBuilder droppedBuilder;
+                for (std::map<SubscriptionId, long long>::iterator it = droppedMessages.begin();
+                     it != droppedMessages.end();
+                     it++) {
+                        droppedBuilder.append(it->first.toString(), it->second);
+                }
+                result.append(kDroppedMessagesField, droppedBuilder.obj());
+            }
+
+            if (gaps.size() > 0) {
+                BSONObjBuilder gapsBuilder;
+                for (std::map<SubscriptionId, std::vector<SequenceGap> >::iterator it =
+                         gaps.begin();
+                     it != gaps.end();
+                     it++) {
+                        BSONArrayBuilder subGaps(gapsBuilder.subarrayStart(it->first.toString()));
+                        for (size_t i = 0; i < it->second.size(); i++) {
+                            const SequenceGap& gap = it->second[i];
+                            subGaps.append(BSON(kChannelField << gap.channel
+                                             << kFromField << static_cast<long long>(gap.from)
+                                             << kToField << static_cast<long long>(gap.to)));
+                        }
+                        subGaps.done();
+                }
+                result.append(kGapsField, gapsBuilder.obj());
+            }
+
             return true;
         }
 
@@ -465,4 +841,126 @@ namespace mongo {
 
     } unsubscribeCmd;
 
+
+    /**
+     * Command for reporting pubsub metrics on this node in more detail than serverStatus.
+     *
+     * Format:
+     * {
+     *    pubsubStats: 1,
+     *    [channels]: <Number>, // how many of the busiest channels to list, default 100
+     *    [subscriptions]: <Number> // how many of the fullest subscriptions to list, default 100
+     * }
+     *
+     * Return value:
+     * {
+     *    <the pubsub section of serverStatus>,
+     *    channels: { // channels with the most messages routed, keyed on channel
+     *       <channel>: { messages: <Long>, bytes: <Long>, deliveries: <Long>,
+     *                    filtersEvaluated: <Long>, filtersRejected: <Long> },
+     *       ...
+     *    },
+     *    subscriptions: [ // subscriptions with the most queued messages
+     *       { subscriptionId: <ObjectId>, channel: <string>, queuedMessages: <Long>,
+     *         queuedBytes: <Long>, droppedMessages: <Long>, cursorId: <Long> },
+     *       ...
+     *    ],
+     *    filterMicros: [ // time spent evaluating filters on each routed message
+     *       { micros: <Long>, count: <Long> }, // messages taking at most micros
+     *       ...
+     *    ]
+     * }
+     */
+    class PubSubStatsCommand : public Command {
+    public:
+        PubSubStatsCommand() : Command("pubsubStats") {}
+
+        virtual bool slaveOk() const { return true; }
+        virtual bool slaveOverrideOk() const { return true; }
+        virtual bool isWriteCommandForConfigServer() const { return false; }
+
+        virtual LockType locktype() const { return NONE; }
+
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {
+            ActionSet actions;
+            actions.addAction(ActionType::serverStatus);
+            out->push_back(Privilege(ResourcePattern::forClusterResource(), actions));
+        }
+
+        virtual void help(stringstream &help) const {
+            help << "{ pubsubStats : 1, [channels : <count>], [subscriptions : <count>] }";
+        }
+
+        bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg,
+                 BSONObjBuilder& result, bool fromRepl) {
+
+            uassert(18594, "PubSub is not enabled.", pubsubEnabled);
+
+            size_t maxChannels = statsEntries(cmdObj, kChannelsField);
+            size_t maxSubscriptions = statsEntries(cmdObj, kSubscriptionsField);
+
+            appendStatus(&result);
+
+            BSONObjBuilder channelsBuilder(result.subobjStart(kChannelsField));
+            PubSubStats::appendChannels(&channelsBuilder, maxChannels);
+            channelsBuilder.done();
+
+            PubSub::appendSubscriptionStats(&result, maxSubscriptions);
+            PubSubStats::appendFilterMicros(&result);
+            return true;
+        }
+
+    } pubsubStatsCmd;
+
+
+    /**
+     * pubsub section of serverStatus.
+     *
+     * Format:
+     * {
+     *    subscriptions: <Long>, // subscriptions on this node
+     *    published: <Long>, // messages published on this node, including data events
+     *    publishedBytes: <Long>,
+     *    returned: <Long>, // messages returned to subscribers by poll and getMore
+     *    returnedBytes: <Long>,
+     *    routed: { // messages received by this node, across all channels
+     *       messages: <Long>,
+     *       bytes: <Long>,
+     *       deliveries: <Long>, // times a message was queued for a subscription
+     *       filtersEvaluated: <Long>, // distinct subscription filters evaluated
+     *       filtersRejected: <Long> // of which did not match the message
+     *    },
+     *    links: {
+     *       send: <LinkStats>, // messages published to other nodes
+     *       [dbEvents]: <LinkStats>, // on shard mongods, data events published to the
+     *                                // mongoses
+     *       receive: <LinkStats>, // messages received from other nodes and from this one
+     *       [mongosPeers]: [ <host:port>, ... ] // on mongoses and shard mongods, the
+     *                                           // mongoses this node publishes to
+     *    }
+     * }
+     *
+     * where each <LinkStats> is
+     * { messages: <Long>, compressedMessages: <Long>, bytes: <Long>, wireBytes: <Long> },
+     * bytes counting message bodies before compression and wireBytes after.
+     */
+    class PubSubServerStatus : public ServerStatusSection {
+    public:
+        PubSubServerStatus() : ServerStatusSection("pubsub") {}
+
+        virtual bool includeByDefault() const { return true; }
+
+        virtual BSONObj generateSection(const BSONElement& configElement) const {
+            if (!pubsubEnabled)
+                return BSONObj();
+
+            BSONObjBuilder result;
+            appendStatus(&result);
+            return result.obj();
+        }
+
+    } pubsubServerStatus;
+
 }  // namespace mongo
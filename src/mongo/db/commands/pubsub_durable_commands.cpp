@@ -0,0 +1,135 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include <string>
+#include <vector>
+
+#include "mongo/db/auth/action_set.h"
+#include "mongo/db/auth/action_type.h"
+#include "mongo/db/auth/privilege.h"
+#include "mongo/db/commands.h"
+#include "mongo/db/namespace_string.h"
+#include "mongo/db/pubsub.h"
+#include "mongo/db/pubsub_durable.h"
+
+namespace mongo {
+
+    namespace {
+
+        // constants for field names
+        const std::string kCreateDurableChannelField = "createDurableChannel";
+        const std::string kSizeField = "size";
+        const std::string kMaxField = "max";
+
+    }
+
+    /**
+     * Command for making a channel durable on this mongod. Messages the mongod receives on
+     * the channel from then on are stored in a capped collection, and subscriptions to it
+     * can start from a past position with the startAt argument of subscribe.
+     *
+     * Format:
+     * {
+     *    createDurableChannel: <string> // name of the channel
+     *    size: <Number> // max total size in bytes of the stored messages
+     *    [max]: <Number> // max number of stored messages
+     * }
+     *
+     * Return value:
+     * {
+     *    ok: <Number>
+     * }
+     */
+    class CreateDurableChannelCommand : public Command {
+    public:
+        CreateDurableChannelCommand() : Command("createDurableChannel") {}
+
+        virtual bool slaveOk() const { return true; }
+        virtual bool isWriteCommandForConfigServer() const { return false; }
+
+        virtual LockType locktype() const { return NONE; }
+
+        virtual void addRequiredPrivileges(const std::string& dbname,
+                                           const BSONObj& cmdObj,
+                                           std::vector<Privilege>* out) {
+            ActionSet actions;
+            actions.addAction(ActionType::createCollection);
+            actions.addAction(ActionType::insert);
+            out->push_back(Privilege(ResourcePattern::forDatabaseName("local"), actions));
+        }
+
+        virtual void help(stringstream &help) const {
+            help << "{ createDurableChannel : <channel>, size : <bytes>, max : <messages> }";
+        }
+
+        bool run(const string& dbname, BSONObj& cmdObj, int, string& errmsg,
+                 BSONObjBuilder& result, bool fromRepl) {
+
+            uassert(18581, "PubSub is not enabled.", pubsubEnabled);
+
+            BSONElement channelElem = cmdObj[kCreateDurableChannelField];
+
+            // the channel names a collection, and channels starting with $ are reserved
+            uassert(18578,
+                    mongoutils::str::stream() << "The channel passed to the "
+                                              << "createDurableChannel command must be a "
+                                              << "valid collection name not starting with $ "
+                                              << "and not a channel pattern",
+                    channelElem.type() == mongo::String &&
+                    NamespaceString::validCollectionName(channelElem.valuestr()) &&
+                    !ChannelPattern::isPattern(channelElem.valuestr()));
+            string channel = channelElem.String();
+
+            BSONElement sizeElem = cmdObj[kSizeField];
+            uassert(18579,
+                    mongoutils::str::stream() << "The size argument to the "
+                                              << "createDurableChannel command must be a "
+                                              << "positive number",
+                    sizeElem.isNumber() && sizeElem.numberLong() > 0);
+
+            long long maxMessages = 0;
+            if (cmdObj.hasField(kMaxField)) {
+                BSONElement maxElem = cmdObj[kMaxField];
+                uassert(18580,
+                        mongoutils::str::stream() << "The max argument to the "
+                                                  << "createDurableChannel command must be a "
+                                                  << "number but was a "
+                                                  << typeName(maxElem.type()),
+                        maxElem.isNumber());
+                maxMessages = maxElem.numberLong();
+            }
+
+            DurableChannels::create(channel, sizeElem.numberLong(), maxMessages);
+            return true;
+        }
+
+    } createDurableChannelCmd;
+
+}  // namespace mongo
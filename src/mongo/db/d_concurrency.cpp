@@ -39,6 +39,7 @@
 #include "mongo/db/dur.h"
 #include "mongo/db/lockstat.h"
 #include "mongo/db/namespace_string.h"
+#include "mongo/db/pubsub_data_events.h"
 #include "mongo/server.h"
 #include "mongo/util/assert_util.h"
 #include "mongo/util/concurrency/mapsf.h"
@@ -111,6 +112,7 @@ namespace mongo {
     static void locked_W();
     static void unlocking_w();
     static void unlocking_W();
+    static void unlocked_global();
 
     class WrapperForQLock { 
         QLock q;
@@ -181,6 +183,7 @@ namespace mongo {
             wassert( threadState() == 'w' );
             lockState().unlocked();
             q.unlock_w(); 
+            unlocked_global();
         }
 
         void unlock_R() { _unlock_R(); }
@@ -190,6 +193,7 @@ namespace mongo {
             unlocking_W();
             lockState().unlocked();
             q.unlock_W(); 
+            unlocked_global();
         }
 
         // todo timing stats? : 
@@ -203,6 +207,7 @@ namespace mongo {
             wassert( threadState() == 'R' );
             lockState().unlocked();
             q.unlock_R(); 
+            unlocked_global(); // R may have been downgraded from W
         }
     };
 
@@ -808,6 +813,10 @@ namespace mongo {
     void unlocking_W() {
         dur::releasingWriteLock();
     }
+    void unlocked_global() {
+        // publish the events of writes made under the lock now that it is released
+        DataEvents::publishRecorded();
+    }
 
     class GlobalLockServerStatusSection : public ServerStatusSection {
     public:
@@ -74,6 +74,7 @@
 #include "mongo/db/ops/update_request.h"
 #include "mongo/db/pagefault.h"
 #include "mongo/db/query/new_find.h"
+#include "mongo/db/pubsub_sendsock.h"
 #include "mongo/db/repl/is_master.h"
 #include "mongo/db/repl/oplog.h"
 #include "mongo/db/stats/counters.h"
@@ -540,6 +541,15 @@ namespace mongo {
 
         int found = CollectionCursorCache::eraseCursorGlobalIfAuthorized(n, (long long *) x);
 
+        // subscription cursors are not in the cursor cache
+        if ( pubsubKillCursor ) {
+            long long* ids = (long long *) x;
+            for ( int i = 0; i < n; i++ ) {
+                if ( isPubSubCursorId( ids[i] ) && pubsubKillCursor( ids[i] ) )
+                    found++;
+            }
+        }
+
         if ( logger::globalLogDomain()->shouldLog(logger::LogSeverity::Debug(1)) || found != n ) {
             LOG( found == n ? 1 : 0 ) << "killcursors: found " << found << " of " << n << endl;
         }
@@ -722,13 +732,19 @@ namespace mongo {
                     }
                 }
 
-                msgdata = newGetMore(ns,
-                                     ntoreturn,
-                                     cursorid,
-                                     curop,
-                                     pass,
-                                     exhaust,
-                                     &isCursorAuthorized);
+                if (pubsubGetMore && isPubSubCursorId(cursorid)) {
+                    // subscription cursors wait for messages themselves
+                    msgdata = pubsubGetMore(cursorid, ntoreturn);
+                }
+                else {
+                    msgdata = newGetMore(ns,
+                                         ntoreturn,
+                                         cursorid,
+                                         curop,
+                                         pass,
+                                         exhaust,
+                                         &isCursorAuthorized);
+                }
             }
             catch ( AssertionException& e ) {
                 if ( isCursorAuthorized ) {
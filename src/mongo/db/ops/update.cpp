@@ -46,7 +46,7 @@
 #include "mongo/db/ops/update_lifecycle.h"
 #include "mongo/db/pagefault.h"
 #include "mongo/db/pdfile.h"
-#include "mongo/db/pubsub_sendsock.h"
+#include "mongo/db/pubsub_data_events.h"
 #include "mongo/db/query/get_runner.h"
 #include "mongo/db/query/lite_parsed_query.h"
 #include "mongo/db/query/query_planner_common.h"
@@ -606,10 +606,6 @@ namespace mongo {
             DiskLoc loc;
             state = runner->getNext(&oldObj, &loc);
 
-            BSONObj oldObjOwned;
-            if (pubsubEnabled && publishDataEvents)
-                oldObjOwned = oldObj.getOwned();
-            
             const bool didYield = (oldYieldCount != curOp->numYields());
 
             if (state != Runner::RUNNER_ADVANCED) {
@@ -719,6 +715,10 @@ namespace mongo {
                 }
             }
 
+            // The old document must be recorded before it is changed in place or moved
+            if (DataEvents::enabled(nsString, DataEventInterest::kUpdate))
+                DataEvents::beginUpdate(nsString, oldObj);
+
             // Save state before making changes
             runner->saveState();
 
@@ -791,16 +791,8 @@ namespace mongo {
             if (docWasModified)
                 opDebug->nModified++;
 
-            if (pubsubEnabled && publishDataEvents) {
-                BSONObj updateObject = BSON("old" << oldObjOwned << "new" << newObj);
-                BSONObj publishObject = BSON("db" << nsString.db() <<
-                                             "collection" << nsString.coll() <<
-                                             "type" << "update" <<
-                                             "doc" << updateObject);
-                bool success = PubSubSendSocket::publish("$events", publishObject);
-                if (!success)
-                    log() << "Error publishing DB event." << endl;
-            }
+            if (DataEvents::enabled(nsString, DataEventInterest::kUpdate))
+                DataEvents::finishUpdate(newObj, logObj);
 
             if (!request.isMulti()) {
                 break;
@@ -30,64 +30,313 @@
 
 #include "mongo/db/pubsub.h"
 
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <cstdlib>
+#include <limits>
 #include <time.h>
 #include <zmq.hpp>
 
 #include "mongo/db/pubsub_sendsock.h"
+#include "mongo/db/pubsub_stats.h"
 #include "mongo/db/server_options_helpers.h"
 #include "mongo/db/server_parameters.h"
+#include "mongo/platform/random.h"
+#include "mongo/util/timer.h"
 
 namespace mongo {
 
     MONGO_EXPORT_SERVER_PARAMETER(useDebugTimeout, bool, false);
 
+    // default limits on the messages queued for a subscription between polls, used for
+    // subscriptions that do not set their own. 0 or less is unlimited.
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubMaxQueueMessages, int, 100 * 1000);
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubMaxQueueBytes, int, 64 * 1024 * 1024);
+
+    // default limits on the messages returned by a single poll, used for polls that do not
+    // set their own. they keep replies well within the maximum BSON object size. 0 or less
+    // is unlimited.
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubPollMaxMessages, int, 100 * 1000);
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubPollMaxBytes, int, 8 * 1024 * 1024);
+
+    // how long a subscription which sets no idle timeout of its own is kept without being
+    // polled
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubIdleTimeoutMillis, int, 10 * 60 * 1000);
+
+    // total size of the recently received messages kept for polls with afterSeq. 0 or less
+    // keeps none.
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubReplayBufferBytes, int, 16 * 1024 * 1024);
+
+    // number of threads routing received messages to subscriptions. the channels are split
+    // between them by hash.
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(pubsubDispatchThreads, int, 1);
+
+    // number of zmq I/O threads serving the connections to other nodes
+    MONGO_EXPORT_STARTUP_SERVER_PARAMETER(pubsubIOThreads, int, 1);
+
     namespace {
-        // used as a timeout for polling and cleaning up inactive subscriptions
+        // the longest a poll waits for messages
         long maxTimeoutMillis = 1000 * 60 * 10;
+
+        // resolution of the idle timeouts of subscriptions
+        const long long kExpiryTickMillis = 100;
+
+        const char kOverflowedError[] =
+            "Subscription removed because its queue limit was exceeded.";
+        const char kPollActiveError[] = "Poll currently active.";
+
+        // how long a getMore on a subscription cursor waits for messages before returning an
+        // empty batch, and the most bytes of messages it returns in a batch
+        const long kCursorWaitMillis = 4 * 1000;
+        const size_t kCursorMaxBatchBytes = 4 * 1024 * 1024;
+
+        const char kCursorChannelField[] = "channel";
+        const char kCursorMessageField[] = "message";
+        const char kCursorSeqField[] = "seq";
+        const char kCursorStoredIdField[] = "storedId";
+        const char kCursorDroppedMessagesField[] = "droppedMessages";
+
+        // most stored messages a subscription catching up on a durable channel reads per poll
+        const size_t kCatchUpBatchMessages = 1000;
+
+        bool bySubscriptionAndChannel(const SubscriptionMessage& a, const SubscriptionMessage& b) {
+            if (a.subscriptionId != b.subscriptionId)
+                return a.subscriptionId < b.subscriptionId;
+            return a.channel() < b.channel();
+        }
+
+        // default overflow policy for subscriptions that do not set their own
+        std::string pubsubOverflowPolicy = "dropOldest";
+
+        class ExportedOverflowPolicyParameter : public ExportedServerParameter<std::string> {
+        public:
+            ExportedOverflowPolicyParameter() :
+                ExportedServerParameter<std::string>(ServerParameterSet::getGlobal(),
+                                                     "pubsubOverflowPolicy",
+                                                     &pubsubOverflowPolicy,
+                                                     true,
+                                                     true) {}
+
+            virtual Status validate(const std::string& potentialNewValue) {
+                SubscriptionLimits::OverflowPolicy policy;
+                if (!SubscriptionLimits::parseOverflowPolicy(potentialNewValue, &policy)) {
+                    return Status(ErrorCodes::BadValue,
+                                  "pubsubOverflowPolicy must be one of dropOldest, "
+                                  "dropNewest or disconnect");
+                }
+                return Status::OK();
+            }
+        } exportedOverflowPolicyParam;
+    }
+
+    SubscriptionLimits SubscriptionLimits::defaults() {
+        SubscriptionLimits limits;
+        limits.maxMessages = pubsubMaxQueueMessages;
+        limits.maxBytes = pubsubMaxQueueBytes;
+        limits.overflowPolicy = kDropOldest;
+        parseOverflowPolicy(pubsubOverflowPolicy, &limits.overflowPolicy);
+        // change timeout to 100 millis for testing
+        limits.idleTimeoutMillis = useDebugTimeout ? 100 : pubsubIdleTimeoutMillis;
+        return limits;
+    }
+
+    bool SubscriptionLimits::parseOverflowPolicy(const std::string& name,
+                                                 OverflowPolicy* out) {
+        if (name == "dropOldest")
+            *out = kDropOldest;
+        else if (name == "dropNewest")
+            *out = kDropNewest;
+        else if (name == "disconnect")
+            *out = kDisconnect;
+        else
+            return false;
+        return true;
     }
 
     SubscriptionMessage::SubscriptionMessage(SubscriptionId _subscriptionId,
-                                             std::string _channel,
-                                             BSONObj _message,
-                                             unsigned long long _timestamp) {
-        subscriptionId = _subscriptionId;
-        channel = _channel;
-        message = _message;
-        timestamp = _timestamp;
+                                             const shared_ptr<const ReceivedMessage>& _received,
+                                             BSONObj _message)
+        : subscriptionId(_subscriptionId),
+          message(_message),
+          received(_received) {
+    }
+
+    void PubSub::PollWaiter::notify() {
+        mongo::mutex::scoped_lock lk(_mutex);
+        _notified = true;
+        _condition.notify_one();
     }
 
-    bool operator<(const SubscriptionMessage& m1, const SubscriptionMessage& m2) {
-        if (m1.subscriptionId < m2.subscriptionId)
-            return true;
-        if (m1.subscriptionId == m2.subscriptionId && m1.channel < m2.channel)
-            return true;
-        if (m1.subscriptionId == m2.subscriptionId &&
-            m1.channel == m2.channel &&
-            m1.timestamp > m2.timestamp)
-            return true;
-        return false;
+    void PubSub::PollWaiter::wait(long long millis) {
+        mongo::mutex::scoped_lock lk(_mutex);
+        if (!_notified)
+            _condition.timed_wait(lk.boost(), boost::posix_time::milliseconds(millis));
+        _notified = false;
+    }
+
+    void PubSub::SubscriptionInfo::deliver(const InboxEntry& entry) {
+        if (overflowed.load())
+            return;
+
+        size_t size = entry.message.objsize();
+        while ((limits.maxMessages > 0 &&
+                inboxSize + 1 > static_cast<size_t>(limits.maxMessages)) ||
+               (limits.maxBytes > 0 &&
+                inboxBytes + size > static_cast<size_t>(limits.maxBytes))) {
+
+            if (limits.overflowPolicy == SubscriptionLimits::kDisconnect) {
+                clearInbox();
+                overflowed.store(1);
+                return;
+            }
+
+            droppedMessages++;
+
+            // a message larger than maxBytes on its own is always dropped
+            if (limits.overflowPolicy == SubscriptionLimits::kDropNewest || inboxSize == 0)
+                return;
+
+            dropOldest();
+        }
+
+        Inbox::iterator it = inbox.find(entry.received->channel);
+        if (it == inbox.end()) {
+            // the limits are enforced above, so the channel's buffer never has to drop
+            size_t maxSize = limits.maxMessages > 0 ?
+                static_cast<size_t>(limits.maxMessages) : std::numeric_limits<size_t>::max();
+            it = inbox.insert(std::make_pair(entry.received->channel,
+                                             RingBuffer<InboxEntry>(maxSize))).first;
+        }
+
+        it->second.push_back(entry);
+        inboxSize++;
+        inboxBytes += size;
+    }
+
+    void PubSub::SubscriptionInfo::dropOldest() {
+        Inbox::iterator oldest = inbox.end();
+        for (Inbox::iterator it = inbox.begin(); it != inbox.end(); it++) {
+            if (it->second.empty())
+                continue;
+            if (oldest == inbox.end() ||
+                it->second.front().received->envelope.timestamp <
+                    oldest->second.front().received->envelope.timestamp) {
+                oldest = it;
+            }
+        }
+
+        if (oldest == inbox.end())
+            return;
+
+        inboxSize--;
+        inboxBytes -= oldest->second.front().message.objsize();
+        oldest->second.pop_front();
+    }
+
+    void PubSub::SubscriptionInfo::clearInbox() {
+        inbox.clear();
+        inboxSize = 0;
+        inboxBytes = 0;
+    }
+
+    bool PubSub::SubscriptionInfo::isStoredThrough(const ReceivedMessage& received) const {
+        if (!storedThrough.isSet())
+            return false;
+        return received.storedId.isSet() && received.storedId <= storedThrough;
+    }
+
+    size_t PubSub::SubscriptionInfo::nextMessageBytes() const {
+        for (Inbox::const_iterator it = inbox.begin(); it != inbox.end(); it++) {
+            if (!it->second.empty())
+                return it->second.front().message.objsize();
+        }
+        return 0;
+    }
+
+    void PubSub::SubscriptionInfo::drainInbox(std::vector<SubscriptionMessage>* out,
+                                              size_t maxMessages,
+                                              size_t maxBytes,
+                                              bool allowLarger,
+                                              size_t* numMessages,
+                                              size_t* numBytes) {
+        *numMessages = 0;
+        *numBytes = 0;
+
+        Inbox::iterator it = inbox.begin();
+        while (it != inbox.end()) {
+            RingBuffer<InboxEntry>& buffer = it->second;
+
+            // channels without messages since the last poll are dropped, so a subscription
+            // receiving on many short lived channels does not keep a buffer for each of them
+            if (buffer.empty()) {
+                inbox.erase(it++);
+                continue;
+            }
+
+            ReturnedSeqs* channelSeqs = NULL;
+            while (!buffer.empty()) {
+                const InboxEntry& entry = buffer.front();
+                size_t size = entry.message.objsize();
+
+                if ((maxMessages > 0 && *numMessages >= maxMessages) ||
+                    (maxBytes > 0 && *numBytes + size > maxBytes &&
+                     (*numMessages > 0 || !allowLarger))) {
+                    return;
+                }
+
+                out->push_back(SubscriptionMessage(id, entry.received, entry.message));
+
+                unsigned long long seq = entry.received->seq;
+                if (seq != 0) {
+                    if (!channelSeqs) {
+                        std::map<std::string, ReturnedSeqs>::iterator seqIt =
+                            returnedSeqs.find(it->first);
+                        if (seqIt == returnedSeqs.end()) {
+                            ReturnedSeqs first = { seq, seq };
+                            seqIt = returnedSeqs.insert(std::make_pair(it->first, first)).first;
+                        }
+                        channelSeqs = &seqIt->second;
+                    }
+                    channelSeqs->last = seq;
+                }
+
+                buffer.pop_front();
+                inboxSize--;
+                inboxBytes -= size;
+                (*numMessages)++;
+                *numBytes += size;
+            }
+            it++;
+        }
     }
 
 
     /**
      * Sockets for internal communication across replsets and clusters.
      *
-     * Mongods in a replica set communicate directly, while mongoses in a cluster
-     * communicate through the config server.
-     * Further, mongod's "publish" information to each other, whereas mongoses
-     * "push" information to a queue shared between the 3 config servers.
+     * Mongods in a replica set publish to each other directly. Mongoses in a cluster
+     * likewise publish to every mongos, including themselves, and shards publish their data
+     * events to every mongos, see refreshPubSubMongosPeers. Config servers still relay
+     * messages pushed to them, for nodes which push to them rather than to the mongoses.
      */
 
-    const char* const PubSub::kIntPubSubEndpoint = "inproc://pubsub";
-
     zmq::context_t PubSub::zmqContext(1);
-    zmq::socket_t PubSub::intPubSocket(zmqContext, ZMQ_PUB);
     zmq::socket_t* PubSub::extRecvSocket = NULL;
 
+    bool (*PubSub::storeDurable)(const shared_ptr<ReceivedMessage>& received) = NULL;
+    DurableChannelReader* (*PubSub::openDurableReader)(const std::string& channel,
+                                                       const BSONElement& startAt) = NULL;
+
     zmq::socket_t* PubSub::initSendSocket() {
+        // zmq starts a context's I/O threads when its first socket is created
+        int ioThreads = std::max(static_cast<int>(pubsubIOThreads), 1);
+        zmq_ctx_set(zmqContext, ZMQ_IO_THREADS, ioThreads);
+        zmq_ctx_set(PubSubSendSocket::zmqContext, ZMQ_IO_THREADS, ioThreads);
+
         zmq::socket_t* sendSocket = NULL;
         try {
-            sendSocket = new zmq::socket_t(zmqContext, isMongos() ? ZMQ_PUSH : ZMQ_PUB);
+            sendSocket = new zmq::socket_t(zmqContext, ZMQ_PUB);
             int hwm = 0;
             sendSocket->setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm)); 
         }
@@ -130,54 +379,332 @@ namespace mongo {
         }
     }
 
-    // runs in a background thread and cleans up subscriptions
-    // that have not been polled in at least 10 minutes
     void PubSub::subscriptionCleanup() {
         if (useDebugTimeout)
             // change timeout to 100 millis for testing
             maxTimeoutMillis = 100;
         while (true) {
+            sleepmillis(kExpiryTickMillis);
+
+            long long now = curTimeMillis64();
+            std::vector<SubscriptionId> due;
             {
-                SimpleMutex::scoped_lock lk(mapMutex);
-                for (SubscriptionMap::iterator it = subscriptions.begin();
-                     it != subscriptions.end();
-                     it++) {
-                        shared_ptr<SubscriptionInfo> s = it->second;
-                        if (s->polledRecently) {
-                            s->polledRecently = 0;
-                        }
-                        else {
-                            try {
-                                s->sock->close();
-                            }
-                            catch (zmq::error_t& e) {
-                                log() << "Error closing zmq socket." << causedBy(e);
-                            }
-                            subscriptions.erase(it);
-                        }
+                SimpleMutex::scoped_lock lk(expiryMutex);
+                expiryWheel.advance(now, &due);
+            }
+
+            std::vector<std::pair<SubscriptionId, long long> > rescheduled;
+            for (size_t i = 0; i < due.size(); i++) {
+                shared_ptr<SubscriptionInfo> s = findSubscription(due[i]);
+                if (!s)
+                    continue;
+
+                // a subscription being polled is not idle. it is checked again a full idle
+                // timeout after the poll, which can be at most maxTimeoutMillis away.
+                long long deadline = s->lastActiveMillis.load() + s->limits.idleTimeoutMillis;
+                if (deadline > now || s->inUse.load()) {
+                    rescheduled.push_back(std::make_pair(due[i],
+                                                         std::max(deadline, now + 1)));
+                }
+                else if (s->inUse.compareAndSwap(0, 1) == 0) {
+                    s->shouldUnsub.store(1);
+                    removeSubscription(s);
+                }
+                else {
+                    // a poll checked it out just now
+                    rescheduled.push_back(std::make_pair(due[i], now + 1));
+                }
+            }
+
+            if (!rescheduled.empty()) {
+                SimpleMutex::scoped_lock lk(expiryMutex);
+                for (size_t i = 0; i < rescheduled.size(); i++)
+                    expiryWheel.schedule(rescheduled[i].first, rescheduled[i].second);
+            }
+        }
+    }
+
+    void PubSub::startDispatchers() {
+        int numDispatchers = std::max(static_cast<int>(pubsubDispatchThreads), 1);
+        boost::thread partitioner(PubSub::partition, numDispatchers);
+    }
+
+    std::string PubSub::dispatchEndpoint(int dispatcher) {
+        return str::stream() << "inproc://pubsub.dispatch." << dispatcher;
+    }
+
+    // runs in a background thread and hands every message received from other nodes to the
+    // dispatcher of its channel
+    void PubSub::partition(int numDispatchers) {
+        std::vector<shared_ptr<zmq::socket_t> > dispatchSockets;
+        try {
+            for (int i = 0; i < numDispatchers; i++) {
+                shared_ptr<zmq::socket_t> socket =
+                    boost::make_shared<zmq::socket_t>(boost::ref(zmqContext), ZMQ_PUSH);
+                int hwm = 0;
+                socket->setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+                socket->bind(dispatchEndpoint(i).c_str());
+                dispatchSockets.push_back(socket);
+            }
+        }
+        catch (zmq::error_t& e) {
+            log() << "Error initializing zmq dispatch sockets for PubSub." << causedBy(e);
+            pubsubEnabled = false;
+            publishDataEvents = false;
+            return;
+        }
+
+        for (int i = 0; i < numDispatchers; i++)
+            boost::thread messageDispatcher(PubSub::dispatch, i);
+
+        // the frames are moved from one socket to the other without being copied
+        StringData::Hasher hasher;
+        zmq::message_t frame;
+        while (true) {
+            try {
+                // the channel name ends at the first NUL of the channel frame
+                extRecvSocket->recv(&frame);
+                const char* channel = static_cast<const char*>(frame.data());
+                size_t channelBytes = strnlen(channel, frame.size());
+                zmq::socket_t* dispatchSocket =
+                    dispatchSockets[hasher(StringData(channel, channelBytes)) %
+                                    numDispatchers].get();
+
+                while (true) {
+                    int more = 0;
+                    size_t moreSize = sizeof(more);
+                    extRecvSocket->getsockopt(ZMQ_RCVMORE, &more, &moreSize);
+                    dispatchSocket->send(frame, more ? ZMQ_SNDMORE : 0);
+                    if (!more)
+                        break;
+                    extRecvSocket->recv(&frame);
                 }
             }
-            sleepmillis(maxTimeoutMillis);
+            catch (zmq::error_t& e) {
+                if (e.num() == ETERM)
+                    return;
+                log() << "Error receiving message on zmq receive socket." << causedBy(e);
+            }
+        }
+    }
+
+    // runs in a background thread and routes every message handed to it by the partition
+    // thread to the inboxes of the subscriptions on matching channels
+    void PubSub::dispatch(int dispatcher) {
+        scoped_ptr<zmq::socket_t> dispatchSocket;
+        try {
+            dispatchSocket.reset(new zmq::socket_t(zmqContext, ZMQ_PULL));
+            int hwm = 0;
+            dispatchSocket->setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
+            dispatchSocket->connect(dispatchEndpoint(dispatcher).c_str());
+        }
+        catch (zmq::error_t& e) {
+            log() << "Error initializing zmq dispatch socket for PubSub." << causedBy(e);
+            pubsubEnabled = false;
+            publishDataEvents = false;
+            return;
+        }
+
+        zmq::message_t msg;
+        while (true) {
+            try {
+                shared_ptr<ReceivedMessage> received = boost::make_shared<ReceivedMessage>();
+
+                // receive channel, and the flags the sender set on the message
+                dispatchSocket->recv(&msg);
+                received->channel = std::string(static_cast<const char*>(msg.data()));
+                char flags = PubSubSendSocket::channelFlags(msg);
+                msg.rebuild();
+
+                // receive message body. the frame is kept as the backing store of the
+                // message rather than copied into an owned BSONObj.
+                dispatchSocket->recv(&received->frame);
+
+                // receive the envelope: the timestamp, and the hashes of the body's fields
+                // if the publishing node computed them
+                dispatchSocket->recv(&msg);
+                bool validEnvelope =
+                    PubSubEnvelope::decode(static_cast<const char*>(msg.data()),
+                                           msg.size(),
+                                           &received->envelope);
+                msg.rebuild();
+                if (!validEnvelope) {
+                    log() << "PubSub received a message with an invalid envelope on channel "
+                          << received->channel << ". Dropping it.";
+                    continue;
+                }
+
+                if (!PubSubSendSocket::decodeBody(flags, &received->frame)) {
+                    log() << "PubSub could not decompress a message on channel "
+                          << received->channel << ". Dropping it.";
+                    continue;
+                }
+
+                // watches announced by other replica set members are not delivered to
+                // subscriptions
+                if (received->channel == DataEventInterest::kAnnounceChannel) {
+                    DataEventInterest::receiveAnnouncement(received->body());
+                    continue;
+                }
+
+                // messages on durable channels are stored before they are routed, so that a
+                // subscription catching up reads every message it did not receive live. the
+                // durable writer routes them once they are stored.
+                if (storeDurable && storeDurable(received))
+                    continue;
+
+                routeReceived(received);
+            }
+            catch (zmq::error_t& e) {
+                if (e.num() == ETERM)
+                    return;
+                log() << "Error receiving message on zmq dispatch socket." << causedBy(e);
+            }
+        }
+    }
+
+    void PubSub::routeReceived(const shared_ptr<ReceivedMessage>& received) {
+        // number the message on its channel and keep it for polls with afterSeq. the
+        // buffer numbers messages even when it keeps none.
+        {
+            SimpleMutex::scoped_lock lk(replayMutex);
+            int maxBytes = pubsubReplayBufferBytes;
+            replayBuffer.setMaxBytes(maxBytes > 0 ? maxBytes : 0);
+            received->seq = replayBuffer.add(received->channel,
+                                             received->frame.size(),
+                                             received);
+        }
+
+        routeMessage(received);
+    }
+
+    void PubSub::routeMessage(const shared_ptr<const ReceivedMessage>& received) {
+        const std::string& channel = received->channel;
+        BSONObj message = received->body();
+
+        // find all subscriptions whose channel is a prefix of the message's channel or whose
+        // pattern matches it, and whose filter matches the message
+        std::vector<shared_ptr<SubscriptionInfo> > targets;
+        size_t filtersEvaluated = 0;
+        size_t filtersRejected = 0;
+        unsigned long long filterMicros = 0;
+        {
+            rwlock_shared lk(indexLock);
+            std::vector<shared_ptr<ChannelFilters> > matchingChannels;
+            channelIndex.findPrefixesOf(channel, &matchingChannels);
+            if (!channelPatternIndex.empty())
+                channelPatternIndex.findMatches(channel, &matchingChannels);
+            if (!matchingChannels.empty()) {
+                unsigned long long start = curTimeMicros64();
+                for (size_t i = 0; i < matchingChannels.size(); i++) {
+                    matchingChannels[i]->findMatches(message,
+                                                     &targets,
+                                                     &filtersEvaluated,
+                                                     &filtersRejected,
+                                                     &received->envelope);
+                }
+                filterMicros = curTimeMicros64() - start;
+            }
+        }
+
+        PubSubStats::recordRouted(channel,
+                                  message.objsize(),
+                                  targets.size(),
+                                  filtersEvaluated,
+                                  filtersRejected,
+                                  filterMicros);
+
+        if (targets.empty())
+            return;
+
+        // projections are immutable once the subscription is created,
+        // so they are applied outside of the lock
+        bool isDataEvent = channel == DataEventInterest::kEventsChannel;
+        std::vector<std::pair<shared_ptr<SubscriptionInfo>, InboxEntry> > outbox;
+        outbox.reserve(targets.size());
+        for (size_t i = 0; i < targets.size(); i++) {
+            shared_ptr<SubscriptionInfo> s = targets[i];
+
+            // events on the local database and system collections only go to the
+            // subscriptions which name them
+            if (isDataEvent && !DataEventInterest::covers(s->dataEventWatch, message))
+                continue;
+
+            // if subscription has projection, apply projection to message. otherwise the
+            // subscription shares the received frame.
+            InboxEntry entry;
+            entry.received = received;
+            entry.message = message;
+            if (s->projection)
+                entry.message = s->projection->transform(message);
+
+            outbox.push_back(std::make_pair(s, entry));
+        }
+
+        std::vector<shared_ptr<SubscriptionInfo> > overflowed;
+        for (size_t i = 0; i < outbox.size(); i++) {
+            shared_ptr<SubscriptionInfo> s = outbox[i].first;
+            SimpleMutex::scoped_lock lk(s->mutex);
+            if (s->overflowed.load())
+                continue;
+
+            // a subscription catching up reads the durable channel's messages from storage,
+            // including those it already read by the time it caught up
+            if (channel == s->channel && (s->replaying || s->isStoredThrough(*received)))
+                continue;
+
+            s->deliver(outbox[i].second);
+            if (s->overflowed.load())
+                overflowed.push_back(s);
+
+            if (s->pollWaiter)
+                s->pollWaiter->notify();
+        }
+
+        // stop routing to subscriptions that overflowed under the disconnect policy.
+        // they are removed from their shards by their next poll or by subscriptionCleanup.
+        if (!overflowed.empty()) {
+            rwlock lk(indexLock, true);
+            for (size_t i = 0; i < overflowed.size(); i++)
+                unindexSubscription(overflowed[i]);
         }
     }
 
     /**
      * In-memory data structures for pubsub.
      * Subscribers can poll for more messages on their subscribed channels, and the class
-     * keeps an in-memory map of the id (cursor) they are polling on to the actual
-     * poller instance used to retrieve their messages.
+     * keeps an in-memory map of the id (cursor) they are polling on to the inbox
+     * the dispatcher fills with their messages.
      *
      * The map is wrapped in a class to facilitate clean (multi-threaded) access
      * to the table from subscribe (to add entries), unsubscribe (to remove entries),
-     * and poll (to access entries) without exposing any locking mechanisms
-     * to the user.
+     * poll (to access entries) and dispatch (to route messages) without exposing any
+     * locking mechanisms to the user.
      */
 
-    PubSub::SubscriptionMap PubSub::subscriptions;
+    PubSub::SubscriptionShard PubSub::shards[PubSub::kNumShards];
+    PubSub::CursorMap PubSub::cursors;
+    PubSub::ChannelIndex PubSub::channelIndex;
+    PubSub::ChannelPatternIndex PubSub::channelPatternIndex;
+    std::map<std::string, shared_ptr<PubSub::ChannelFilters> > PubSub::channelFilters;
 
-    const long PubSub::maxPollInterval = 1000; // milliseconds
+    SimpleMutex PubSub::cursorMutex("subscursors");
+    RWLock PubSub::indexLock("subsindex");
 
-    SimpleMutex PubSub::mapMutex("subsmap");
+    SimpleMutex PubSub::replayMutex("pubsubreplay");
+
+    SimpleMutex PubSub::expiryMutex("pubsubexpiry");
+    TimerWheel<SubscriptionId> PubSub::expiryWheel(kExpiryTickMillis, curTimeMillis64());
+
+    SimpleMutex PubSub::connectionMutex("pubsubconnections");
+    PubSub::ConnectionMap PubSub::connectionSubscriptions;
+    ReplayBuffer<shared_ptr<const ReceivedMessage> > PubSub::replayBuffer(0);
+
+    PubSub::SubscriptionShard& PubSub::shardFor(const SubscriptionId& subscriptionId) {
+        size_t hash = 0;
+        subscriptionId.hash_combine(hash);
+        return shards[hash % kNumShards];
+    }
 
     // Outwards-facing interface for PubSub across replica sets and sharded clusters
 
@@ -185,31 +712,38 @@ namespace mongo {
     // perhaps return an <oid, key> pair?
     SubscriptionId PubSub::subscribe(const std::string& channel,
                                      const BSONObj& filter,
-                                     const BSONObj& projection) {
+                                     const BSONObj& projection,
+                                     const SubscriptionLimits& limits,
+                                     const BSONElement& startAt,
+                                     long long connectionId) {
         SubscriptionId subscriptionId;
         subscriptionId.init();
 
-        zmq::socket_t* subSocket;
-        try {
-            subSocket = new zmq::socket_t(zmqContext, ZMQ_SUB);
-            subSocket->setsockopt(ZMQ_SUBSCRIBE, channel.c_str(), channel.length());
-            int hwm = 0;
-            subSocket->setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm)); 
-            subSocket->connect(PubSub::kIntPubSubEndpoint);
-        }
-        catch (zmq::error_t& e) {
-            uassert(18539, e.what(), false);
-        }
-
         shared_ptr<SubscriptionInfo> s(new SubscriptionInfo());
-        s->sock.reset(subSocket);
-        s->inUse = 0;
-        s->shouldUnsub = 0;
-        s->polledRecently = 1;
+        s->id = subscriptionId;
+        s->channel = channel;
+        s->pattern = ChannelPattern::isPattern(channel);
+        s->lastActiveMillis.store(curTimeMillis64());
+        s->limits = limits;
+        s->connectionId = connectionId;
+
+        uassert(18584,
+                mongoutils::str::stream() << "Invalid channel pattern " << channel << ": \""
+                                          << ChannelPattern::kAnySegments
+                                          << "\" may only be the last segment",
+                !s->pattern || ChannelPattern::isValid(channel));
+
+        if (!startAt.eoo()) {
+            uassert(18585, "startAt is not supported for channel patterns.", !s->pattern);
+            uassert(18573, "Durable channels are not supported on this server.",
+                    openDurableReader != NULL);
+            s->replay.reset(openDurableReader(channel, startAt));
+            s->replaying = true;
+        }
 
-        s->filter.reset(NULL);
+        // equivalent filters on the same channel share evaluation, see ChannelFilters
         if (!filter.isEmpty())
-            s->filter.reset(new Matcher2(filter.getOwned()));
+            s->filter.reset(new PubSubFilter(filter));
 
         s->projection.reset(NULL);
         if (!projection.isEmpty()){
@@ -217,227 +751,815 @@ namespace mongo {
             s->projection->init(projection);
         }
 
-        SimpleMutex::scoped_lock lk(mapMutex);
-        subscriptions.insert(std::make_pair(subscriptionId, s));
+        if (DataEventInterest::watchFor(channel, filter, &s->dataEventWatch))
+            DataEventInterest::addLocal(s->dataEventWatch);
+
+        {
+            rwlock lk(indexLock, true);
+            indexSubscription(s);
+        }
+
+        {
+            SubscriptionShard& shard = shardFor(subscriptionId);
+            SimpleMutex::scoped_lock lk(shard.mutex);
+            shard.subscriptions.insert(std::make_pair(subscriptionId, s));
+        }
+
+        {
+            SimpleMutex::scoped_lock lk(expiryMutex);
+            expiryWheel.schedule(subscriptionId,
+                                 s->lastActiveMillis.load() + limits.idleTimeoutMillis);
+        }
+
+        // the connection is the one running this subscribe, so it cannot have closed yet
+        if (connectionId != 0) {
+            SimpleMutex::scoped_lock lk(connectionMutex);
+            connectionSubscriptions[connectionId].insert(subscriptionId);
+        }
 
         return subscriptionId;
     }
 
-    std::priority_queue<SubscriptionMessage> PubSub::poll(
+    long long PubSub::openCursor(const SubscriptionId& subscriptionId) {
+        SimpleMutex::scoped_lock lk(cursorMutex);
+        static PseudoRandom random(SecureRandom::create()->nextInt64());
+
+        // cursorMutex is held across the lookup, so if the subscription is removed
+        // concurrently removeSubscription sees the new cursor id and erases it
+        shared_ptr<SubscriptionInfo> s = findSubscription(subscriptionId);
+        if (!s)
+            return 0;
+
+        if (s->cursorId != 0)
+            return s->cursorId;
+
+        // see isPubSubCursorId for why only the low 32 bits are used
+        long long cursorId;
+        do {
+            cursorId = static_cast<uint32_t>(random.nextInt32());
+        } while (cursorId == 0 || cursors.count(cursorId) > 0);
+
+        s->cursorId = cursorId;
+        cursors.insert(std::make_pair(cursorId, subscriptionId));
+        return cursorId;
+    }
+
+    QueryResult* PubSub::getMore(long long cursorId, int ntoreturn) {
+        SubscriptionId subscriptionId;
+        bool found = false;
+        {
+            SimpleMutex::scoped_lock lk(cursorMutex);
+            CursorMap::iterator it = cursors.find(cursorId);
+            if (it != cursors.end()) {
+                subscriptionId = it->second;
+                found = true;
+            }
+        }
+
+        std::vector<SubscriptionMessage> messages;
+        std::map<SubscriptionId, long long> droppedMessages;
+        if (found) {
+            std::set<SubscriptionId> subscriptionIds;
+            subscriptionIds.insert(subscriptionId);
+            long long millisPolled = 0;
+            bool pollAgain = false;
+            std::map<SubscriptionId, std::string> errors;
+            messages = poll(subscriptionIds,
+                            kCursorWaitMillis,
+                            millisPolled,
+                            pollAgain,
+                            errors,
+                            droppedMessages,
+                            std::abs(ntoreturn),
+                            kCursorMaxBatchBytes);
+
+            // any other error means the subscription is gone
+            if (!errors.empty()) {
+                uassert(18564, errors.begin()->second, errors.begin()->second != kPollActiveError);
+                found = false;
+            }
+        }
+
+        BufBuilder b(32768);
+        b.skip(sizeof(QueryResult));
+        int nReturned = 0;
+
+        if (!droppedMessages.empty()) {
+            BSONObjBuilder droppedBuilder(b);
+            droppedBuilder.append(kCursorDroppedMessagesField, droppedMessages.begin()->second);
+            droppedBuilder.done();
+            nReturned++;
+        }
+
+        for (std::vector<SubscriptionMessage>::const_iterator it = messages.begin();
+             it != messages.end();
+             it++) {
+                BSONObjBuilder messageBuilder(b);
+                messageBuilder.append(kCursorChannelField, it->channel());
+                messageBuilder.append(kCursorMessageField, it->message);
+                if (it->seq() != 0)
+                    messageBuilder.append(kCursorSeqField, static_cast<long long>(it->seq()));
+                if (it->storedId().isSet())
+                    messageBuilder.append(kCursorStoredIdField, it->storedId());
+                messageBuilder.done();
+                nReturned++;
+        }
+
+        QueryResult* qr = reinterpret_cast<QueryResult*>(b.buf());
+        qr->_resultFlags() = found ? 0 : ResultFlag_CursorNotFound;
+        qr->len = b.len();
+        qr->setOperation(opReply);
+        qr->cursorId = found ? cursorId : 0;
+        qr->startingFrom = 0;
+        qr->nReturned = nReturned;
+        b.decouple();
+        return qr;
+    }
+
+    bool PubSub::killCursor(long long cursorId) {
+        SubscriptionId subscriptionId;
+        {
+            SimpleMutex::scoped_lock lk(cursorMutex);
+            CursorMap::iterator it = cursors.find(cursorId);
+            if (it == cursors.end())
+                return false;
+            subscriptionId = it->second;
+        }
+
+        std::map<SubscriptionId, std::string> errors;
+        unsubscribe(subscriptionId, errors);
+        return errors.empty();
+    }
+
+    std::vector<SubscriptionMessage> PubSub::poll(
             std::set<SubscriptionId>& subscriptionIds,
             long timeout, long long& millisPolled,
             bool& pollAgain,
-            std::map<SubscriptionId, std::string>& errors) {
-
-        std::priority_queue<SubscriptionMessage> messages;
+            std::map<SubscriptionId, std::string>& errors,
+            std::map<SubscriptionId, long long>& droppedMessages,
+            size_t maxMessages,
+            size_t maxBytes,
+            const std::map<std::string, unsigned long long>* afterSeqs,
+            std::map<SubscriptionId, std::vector<SequenceGap> >* gaps) {
+
+        std::vector<SubscriptionMessage> messages;
         SubscriptionVector subs;
-        std::vector<zmq::pollitem_t> items;
 
-        PubSub::getSubscriptions(subscriptionIds, items, subs, errors);
+        PubSub::getSubscriptions(subscriptionIds, subs, errors);
 
         // if there are no valid subscriptions to check, return. there may have
         // been errors during getSubscriptions which will be returned.
-        if (items.size() == 0)
+        if (subs.size() == 0)
             return messages;
 
         // limit time polled to ten minutes.
-        // poll for max poll interval or timeout, whichever is shorter, until
-        // client timeout has passed
         if (timeout > maxTimeoutMillis || timeout < 0)
             timeout = maxTimeoutMillis;
-        long long pollRuntime = 0LL;
-        long currPollInterval = std::min(PubSub::maxPollInterval, timeout);
 
-        try {
-            // while no messages have been received on any of the subscriptions,
-            // continue polling coming up for air in intervals to check if any of the
-            // subscriptions have been canceled
-            while (timeout > 0 && !zmq::poll(&items[0], items.size(), currPollInterval)) {
-                for (size_t i = 0; i < subs.size(); i++) {
-                    if (subs[i].second->shouldUnsub) {
-                        SubscriptionId subscriptionId = subs[i].first;
-                        errors.insert(std::make_pair(subscriptionId,
+        // subscriptions catching up on a durable channel move their next stored messages to
+        // their inboxes. one which can no longer catch up is removed with an error.
+        for (size_t i = 0; i < subs.size(); i++) {
+            shared_ptr<SubscriptionInfo> s = subs[i].second;
+            if (!s->replay)
+                continue;
+
+            try {
+                catchUp(s, maxMessages);
+            }
+            catch (const DBException& e) {
+                errors.insert(std::make_pair(subs[i].first, e.toString()));
+                subs.erase(subs.begin() + i);
+                removeSubscription(s);
+                i--;
+            }
+        }
+
+        if (subs.size() == 0)
+            return messages;
+
+        // messages returned by earlier polls after the client's afterSeqs come first
+        std::vector<SubscriptionMessage> replayed;
+        if (afterSeqs && !afterSeqs->empty()) {
+            for (size_t i = 0; i < subs.size(); i++) {
+                std::vector<SequenceGap> subGaps;
+                replayReturned(subs[i].second, *afterSeqs, &replayed, &subGaps);
+                if (gaps && !subGaps.empty())
+                    (*gaps)[subs[i].first] = subGaps;
+            }
+        }
+
+        Timer pollTimer;
+        PollWaiter waiter;
+
+        for (size_t i = 0; i < subs.size(); i++) {
+            SimpleMutex::scoped_lock lk(subs[i].second->mutex);
+            subs[i].second->pollWaiter = &waiter;
+        }
+
+        // wait until a message is routed to any of the subscriptions, the timeout passes or
+        // all of the subscriptions are unsubscribed. the dispatcher and unsubscribe both
+        // notify the waiter so there is no need to wake up periodically.
+        while (true) {
+            bool haveMessages = false;
+            for (size_t i = 0; i < subs.size(); i++) {
+                shared_ptr<SubscriptionInfo> s = subs[i].second;
+                if (s->shouldUnsub.load() || s->overflowed.load()) {
+                    errors.insert(std::make_pair(subs[i].first,
+                                                 s->overflowed.load() ?
+                                                     kOverflowedError :
                                                      "Poll interrupted by unsubscribe."));
-                        items.erase(items.begin() + i);
-                        subs.erase(subs.begin() + i);
-                        PubSub::unsubscribe(subscriptionId, errors, true);
-                        i--;
+                    {
+                        SimpleMutex::scoped_lock lk(s->mutex);
+                        s->pollWaiter = NULL;
                     }
+                    subs.erase(subs.begin() + i);
+                    removeSubscription(s);
+                    i--;
                 }
-
-                // If all sockets that were polling are unsubscribed, return
-                if (items.size() == 0) {
-                    millisPolled = pollRuntime;
-                    return messages;
+                else {
+                    // return dropped message counts right away so clients see gaps
+                    SimpleMutex::scoped_lock lk(s->mutex);
+                    if (s->inboxSize > 0 || s->droppedMessages > 0)
+                        haveMessages = true;
                 }
+            }
 
-                timeout -= currPollInterval;
-                pollRuntime += currPollInterval;
+            // If all subscriptions that were polling are unsubscribed, return
+            if (subs.size() == 0) {
+                millisPolled = pollTimer.millis();
+                return messages;
+            }
 
-                // stop polling if poll has run longer than the max timeout (default ten minutes,
-                // or 100 millis if debug flag is set)
-                if (pollRuntime >= maxTimeoutMillis) {
-                    millisPolled = pollRuntime;
-                    pollAgain = true;
-                    endCurrentPolls(subs);
-                    return messages;
-                }
+            if (haveMessages || !replayed.empty())
+                break;
 
-                currPollInterval = std::min(PubSub::maxPollInterval, timeout);
+            long long remaining = timeout - pollTimer.millis();
+            if (remaining <= 0) {
+                millisPolled = pollTimer.millis();
+                // stop polling if poll has run longer than the max timeout (default ten
+                // minutes, or 100 millis if debug flag is set)
+                if (millisPolled >= maxTimeoutMillis)
+                    pollAgain = true;
+                takeDroppedMessages(subs, droppedMessages);
+                endCurrentPolls(subs);
+                return messages;
             }
-        }
-        catch (zmq::error_t& e) {
-            log() << "Error polling on zmq socket." << causedBy(e);
-            // check all sockets back in
-            endCurrentPolls(subs);
-            uassert(18547, e.what(), false);
+
+            waiter.wait(remaining);
         }
 
         // if we reach this point, then we know at least 1 message
         // has been received on some subscription
-        messages = PubSub::recvMessages(subs, errors);
+        takeDroppedMessages(subs, droppedMessages);
+
+        // replayed messages count against the limits first
+        size_t replayedBytes = 0;
+        for (size_t i = 0; i < replayed.size(); i++)
+            replayedBytes += replayed[i].message.objsize();
+        if ((maxMessages > 0 && replayed.size() >= maxMessages) ||
+            (maxBytes > 0 && replayedBytes >= maxBytes)) {
+            endCurrentPolls(subs);
+        }
+        else {
+            messages = PubSub::recvMessages(subs,
+                                            maxMessages > 0 ? maxMessages - replayed.size() : 0,
+                                            maxBytes > 0 ? maxBytes - replayedBytes : 0,
+                                            replayed.empty());
+        }
+
+        // replayed messages go before the queued ones of the same subscription and channel
+        if (!replayed.empty()) {
+            replayed.insert(replayed.end(), messages.begin(), messages.end());
+            std::stable_sort(replayed.begin(), replayed.end(), bySubscriptionAndChannel);
+            messages.swap(replayed);
+        }
 
-        millisPolled = pollRuntime;
+        size_t returnedBytes = 0;
+        for (size_t i = 0; i < messages.size(); i++)
+            returnedBytes += messages[i].message.objsize();
+        PubSubStats::add(PubSubStats::kReturned, messages.size());
+        PubSubStats::add(PubSubStats::kReturnedBytes, returnedBytes);
+
+        millisPolled = pollTimer.millis();
         return messages;
     }
 
+    void PubSub::replayReturned(const shared_ptr<SubscriptionInfo>& s,
+                                const std::map<std::string, unsigned long long>& afterSeqs,
+                                std::vector<SubscriptionMessage>* out,
+                                std::vector<SequenceGap>* gaps) {
+        // only messages the subscription returned are returned again
+        std::vector<std::pair<std::string, SubscriptionInfo::ReturnedSeqs> > ranges;
+        {
+            SimpleMutex::scoped_lock lk(s->mutex);
+            for (std::map<std::string, unsigned long long>::const_iterator it =
+                     afterSeqs.begin();
+                 it != afterSeqs.end();
+                 it++) {
+                    std::map<std::string, SubscriptionInfo::ReturnedSeqs>::const_iterator
+                        returned = s->returnedSeqs.find(it->first);
+                    if (returned == s->returnedSeqs.end())
+                        continue;
+
+                    SubscriptionInfo::ReturnedSeqs range = returned->second;
+                    range.first = std::max(it->second, range.first - 1);
+                    if (range.last > range.first)
+                        ranges.push_back(std::make_pair(it->first, range));
+            }
+        }
+
+        for (size_t i = 0; i < ranges.size(); i++) {
+            const std::string& channel = ranges[i].first;
+            unsigned long long afterSeq = ranges[i].second.first;
+
+            std::vector<shared_ptr<const ReceivedMessage> > found;
+            unsigned long long evictedThrough;
+            {
+                SimpleMutex::scoped_lock lk(replayMutex);
+                evictedThrough = replayBuffer.find(channel,
+                                                   afterSeq,
+                                                   ranges[i].second.last,
+                                                   &found);
+            }
+
+            if (evictedThrough > afterSeq) {
+                SequenceGap gap;
+                gap.channel = channel;
+                gap.from = afterSeq + 1;
+                gap.to = evictedThrough;
+                gaps->push_back(gap);
+            }
+
+            for (size_t j = 0; j < found.size(); j++) {
+                BSONObj message = found[j]->body();
+                if (s->filter && !s->filter->matches(message))
+                    continue;
+                if (s->projection)
+                    message = s->projection->transform(message);
+                out->push_back(SubscriptionMessage(s->id, found[j], message));
+            }
+        }
+    }
+
+    void PubSub::catchUp(const shared_ptr<SubscriptionInfo>& s, size_t maxMessages) {
+        size_t batchMessages = kCatchUpBatchMessages;
+        if (maxMessages > 0 && maxMessages < batchMessages)
+            batchMessages = maxMessages;
+
+        std::vector<InboxEntry> entries;
+        OID lastStored;
+        bool caughtUp = false;
+        while (entries.empty() && !caughtUp) {
+            std::vector<BSONObj> stored;
+            caughtUp = s->replay->readMore(batchMessages, &stored);
+            if (caughtUp) {
+                // messages published from now on are delivered as they arrive. those stored
+                // before the switch are read here, and live copies of them are dropped, both
+                // those already delivered and those routed later, see storedThrough.
+                {
+                    SimpleMutex::scoped_lock lk(s->mutex);
+                    s->replaying = false;
+                }
+                s->replay->readMore(0, &stored);
+            }
+
+            for (size_t i = 0; i < stored.size(); i++) {
+                OID id = stored[i]["_id"].OID();
+                BSONObj message = stored[i]["msg"].Obj();
+                lastStored = id;
+                if (s->filter && !s->filter->matches(message))
+                    continue;
+
+                shared_ptr<ReceivedMessage> received = boost::make_shared<ReceivedMessage>();
+                received->channel = s->channel;
+                received->storedId = id;
+                received->envelope.timestamp = id.asDateT().millis * 1000;
+                received->frame.rebuild(message.objsize());
+                memcpy(received->frame.data(), message.objdata(), message.objsize());
+
+                InboxEntry entry;
+                entry.received = received;
+                entry.message = received->body();
+                if (s->projection)
+                    entry.message = s->projection->transform(entry.message);
+                entries.push_back(entry);
+            }
+        }
+
+        SimpleMutex::scoped_lock lk(s->mutex);
+
+        // messages delivered live since the switch go after the stored ones
+        std::vector<InboxEntry> live;
+        if (caughtUp) {
+            SubscriptionInfo::Inbox::iterator it = s->inbox.find(s->channel);
+            if (it != s->inbox.end()) {
+                for (size_t i = 0; i < it->second.size(); i++) {
+                    const InboxEntry& entry = it->second.at(i);
+                    live.push_back(entry);
+                    s->inboxSize--;
+                    s->inboxBytes -= entry.message.objsize();
+                }
+                it->second.clear();
+            }
+        }
+
+        for (size_t i = 0; i < entries.size(); i++)
+            s->deliver(entries[i]);
+
+        if (caughtUp) {
+            if (lastStored.isSet())
+                s->storedThrough = lastStored;
+            for (size_t i = 0; i < live.size(); i++) {
+                if (!s->isStoredThrough(*live[i].received))
+                    s->deliver(live[i]);
+            }
+            s->replay.reset();
+        }
+    }
+
     void PubSub::endCurrentPolls(SubscriptionVector& subs) {
         for (SubscriptionVector::iterator subIt = subs.begin(); subIt != subs.end(); subIt++) {
             shared_ptr<SubscriptionInfo> s = subIt->second;
-            PubSub::checkinSocket(s);
+            PubSub::checkinSubscription(s);
+        }
+    }
+
+    void PubSub::takeDroppedMessages(SubscriptionVector& subs,
+                                     std::map<SubscriptionId, long long>& droppedMessages) {
+        for (SubscriptionVector::iterator subIt = subs.begin(); subIt != subs.end(); subIt++) {
+            shared_ptr<SubscriptionInfo> s = subIt->second;
+            SimpleMutex::scoped_lock lk(s->mutex);
+            if (s->droppedMessages > 0) {
+                droppedMessages.insert(std::make_pair(subIt->first, s->droppedMessages));
+                s->droppedMessages = 0;
+            }
         }
     }
 
     void PubSub::getSubscriptions(std::set<SubscriptionId>& subscriptionIds,
-                                  std::vector<zmq::pollitem_t>& items,
                                   SubscriptionVector& subs,
                                   std::map<SubscriptionId, std::string>& errors) {
         // check if each oid is for a valid subscription.
         // for each oid already in an active poll, set an error message
-        // for each non-active oid, set active poll and create a poller
+        // for each non-active oid, set active poll
         for (std::set<SubscriptionId>::iterator it = subscriptionIds.begin();
              it != subscriptionIds.end();
              it++) {
 
                 SubscriptionId subscriptionId = *it;
                 std::string errmsg;
-                shared_ptr<SubscriptionInfo> s = PubSub::checkoutSocket(subscriptionId, errmsg);
+                shared_ptr<SubscriptionInfo> s = PubSub::checkoutSubscription(subscriptionId,
+                                                                              errmsg);
 
                 if (s == NULL) {
                     errors.insert(std::make_pair(subscriptionId, errmsg));
                     continue;
                 }
 
-                // create subscription info and poll item for socket.
-                // items and subs have corresponding info at the same indexes
-                zmq::pollitem_t pollItem = { *(s->sock), 0, ZMQ_POLLIN, 0 };
-                items.push_back(pollItem);
                 subs.push_back(std::make_pair(subscriptionId, s));
         }
     }
 
-    shared_ptr<PubSub::SubscriptionInfo> PubSub::checkoutSocket(SubscriptionId subscriptionId,
-                                                                std::string& errmsg) {
-        SimpleMutex::scoped_lock lk(mapMutex);
-        SubscriptionMap::iterator subIt = subscriptions.find(subscriptionId);
+    shared_ptr<PubSub::SubscriptionInfo> PubSub::checkoutSubscription(
+                                                        SubscriptionId subscriptionId,
+                                                        std::string& errmsg) {
+        shared_ptr<SubscriptionInfo> s = findSubscription(subscriptionId);
 
-        if (subIt == subscriptions.end() || subIt->second->shouldUnsub) {
+        if (!s || s->shouldUnsub.load()) {
             errmsg = "Subscription not found.";
             return shared_ptr<SubscriptionInfo>();
         }
-        else if (subIt->second->inUse) {
-            errmsg = "Poll currently active.";
+        else if (s->inUse.compareAndSwap(0, 1) != 0) {
+            errmsg = s->shouldUnsub.load() ? "Subscription not found." : kPollActiveError;
+            return shared_ptr<SubscriptionInfo>();
+        }
+        else if (s->overflowed.load()) {
+            errmsg = kOverflowedError;
+            removeSubscription(s);
             return shared_ptr<SubscriptionInfo>();
         }
         else {
-            shared_ptr<SubscriptionInfo> s = subIt->second;
-            s->inUse = 1;
             return s;
         }
     }
 
-    void PubSub::checkinSocket(shared_ptr<SubscriptionInfo> s) {
-        s->polledRecently = 1;
-        s->inUse = 0;
+    void PubSub::checkinSubscription(shared_ptr<SubscriptionInfo> s) {
+        {
+            SimpleMutex::scoped_lock lk(s->mutex);
+            s->pollWaiter = NULL;
+        }
+        s->lastActiveMillis.store(curTimeMillis64());
+        s->inUse.store(0);
+
+        // an unsubscribe which found the subscription in use left its removal to the poll.
+        // whichever of the two sets inUse again removes it, see unsubscribe.
+        if (s->shouldUnsub.load() && s->inUse.compareAndSwap(0, 1) == 0)
+            removeSubscription(s);
     }
 
-    std::priority_queue<SubscriptionMessage> PubSub::recvMessages(
-                                SubscriptionVector& subs,
-                                std::map<SubscriptionId, std::string>& errors) {
+    void PubSub::indexSubscription(const shared_ptr<SubscriptionInfo>& s) {
+        shared_ptr<ChannelFilters>& filters = channelFilters[s->channel];
+        if (!filters) {
+            filters.reset(new ChannelFilters());
+            if (s->pattern)
+                channelPatternIndex.insert(s->channel, filters);
+            else
+                channelIndex.insert(s->channel, filters);
+        }
+        filters->add(s->filter, s);
+    }
 
-        std::priority_queue<SubscriptionMessage> outbox;
+    void PubSub::unindexSubscription(const shared_ptr<SubscriptionInfo>& s) {
+        std::map<std::string, shared_ptr<ChannelFilters> >::iterator it =
+            channelFilters.find(s->channel);
+        if (it == channelFilters.end())
+            return;
 
+        shared_ptr<ChannelFilters> filters = it->second;
+        filters->remove(s->filter.get(), s);
+
+        // drop channels without subscriptions so they are no longer visited when routing
+        if (filters->empty()) {
+            if (s->pattern)
+                channelPatternIndex.remove(s->channel, filters);
+            else
+                channelIndex.remove(s->channel, filters);
+            channelFilters.erase(it);
+        }
+    }
+
+    shared_ptr<PubSub::SubscriptionInfo> PubSub::findSubscription(
+                                                const SubscriptionId& subscriptionId) {
+        SubscriptionShard& shard = shardFor(subscriptionId);
+        SimpleMutex::scoped_lock lk(shard.mutex);
+        SubscriptionMap::iterator it = shard.subscriptions.find(subscriptionId);
+        if (it == shard.subscriptions.end())
+            return shared_ptr<SubscriptionInfo>();
+        return it->second;
+    }
+
+    void PubSub::removeSubscription(const shared_ptr<SubscriptionInfo>& s) {
+        {
+            SubscriptionShard& shard = shardFor(s->id);
+            SimpleMutex::scoped_lock lk(shard.mutex);
+            SubscriptionMap::iterator it = shard.subscriptions.find(s->id);
+            if (it == shard.subscriptions.end() || it->second != s)
+                return;
+            shard.subscriptions.erase(it);
+        }
+        {
+            rwlock lk(indexLock, true);
+            unindexSubscription(s);
+        }
+        {
+            SimpleMutex::scoped_lock lk(cursorMutex);
+            if (s->cursorId != 0)
+                cursors.erase(s->cursorId);
+        }
+        if (s->connectionId != 0) {
+            SimpleMutex::scoped_lock lk(connectionMutex);
+            ConnectionMap::iterator it = connectionSubscriptions.find(s->connectionId);
+            if (it != connectionSubscriptions.end()) {
+                it->second.erase(s->id);
+                if (it->second.empty())
+                    connectionSubscriptions.erase(it);
+            }
+        }
+        if (s->dataEventWatch.ops != 0)
+            DataEventInterest::removeLocal(s->dataEventWatch);
+    }
+
+    std::vector<SubscriptionMessage> PubSub::recvMessages(SubscriptionVector& subs,
+                                                          size_t maxMessages,
+                                                          size_t maxBytes,
+                                                          bool replyEmpty) {
+
+        size_t numMessages = 0;
         for (SubscriptionVector::iterator subIt = subs.begin(); subIt != subs.end(); subIt++) {
-            SubscriptionId subscriptionId = subIt->first;
-            shared_ptr<SubscriptionInfo> s = subIt->second;
+            SimpleMutex::scoped_lock lk(subIt->second->mutex);
+            numMessages += subIt->second->inboxSize;
+        }
+        if (maxMessages > 0 && numMessages > maxMessages)
+            numMessages = maxMessages;
+
+        std::vector<SubscriptionMessage> outbox;
+        outbox.reserve(numMessages);
+
+        // subscriptions are drained in rounds. in each round every subscription which still
+        // has messages gets an equal share of what is left of the limits, so a busy
+        // subscription cannot starve the others. a share one subscription leaves unused goes
+        // to the others in the next round, and each round starts one subscription further
+        // along so that the remainders of the shares are spread evenly too. subscriptions
+        // whose next message was too large for the last poll go first, so that it starts
+        // this reply.
+        std::vector<shared_ptr<SubscriptionInfo> > active;
+        active.reserve(subs.size());
+        for (SubscriptionVector::iterator subIt = subs.begin(); subIt != subs.end(); subIt++) {
+            SimpleMutex::scoped_lock lk(subIt->second->mutex);
+            if (subIt->second->oversizedNext)
+                active.push_back(subIt->second);
+        }
+        for (SubscriptionVector::iterator subIt = subs.begin(); subIt != subs.end(); subIt++) {
+            SimpleMutex::scoped_lock lk(subIt->second->mutex);
+            if (!subIt->second->oversizedNext)
+                active.push_back(subIt->second);
+        }
 
-            try {
-                zmq::message_t msg;
-                while (s->sock->recv(&msg, ZMQ_DONTWAIT)) {
-                    // receive channel
-                    std::string channel = std::string(static_cast<const char*>(msg.data()));
-                    msg.rebuild();
-
-                    // receive message body
-                    s->sock->recv(&msg);
-                    BSONObj message(static_cast<const char*>(msg.data()));
-                    message = message.getOwned();
-                    msg.rebuild();
-
-                    // receive timestamp
-                    s->sock->recv(&msg);
-                    unsigned long long timestamp = *((unsigned long long*)(msg.data()));
-                    msg.rebuild();
-
-                    // if subscription has filter, continue only if message matches filter
-                    if (s->filter && !s->filter->matches(message))
-                        continue;
+        size_t remainingMessages = maxMessages;
+        size_t remainingBytes = maxBytes;
+        size_t first = 0;
+        bool wholeRemainder = false;
+        bool full = false;
+        while (!full && !active.empty()) {
+            size_t messageShare = 0;
+            size_t byteShare = 0;
+            if (maxMessages > 0)
+                messageShare = std::max(remainingMessages / active.size(), size_t(1));
+            if (maxBytes > 0) {
+                byteShare = wholeRemainder ?
+                    remainingBytes : std::max(remainingBytes / active.size(), size_t(1));
+            }
 
-                    // if subscription has projection, apply projection to message
-                    if (s->projection)
-                        message = s->projection->transform(message);
+            size_t roundMessages = 0;
+            std::vector<shared_ptr<SubscriptionInfo> > stillActive;
+            for (size_t i = 0; i < active.size(); i++) {
+                shared_ptr<SubscriptionInfo> s = active[(first + i) % active.size()];
+                if (full) {
+                    stillActive.push_back(s);
+                    continue;
+                }
 
-                    SubscriptionMessage m(subscriptionId, channel, message, timestamp);
-                    outbox.push(m);
+                size_t drainedMessages;
+                size_t drainedBytes;
+                SimpleMutex::scoped_lock lk(s->mutex);
+                s->drainInbox(&outbox,
+                              messageShare,
+                              byteShare,
+                              replyEmpty && outbox.empty(),
+                              &drainedMessages,
+                              &drainedBytes);
+                if (s->inboxSize > 0)
+                    stillActive.push_back(s);
+                roundMessages += drainedMessages;
+
+                if (maxMessages > 0) {
+                    remainingMessages -= drainedMessages;
+                    full = full || remainingMessages == 0;
+                }
+                if (maxBytes > 0) {
+                    // only the first message of the whole reply may be larger than maxBytes
+                    remainingBytes -= std::min(drainedBytes, remainingBytes);
+                    full = full || remainingBytes == 0;
                 }
             }
-            catch (zmq::error_t& e) {
-                errors.insert(std::make_pair(subscriptionId,
-                                             "Error receiving messages from zmq socket."));
+
+            // without limits a single round drains everything that was queued
+            if (maxMessages == 0 && maxBytes == 0)
+                break;
+
+            // when no subscription's next message fits in its share, give each in turn all
+            // that is left, and stop once not even that fits
+            if (roundMessages == 0) {
+                if (wholeRemainder || maxBytes == 0)
+                    break;
+                wholeRemainder = true;
+            }
+            else {
+                wholeRemainder = false;
             }
 
-            // done receiving from ZMQ socket
-            PubSub::checkinSocket(s);
+            active.swap(stillActive);
+            first++;
         }
 
+        for (SubscriptionVector::iterator subIt = subs.begin(); subIt != subs.end(); subIt++) {
+            shared_ptr<SubscriptionInfo> s = subIt->second;
+            SimpleMutex::scoped_lock lk(s->mutex);
+            s->oversizedNext = maxBytes > 0 && s->nextMessageBytes() > maxBytes;
+        }
+
+        // done draining the subscriptions' inboxes
+        endCurrentPolls(subs);
+
         return outbox;
     }
 
+    size_t PubSub::numSubscriptions() {
+        size_t numSubscriptions = 0;
+        for (size_t i = 0; i < kNumShards; i++) {
+            SimpleMutex::scoped_lock lk(shards[i].mutex);
+            numSubscriptions += shards[i].subscriptions.size();
+        }
+        return numSubscriptions;
+    }
+
+    namespace {
+
+        struct SubscriptionStats {
+            SubscriptionId id;
+            std::string channel;
+            size_t queuedMessages;
+            size_t queuedBytes;
+            long long droppedMessages;
+            long long cursorId;
+        };
+
+        bool byQueuedMessagesDescending(const SubscriptionStats& a,
+                                        const SubscriptionStats& b) {
+            return a.queuedMessages > b.queuedMessages;
+        }
+
+    }
+
+    void PubSub::appendSubscriptionStats(BSONObjBuilder* builder, size_t maxSubscriptions) {
+        // copy the shards' subscriptions so that no shard is locked while the others are read
+        std::vector<shared_ptr<SubscriptionInfo> > subscriptions;
+        for (size_t i = 0; i < kNumShards; i++) {
+            SimpleMutex::scoped_lock lk(shards[i].mutex);
+            for (SubscriptionMap::const_iterator it = shards[i].subscriptions.begin();
+                 it != shards[i].subscriptions.end();
+                 it++) {
+                    subscriptions.push_back(it->second);
+            }
+        }
+
+        std::vector<SubscriptionStats> stats(subscriptions.size());
+        {
+            SimpleMutex::scoped_lock lk(cursorMutex);
+            for (size_t i = 0; i < subscriptions.size(); i++)
+                stats[i].cursorId = subscriptions[i]->cursorId;
+        }
+        for (size_t i = 0; i < subscriptions.size(); i++) {
+            const shared_ptr<SubscriptionInfo>& s = subscriptions[i];
+            SimpleMutex::scoped_lock lk(s->mutex);
+            stats[i].id = s->id;
+            stats[i].channel = s->channel;
+            stats[i].queuedMessages = s->inboxSize;
+            stats[i].queuedBytes = s->inboxBytes;
+            stats[i].droppedMessages = s->droppedMessages;
+        }
+
+        size_t numSubscriptions = std::min(maxSubscriptions, stats.size());
+        std::partial_sort(stats.begin(),
+                          stats.begin() + numSubscriptions,
+                          stats.end(),
+                          byQueuedMessagesDescending);
+
+        BSONArrayBuilder subscriptionsBuilder(builder->subarrayStart("subscriptions"));
+        for (size_t i = 0; i < numSubscriptions; i++) {
+            BSONObjBuilder subscription(subscriptionsBuilder.subobjStart());
+            subscription.append("subscriptionId", stats[i].id);
+            subscription.append("channel", stats[i].channel);
+            subscription.append("queuedMessages",
+                                static_cast<long long>(stats[i].queuedMessages));
+            subscription.append("queuedBytes", static_cast<long long>(stats[i].queuedBytes));
+            subscription.append("droppedMessages", stats[i].droppedMessages);
+            subscription.append("cursorId", stats[i].cursorId);
+            subscription.done();
+        }
+        subscriptionsBuilder.done();
+    }
+
     void PubSub::unsubscribe(const SubscriptionId& subscriptionId,
-                             std::map<SubscriptionId, std::string>& errors,
-                             bool force) {
-        SimpleMutex::scoped_lock lk(mapMutex);
-        SubscriptionMap::iterator it = subscriptions.find(subscriptionId);
+                             std::map<SubscriptionId, std::string>& errors) {
+        shared_ptr<SubscriptionInfo> s = findSubscription(subscriptionId);
 
-        if (it == subscriptions.end()) {
+        if (!s) {
             errors.insert(std::make_pair(subscriptionId, "Subscription not found."));
             return;
         }
 
-        // if force unsubscribe not specified, set flag to unsubscribe when poll checks
-        // active polls check frequently if unsubscribe has been noted
-        shared_ptr<SubscriptionInfo> s = it->second;
-        if (!force && s->inUse) {
-            s->shouldUnsub = 1;
+        // if the subscription is not being polled, remove it now. otherwise wake up the
+        // active poll so that it notices the unsubscribe immediately and removes it. if the
+        // poll ends first, checkinSubscription sees shouldUnsub and removes it instead.
+        s->shouldUnsub.store(1);
+        if (s->inUse.compareAndSwap(0, 1) == 0) {
+            removeSubscription(s);
         }
         else {
-            try {
-                s->sock->close();
-            }
-            catch (zmq::error_t& e) {
-                errors.insert(std::make_pair(subscriptionId, "Error closing zmq socket."));
-            }
-            subscriptions.erase(it);
+            SimpleMutex::scoped_lock lk(s->mutex);
+            if (s->pollWaiter)
+                s->pollWaiter->notify();
+        }
+    }
+
+    void PubSub::connectionClosed(long long connectionId) {
+        std::set<SubscriptionId> subscriptionIds;
+        {
+            SimpleMutex::scoped_lock lk(connectionMutex);
+            ConnectionMap::iterator it = connectionSubscriptions.find(connectionId);
+            if (it == connectionSubscriptions.end())
+                return;
+            subscriptionIds.swap(it->second);
+            connectionSubscriptions.erase(it);
+        }
+
+        // subscriptions already removed otherwise are not found, which is not an error here
+        std::map<SubscriptionId, std::string> errors;
+        for (std::set<SubscriptionId>::const_iterator it = subscriptionIds.begin();
+             it != subscriptionIds.end();
+             it++) {
+                unsubscribe(*it, errors);
         }
     }
 
@@ -28,14 +28,27 @@
 
 #pragma once
 
-#include <queue>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition.hpp>
+#include <map>
+#include <vector>
 #include <zmq.hpp>
 
 #include "mongo/bson/oid.h"
+#include "mongo/db/dbmessage.h"
+#include "mongo/platform/atomic_word.h"
 #include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/rwlock.h"
 #include "mongo/util/net/hostandport.h"
-#include "mongo/db/matcher/matcher.h"
 #include "mongo/db/projection.h"
+#include "mongo/db/pubsub_channel_pattern.h"
+#include "mongo/db/pubsub_channel_trie.h"
+#include "mongo/db/pubsub_data_event_interest.h"
+#include "mongo/db/pubsub_envelope.h"
+#include "mongo/db/pubsub_filter_index.h"
+#include "mongo/db/pubsub_replay_buffer.h"
+#include "mongo/db/pubsub_ring_buffer.h"
+#include "mongo/db/pubsub_timer_wheel.h"
 
 namespace mongo {
 
@@ -44,94 +57,445 @@ namespace mongo {
     extern bool pubsubEnabled;
     extern bool publishDataEvents;
 
+    // Server Parameters limiting the messages returned by a poll which sets no limits itself
+    extern int pubsubPollMaxMessages;
+    extern int pubsubPollMaxBytes;
+
     typedef OID SubscriptionId;
 
-    // contains information about a message
+    // A message as received by a dispatcher from another node or this one. The body is not
+    // copied out of the zmq frame it arrived in. Instead the frame is kept here, and every
+    // SubscriptionMessage the message is delivered to holds a reference to it, so the body is
+    // only freed once it has been returned by all polls.
+    class ReceivedMessage : boost::noncopyable {
+    public:
+        ReceivedMessage() : seq(0) {}
+
+        std::string channel;
+
+        // the header sent with the message by the node it was published on
+        PubSubEnvelope envelope;
+
+        // Numbers the messages received on channel by this node, consecutively while the
+        // channel has messages in the replay buffer, so clients can tell which messages they
+        // have seen. 0 for stored messages read by a subscription catching up on a durable
+        // channel, which are identified by storedId instead.
+        unsigned long long seq;
+
+        // the _id the message is stored under on a durable channel, unset if it was not
+        // stored. set by the durable writer before the message is routed.
+        OID storedId;
+
+        zmq::message_t frame;
+
+        // unowned BSONObj pointing into the frame
+        BSONObj body() const { return BSONObj(static_cast<const char*>(frame.data())); }
+    };
+
+    // contains information about a message delivered to a subscription
     class SubscriptionMessage {
     public:
         SubscriptionId subscriptionId;
-        std::string channel;
+
+        // The message body. Points into received->frame unless the subscription has a
+        // projection, in which case it is an owned copy with the projection applied.
         BSONObj message;
-        unsigned long long timestamp;
+
+        shared_ptr<const ReceivedMessage> received;
 
         SubscriptionMessage(SubscriptionId _subscriptionId,
-                            std::string _channel,
-                            BSONObj _message,
-                            unsigned long long _timestamp);
+                            const shared_ptr<const ReceivedMessage>& _received,
+                            BSONObj _message);
+
+        const std::string& channel() const { return received->channel; }
+        unsigned long long timestamp() const { return received->envelope.timestamp; }
+        unsigned long long seq() const { return received->seq; }
+        const OID& storedId() const { return received->storedId; }
+    };
+
+    // messages on channel numbered from through to which a poll with afterSeq could not
+    // deliver again because they are no longer in the replay buffer
+    struct SequenceGap {
+        std::string channel;
+        unsigned long long from;
+        unsigned long long to;
+    };
+
+    // limits on the messages queued for a subscription between polls, and what happens to
+    // a message routed to the subscription when queueing it would exceed them
+    struct SubscriptionLimits {
+        enum OverflowPolicy {
+            // drop the oldest queued messages until the new message fits
+            kDropOldest,
+            // drop the new message
+            kDropNewest,
+            // drop the subscription. its next poll returns an error for it.
+            kDisconnect
+        };
+
+        // a limit of 0 or less is unlimited
+        long long maxMessages;
+        long long maxBytes;
+        OverflowPolicy overflowPolicy;
+
+        // the subscription is removed once it has not been polled for this long
+        long long idleTimeoutMillis;
+
+        // limits set by the pubsubMaxQueueMessages, pubsubMaxQueueBytes,
+        // pubsubOverflowPolicy and pubsubIdleTimeoutMillis server parameters
+        static SubscriptionLimits defaults();
 
-        friend bool operator<(const SubscriptionMessage& m1, const SubscriptionMessage& m2);
+        // parses "dropOldest", "dropNewest" or "disconnect". returns false for anything else.
+        static bool parseOverflowPolicy(const std::string& name, OverflowPolicy* out);
+    };
+
+    // Reads the messages stored for a durable channel in the order they were published,
+    // starting from the position a subscription was created with. Implemented by mongod, see
+    // DurableChannels.
+    class DurableChannelReader {
+    public:
+        virtual ~DurableChannelReader() {}
+
+        // Appends up to maxMessages of the messages stored after the last one read to out, 0
+        // being unlimited, as the documents they are stored in: { _id: <ObjectId>, msg:
+        // <message> }. Returns true if no more messages are currently stored. Throws if
+        // messages after the last one read were overwritten before they could be read.
+        virtual bool readMore(size_t maxMessages, std::vector<BSONObj>* out) = 0;
     };
 
     class PubSub {
     public:
 
-        // outwards-facing interface for pubsub communication across replsets and clusters
+        // outwards-facing interface for pubsub communication across replsets and clusters.
+        // If startAt is given, the subscription first receives the messages stored for the
+        // durable channel since startAt, then switches to messages as they are published.
+        // If connectionId is not 0, the subscription is removed when that client connection
+        // closes, see connectionClosed.
         static SubscriptionId subscribe(const string& channel,
                                         const BSONObj& filter,
-                                        const BSONObj& projection);
-        static std::priority_queue<SubscriptionMessage> poll(
+                                        const BSONObj& projection,
+                                        const SubscriptionLimits& limits,
+                                        const BSONElement& startAt = BSONElement(),
+                                        long long connectionId = 0);
+        // returns the messages received on the subscriptions, grouped by subscription, then
+        // by channel, in arrival order within each channel. droppedMessages is filled in with
+        // the number of messages dropped by each subscription's overflow policy since its
+        // last poll, for subscriptions which dropped any. at most maxMessages messages and,
+        // unless the first message alone is larger, maxBytes bytes are returned, with 0
+        // being unlimited. the limits are shared fairly between the subscriptions, and
+        // messages past them stay queued for the next poll.
+        //
+        // afterSeqs maps channels to the seq of the last message the client received on
+        // them. Messages on those channels after it which were returned by an earlier poll
+        // are returned again first, from the replay buffer, so that a client whose earlier
+        // reply was lost can recover them. Those no longer in the buffer are reported in
+        // gaps.
+        static std::vector<SubscriptionMessage> poll(
                 std::set<SubscriptionId>& subscriptionIds,
                 long timeout,
                 long long& millisPolled,
                 bool& pollAgain,
-                std::map<SubscriptionId, std::string>& errors);
-        // force is an option used internally if a poll is interrupted by an unsubscribe to 
-        // allow the unsubscribe to happen without having to check the subscription in and
-        // back out. it is always false if this method is called from the unsubscribe command.
+                std::map<SubscriptionId, std::string>& errors,
+                std::map<SubscriptionId, long long>& droppedMessages,
+                size_t maxMessages = 0,
+                size_t maxBytes = 0,
+                const std::map<std::string, unsigned long long>* afterSeqs = NULL,
+                std::map<SubscriptionId, std::vector<SequenceGap> >* gaps = NULL);
+
+        // Streaming delivery. openCursor returns a cursor id for the subscription, or 0 if
+        // the subscription does not exist. Each getMore on the cursor waits for messages the
+        // same way poll does and returns them as documents { channel: <string>,
+        // message: <Object> }, preceded by a { droppedMessages: <count> } document if the
+        // subscription dropped messages since it was last read. killCursor unsubscribes.
+        // getMore and killCursor are installed as pubsubGetMore and pubsubKillCursor.
+        static long long openCursor(const SubscriptionId& subscriptionId);
+        static QueryResult* getMore(long long cursorId, int ntoreturn);
+        static bool killCursor(long long cursorId);
+        // if the subscription is currently being polled, the poll is woken up and disposes
+        // of the subscription itself, returning an error for it.
         static void unsubscribe(const SubscriptionId& subscriptionId,
-                                std::map<SubscriptionId, std::string>& errors,
-                                bool force=false);
+                                std::map<SubscriptionId, std::string>& errors);
 
-        // to be included in all files using the client's sub sockets
-        static const char* const kIntPubSubEndpoint;
+        // Unsubscribes the subscriptions bound to a client connection which has closed.
+        // Installed as pubsubConnectionClosed.
+        static void connectionClosed(long long connectionId);
 
-        // process-specific (mongod or mongos) initialization of internal communication sockets
+        // Number of subscriptions on this node.
+        static size_t numSubscriptions();
+
+        // Appends the maxSubscriptions subscriptions with the most queued messages as an array
+        // "subscriptions" of { subscriptionId, channel, queuedMessages, queuedBytes,
+        // droppedMessages, cursorId }.
+        static void appendSubscriptionStats(BSONObjBuilder* builder, size_t maxSubscriptions);
+
+        // process-specific (mongod or mongos) initialization of internal communication sockets.
+        // initSendSocket sets the number of zmq I/O threads from pubsubIOThreads, so it must
+        // be called before any other pubsub socket is created.
         static zmq::socket_t* initSendSocket();
         static zmq::socket_t* initRecvSocket();
         static void proxy(zmq::socket_t* subscriber, zmq::socket_t* publisher);
+
+        // Runs in a background thread and removes the subscriptions which have not been
+        // polled for their idle timeout, as they expire in expiryWheel.
         static void subscriptionCleanup();
 
+        // Starts pubsubDispatchThreads dispatcher threads, each routing the messages of some
+        // channels to the queues of all matching subscriptions, and a thread which receives
+        // every message on extRecvSocket and passes it to the dispatcher of its channel. All
+        // messages on a channel go through the same dispatcher, so they keep their order.
+        static void startDispatchers();
+
+        // Numbers a received message on its channel, keeps it for polls with afterSeq and
+        // routes it to the subscriptions on matching channels.
+        static void routeReceived(const shared_ptr<ReceivedMessage>& received);
+
         // zmq sockets for internal communication
         static zmq::context_t zmqContext;
-        static zmq::socket_t intPubSocket;
         static zmq::socket_t* extRecvSocket;
 
+        // Durable channel storage, installed by mongod and NULL on mongos. storeDurable is
+        // called by the dispatcher for every message. If it returns true the message is
+        // queued to be stored, and is routed with routeReceived once it is, with its
+        // storedId set. Otherwise the dispatcher routes it. openDurableReader throws if the
+        // channel is not durable.
+        static bool (*storeDurable)(const shared_ptr<ReceivedMessage>& received);
+        static DurableChannelReader* (*openDurableReader)(const std::string& channel,
+                                                          const BSONElement& startAt);
+
     private:
 
+        // Wakes up a poll waiting on one or more subscriptions. A notification sent while the
+        // poll is not waiting is kept until its next wait, so that none are missed.
+        class PollWaiter {
+        public:
+            PollWaiter() : _mutex("pollwaiter"), _notified(false) {}
+
+            void notify();
+
+            // returns once notified or after millis milliseconds
+            void wait(long long millis);
+
+        private:
+            mongo::mutex _mutex;
+            boost::condition _condition;
+            bool _notified;
+        };
+
+        // a message routed to a subscription and waiting in its inbox
+        struct InboxEntry {
+            shared_ptr<const ReceivedMessage> received;
+
+            // the message body after the subscription's projection, see SubscriptionMessage
+            BSONObj message;
+        };
+
         // contains information about a single subscription
         struct SubscriptionInfo {
-            scoped_ptr<zmq::socket_t> sock;
+            SubscriptionInfo()
+                : mutex("subscription"),
+                  pattern(false),
+                  cursorId(0),
+                  inboxSize(0),
+                  inboxBytes(0),
+                  droppedMessages(0),
+                  oversizedNext(false),
+                  pollWaiter(NULL),
+                  replaying(false),
+                  connectionId(0) {}
+
+            // Appends a message to the inbox of its channel, applying the overflow policy if
+            // the message does not fit within the subscription's limits. This and the other
+            // inbox methods must be called with mutex held.
+            void deliver(const InboxEntry& entry);
+
+            // Moves messages from the inbox to out, grouped by channel and in arrival order
+            // within each channel, until the inbox is empty or maxMessages messages or
+            // maxBytes bytes have been moved. 0 is unlimited. If allowLarger is set, the
+            // first message is moved even if it alone is larger than maxBytes, so that it
+            // does not block the subscription. Returns the number of messages and bytes
+            // moved.
+            void drainInbox(std::vector<SubscriptionMessage>* out,
+                            size_t maxMessages,
+                            size_t maxBytes,
+                            bool allowLarger,
+                            size_t* numMessages,
+                            size_t* numBytes);
+
+            // Size of the message drainInbox would move first, 0 if the inbox is empty.
+            size_t nextMessageBytes() const;
+
+            // Removes the oldest message in the inbox, across all channels.
+            void dropOldest();
 
-            // If currently polling, all other polls return error. Set in checkoutSocket
-            // (which locks the map of all subscriptions) to ensure that sockets are only
-            // used by one thread at a time.
-            int inUse : 1;
+            // Empties the inbox without returning its messages.
+            void clearInbox();
+
+            // Whether received is a live copy of a message on channel which was already read
+            // from storage while catching up, see storedThrough.
+            bool isStoredThrough(const ReceivedMessage& received) const;
+
+            // protects the inbox, its sizes, droppedMessages, oversizedNext, returnedSeqs and
+            // pollWaiter
+            SimpleMutex mutex;
+
+            SubscriptionId id;
+
+            // channel prefix or pattern this subscription receives messages on
+            std::string channel;
+
+            // true if channel is a pattern, see ChannelPattern. set before the subscription
+            // is indexed and never changed.
+            bool pattern;
+
+            // Messages routed to this subscription by the dispatcher which have not yet
+            // been returned by a poll, one ring buffer per channel the messages were
+            // published on.
+            typedef std::map<std::string, RingBuffer<InboxEntry> > Inbox;
+            Inbox inbox;
+
+            // id of the cursor reading this subscription, or 0 if it has none.
+            // Protected by cursorMutex.
+            long long cursorId;
+
+            // total number and size of the messages in the inbox
+            size_t inboxSize;
+            size_t inboxBytes;
+
+            SubscriptionLimits limits;
+
+            // number of messages dropped by the overflow policy since the last poll
+            long long droppedMessages;
+
+            // Set when the last poll left a message larger than its byte limit first in the
+            // inbox. Such a message is only returned as the first of a reply, so the next
+            // poll drains this subscription first rather than letting others starve it.
+            bool oversizedNext;
+
+            // The seq of the first and last message returned by a poll on each channel.
+            // A poll with afterSeq returns messages in this range again.
+            struct ReturnedSeqs {
+                unsigned long long first;
+                unsigned long long last;
+            };
+            std::map<std::string, ReturnedSeqs> returnedSeqs;
+
+            // Waiter of the poll currently waiting on this subscription, or NULL if the
+            // subscription is not being polled. Notified by the dispatcher when a message is
+            // appended to the inbox and by unsubscribe.
+            PollWaiter* pollWaiter;
+
+            // The flags below are read and written without holding any lock.
+
+            // If currently polling, all other polls return error. Set in checkoutSubscription
+            // with a compare and swap to ensure that the inbox is only drained by one thread
+            // at a time.
+            AtomicUInt32 inUse;
 
             // Set to indicate the subscription is invalid, and should be disposed of at the
             // next opportune time. This is needed while the subscription is being used and the
             // cleanup must wait.
-            int shouldUnsub : 1;
+            AtomicUInt32 shouldUnsub;
 
-            // Signifies that the subscription has been polled recently and is therefore
-            // still alive. Used to clean up subscriptions that are abandoned.
-            int polledRecently : 1;
+            // When the subscription was created or last checked in by a poll. Used to clean
+            // up subscriptions that are abandoned, see subscriptionCleanup.
+            AtomicInt64 lastActiveMillis;
 
-            // Only return documents for this subscription that match this filter
-            scoped_ptr<Matcher2> filter;
+            // Set when a message exceeded the subscription's limits under the disconnect
+            // overflow policy. The subscription no longer receives messages and is removed,
+            // with an error, by the next poll.
+            AtomicUInt32 overflowed;
+
+            // Only return documents for this subscription that match this filter.
+            // NULL if the subscription has no filter.
+            shared_ptr<PubSubFilter> filter;
 
             // Only return the fields in each document that match the projection
             scoped_ptr<Projection> projection;
-        };
 
-        // max poll length so we can check if unsubscribe has been called
-        static const long maxPollInterval;
+            // The data events this subscription receives, registered with DataEventInterest
+            // while the subscription exists. ops is 0 if it receives none.
+            DataEventInterest::Watch dataEventWatch;
+
+            // Reads the stored messages of the durable channel while the subscription catches
+            // up, NULL otherwise. Only used by the thread which checked out the subscription.
+            scoped_ptr<DurableChannelReader> replay;
+
+            // Set while catching up. Messages published on channel are then not delivered
+            // as they arrive, since they are read from the channel's storage instead.
+            // Protected by mutex.
+            bool replaying;
+
+            // The _id of the last stored message read while catching up, unset if the
+            // subscription never caught up. Messages on channel stored at or before it were
+            // already delivered from storage, so live copies of them are dropped. Protected
+            // by mutex.
+            OID storedThrough;
+
+            // The client connection the subscription is removed with, or 0 if it is only
+            // removed by unsubscribe or when idle.
+            long long connectionId;
+        };
 
         // data structure mapping SubscriptionId to subscription info
         typedef std::map<SubscriptionId, shared_ptr<SubscriptionInfo> > SubscriptionMap;
-        static SubscriptionMap subscriptions;
 
-        // for locking around the subscriptions map in subscribe, poll, and unsubscribe
-        static SimpleMutex mapMutex;
+        // The subscriptions are split across shards by SubscriptionId, each with its own
+        // mutex, so that subscribe, poll and unsubscribe on different subscriptions rarely
+        // wait on each other. A shard's mutex is only held while its map is accessed.
+        struct SubscriptionShard {
+            SubscriptionShard() : mutex("subsmap") {}
+
+            SimpleMutex mutex;
+            SubscriptionMap subscriptions;
+        };
+
+        static const size_t kNumShards = 32;
+        static SubscriptionShard shards[kNumShards];
+
+        static SubscriptionShard& shardFor(const SubscriptionId& subscriptionId);
+
+        // cursor ids of subscriptions opened with openCursor
+        typedef std::map<long long, SubscriptionId> CursorMap;
+        static CursorMap cursors;
+
+        // the subscriptions on a single channel, grouped by filter so that each distinct
+        // filter is evaluated once per message
+        typedef FilterIndex<shared_ptr<SubscriptionInfo> > ChannelFilters;
+
+        // index from each channel with subscriptions to the filters of its subscriptions.
+        // a message on channel c is routed to every subscription whose channel is a prefix
+        // of c, and to every subscription whose pattern matches c through
+        // channelPatternIndex. channelFilters holds the entries of both keyed on the exact
+        // channel or pattern.
+        typedef ChannelTrie<shared_ptr<ChannelFilters> > ChannelIndex;
+        static ChannelIndex channelIndex;
+        typedef ChannelPatternTrie<shared_ptr<ChannelFilters> > ChannelPatternIndex;
+        static ChannelPatternIndex channelPatternIndex;
+        static std::map<std::string, shared_ptr<ChannelFilters> > channelFilters;
+
+        // for locking around the cursors map and the cursor ids of subscriptions. if a
+        // shard's mutex is also needed, cursorMutex must be acquired first.
+        static SimpleMutex cursorMutex;
+
+        // for locking around channelIndex, channelPatternIndex and channelFilters. the
+        // dispatchers hold it shared while they evaluate filters, and subscribe and
+        // unsubscribe hold it exclusively to change the indexes. no other mutex is acquired
+        // while holding it.
+        static RWLock indexLock;
+
+        // The ids of all subscriptions, scheduled to expire when they would exceed their idle
+        // timeout if not polled again. Polls only update lastActiveMillis, so that they do not
+        // contend on expiryMutex. subscriptionCleanup instead schedules a subscription again
+        // if it was polled since. Subscriptions that are removed stay in the wheel until
+        // they expire, but only by id.
+        static SimpleMutex expiryMutex;
+        static TimerWheel<SubscriptionId> expiryWheel;
+
+        // The ids of the subscriptions bound to each client connection. No other mutex is
+        // acquired while holding connectionMutex.
+        typedef std::map<long long, std::set<SubscriptionId> > ConnectionMap;
+        static SimpleMutex connectionMutex;
+        static ConnectionMap connectionSubscriptions;
 
         // Helper method to end all polls on subscriptions passed in. This is used in the case
         // that poll() gets cut off by an error or by hitting the max poll timeout.
@@ -139,31 +503,89 @@ namespace mongo {
                                       shared_ptr<SubscriptionInfo> > > SubscriptionVector;
         static void endCurrentPolls(SubscriptionVector& subs);
 
-        // Gets the SubscriptionInfo object for each SubscriptionId passed in. Fills in the
-        // subs vector with the subscription info and the items vector with zmq::pollitem_t's
-        // that correspond to those subscriptions for polling. In the event of an error finding
+        // Moves the dropped message counts of the subscriptions passed in to droppedMessages.
+        static void takeDroppedMessages(SubscriptionVector& subs,
+                                        std::map<SubscriptionId, long long>& droppedMessages);
+
+        // Gets the SubscriptionInfo object for each SubscriptionId passed in and fills in the
+        // subs vector with the subscription info. In the event of an error finding
         // subscriptions, this method inserts an error message in the errors map for the given
         // SubscriptionId.
         static void getSubscriptions(
                 std::set<SubscriptionId>& subscriptionIds,
-                std::vector<zmq::pollitem_t>& items,
                 SubscriptionVector& subs,
                 std::map<SubscriptionId, std::string>& errors);
 
-        // Methods to check subscriptions and their corresponding sockets in and out to ensure
-        // thread safe use. If you check out a socket, you are guaranteed that no other threads
-        // can check out the socket until you check it back in. This is acheived by setting
-        // and checkingthe bits in the SubscriptionInfo struct. If there is an error
-        // checking a socket out, checkoutSocket returns NULL and sets the error message.
-        static shared_ptr<SubscriptionInfo> checkoutSocket(SubscriptionId subscriptionId,
-                                                           std::string& errmsg);
-        static void checkinSocket(shared_ptr<SubscriptionInfo> s);
-
-        // This method receives messages on all subscriptions passed in. In the event of an error,
-        // this method inserts an error message in the errors map for the given SubscriptionId.
-        static std::priority_queue<SubscriptionMessage> recvMessages(
-                SubscriptionVector& subs,
-                std::map<SubscriptionId, std::string>& errors);
+        // Methods to check subscriptions in and out to ensure thread safe use of their inboxes.
+        // If you check out a subscription, you are guaranteed that no other threads can check
+        // out the subscription until you check it back in. This is acheived by setting
+        // and checking the flags in the SubscriptionInfo struct. If there is an error
+        // checking a subscription out, checkoutSubscription returns NULL and sets the error
+        // message. checkinSubscription removes the subscription if it was unsubscribed while
+        // checked out.
+        static shared_ptr<SubscriptionInfo> checkoutSubscription(SubscriptionId subscriptionId,
+                                                                 std::string& errmsg);
+        static void checkinSubscription(shared_ptr<SubscriptionInfo> s);
+
+        // Adds a subscription to or removes it from the channel index.
+        // Must be called with indexLock held exclusively.
+        static void indexSubscription(const shared_ptr<SubscriptionInfo>& s);
+        static void unindexSubscription(const shared_ptr<SubscriptionInfo>& s);
+
+        // Returns the subscription with the given id, or NULL if there is none.
+        static shared_ptr<SubscriptionInfo> findSubscription(
+                const SubscriptionId& subscriptionId);
+
+        // Removes a subscription from its shard, the channel index and the cursors map.
+        // Does nothing if the subscription was already removed. Must be called with no
+        // mutexes held.
+        static void removeSubscription(const shared_ptr<SubscriptionInfo>& s);
+
+        // Drains the inboxes of all subscriptions passed in, up to maxMessages messages and
+        // maxBytes bytes in total, shared fairly between the subscriptions, and checks them
+        // back in. If replyEmpty is set, nothing else is in the reply yet, so a first message
+        // larger than maxBytes is returned alone rather than left to block the subscription.
+        // Subscriptions left with such a message are drained first by the next poll, see
+        // SubscriptionInfo::oversizedNext.
+        static std::vector<SubscriptionMessage> recvMessages(SubscriptionVector& subs,
+                                                             size_t maxMessages,
+                                                             size_t maxBytes,
+                                                             bool replyEmpty);
+
+        // Runs in a background thread. Receives every message on extRecvSocket and sends it
+        // on to the dispatcher of its channel. Binds the dispatchers' endpoints and then
+        // starts them.
+        static void partition(int numDispatchers);
+
+        // Runs in a background thread per dispatcher. Receives the messages for its
+        // channels from the partition thread and routes them.
+        static void dispatch(int dispatcher);
+
+        // inproc endpoint the partition thread sends the messages of dispatcher to
+        static std::string dispatchEndpoint(int dispatcher);
+
+        // Routes a single received message to the inboxes of all subscriptions on a
+        // matching channel, applying each subscription's filter and projection.
+        static void routeMessage(const shared_ptr<const ReceivedMessage>& received);
+
+        // Recently received messages, kept so that polls with afterSeq can return them again.
+        // Numbers the messages added to it by routeReceived.
+        static SimpleMutex replayMutex;
+        static ReplayBuffer<shared_ptr<const ReceivedMessage> > replayBuffer;
+
+        // Appends the messages of subscription s on the channels in afterSeqs which were
+        // returned by an earlier poll after the given seq to out, and the ranges of those no
+        // longer in the replay buffer to gaps. Must be called with s checked out.
+        static void replayReturned(const shared_ptr<SubscriptionInfo>& s,
+                                   const std::map<std::string, unsigned long long>& afterSeqs,
+                                   std::vector<SubscriptionMessage>* out,
+                                   std::vector<SequenceGap>* gaps);
+
+        // Moves the next stored messages of a catching up subscription to its inbox, reading
+        // until at least one passes the filter or no more are stored. Once all stored
+        // messages have been read the subscription switches to delivery as messages arrive.
+        // Must be called with the subscription checked out and no mutexes held.
+        static void catchUp(const shared_ptr<SubscriptionInfo>& s, size_t maxMessages);
     };
 
 }  // namespace mongo
@@ -0,0 +1,69 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_channel_pattern.h"
+
+namespace mongo {
+
+    const char ChannelPattern::kAnySegment[] = "*";
+    const char ChannelPattern::kAnySegments[] = "**";
+
+    bool ChannelPattern::isPattern(const StringData& channel) {
+        std::vector<StringData> segments;
+        split(channel, &segments);
+        for (size_t i = 0; i < segments.size(); i++) {
+            if (segments[i] == kAnySegment || segments[i] == kAnySegments)
+                return true;
+        }
+        return false;
+    }
+
+    bool ChannelPattern::isValid(const StringData& pattern) {
+        std::vector<StringData> segments;
+        split(pattern, &segments);
+        for (size_t i = 0; i + 1 < segments.size(); i++) {
+            if (segments[i] == kAnySegments)
+                return false;
+        }
+        return true;
+    }
+
+    void ChannelPattern::split(const StringData& channel, std::vector<StringData>* out) {
+        size_t start = 0;
+        while (true) {
+            size_t end = channel.find(kSeparator, start);
+            if (end == std::string::npos) {
+                out->push_back(channel.substr(start));
+                return;
+            }
+            out->push_back(channel.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+}  // namespace mongo
@@ -0,0 +1,242 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "mongo/base/string_data.h"
+
+namespace mongo {
+
+    /**
+     * Channel patterns split channels into segments separated by '.'. A pattern segment "*"
+     * matches exactly one segment of a channel, and a final segment "**" matches one or more
+     * segments. Any other segment only matches the same segment, so "orders.*.eu" matches
+     * "orders.books.eu" but not "ordersArchive.books.eu" or "orders.books.europe". Wildcards
+     * never match segments starting with '$', which are reserved for internal channels.
+     */
+    class ChannelPattern {
+    public:
+        static const char kSeparator = '.';
+        static const char kAnySegment[];
+        static const char kAnySegments[];
+
+        // true if channel has a "*" or "**" segment
+        static bool isPattern(const StringData& channel);
+
+        // true if "**" is only used as the last segment
+        static bool isValid(const StringData& pattern);
+
+        // splits channel into its segments, which point into channel
+        static void split(const StringData& channel, std::vector<StringData>* out);
+    };
+
+    /**
+     * Segment trie over channel patterns, used to route published messages to subscriptions
+     * on patterns. Each value is inserted under a pattern and a lookup on channel c returns
+     * every value whose pattern matches c.
+     *
+     * The patterns are compiled into one automaton with a node per distinct pattern prefix.
+     * A lookup steps through the segments of c, following at most the literal, "*" and "**"
+     * edges of each node it is in, so its cost depends on the segments of c and the shape of
+     * the patterns that match them rather than on the number of patterns stored.
+     *
+     * Not thread safe. T must be copyable and equality comparable.
+     */
+    template <typename T>
+    class ChannelPatternTrie : boost::noncopyable {
+    public:
+        ChannelPatternTrie() : _root(new Node()), _size(0) {}
+
+        ~ChannelPatternTrie() { delete _root; }
+
+        /**
+         * Stores value under pattern, which must be valid. A value may be stored under
+         * several patterns, or several times under the same pattern.
+         */
+        void insert(const StringData& pattern, const T& value) {
+            std::vector<StringData> segments;
+            ChannelPattern::split(pattern, &segments);
+
+            Node* node = _root;
+            for (size_t i = 0; i < segments.size(); i++) {
+                    Node*& child = node->children[segments[i].toString()];
+                    if (!child)
+                        child = new Node();
+                    node = child;
+            }
+
+            node->values.push_back(value);
+            _size++;
+        }
+
+        /**
+         * Removes one instance of value stored under pattern.
+         * Returns false if value was not stored under pattern.
+         */
+        bool remove(const StringData& pattern, const T& value) {
+            std::vector<StringData> segments;
+            ChannelPattern::split(pattern, &segments);
+            if (!removeFrom(_root, segments, 0, value))
+                return false;
+            _size--;
+            return true;
+        }
+
+        /**
+         * Appends every value whose pattern matches channel to out.
+         */
+        void findMatches(const StringData& channel, std::vector<T>* out) const {
+            std::vector<StringData> segments;
+            ChannelPattern::split(channel, &segments);
+
+            // the nodes reached after each segment. a channel matches a pattern in at most one
+            // way, so no node is reached twice.
+            std::vector<const Node*> current(1, _root);
+            std::vector<const Node*> next;
+            for (size_t i = 0; i < segments.size() && !current.empty(); i++) {
+                    std::string segment = segments[i].toString();
+                    bool wildcardable = segment.empty() || segment[0] != '$';
+
+                    next.clear();
+                    for (size_t j = 0; j < current.size(); j++) {
+                        const Node* node = current[j];
+
+                        const Node* child = node->child(segment);
+                        if (child)
+                            next.push_back(child);
+
+                        if (!wildcardable)
+                            continue;
+
+                        child = node->child(ChannelPattern::kAnySegment);
+                        if (child)
+                            next.push_back(child);
+
+                        // "**" is always last, so it matches here and now
+                        child = node->child(ChannelPattern::kAnySegments);
+                        if (child)
+                            out->insert(out->end(), child->values.begin(), child->values.end());
+                    }
+                    current.swap(next);
+            }
+
+            for (size_t j = 0; j < current.size(); j++)
+                out->insert(out->end(), current[j]->values.begin(), current[j]->values.end());
+        }
+
+        /**
+         * Number of values stored in the trie.
+         */
+        size_t size() const { return _size; }
+
+        bool empty() const { return _size == 0; }
+
+        /**
+         * Number of nodes in the trie, including the root. Exposed for testing that nodes
+         * are removed with the last value under them.
+         */
+        size_t numNodes() const { return countNodes(_root); }
+
+    private:
+        struct Node : boost::noncopyable {
+            typedef std::map<std::string, Node*> Children;
+
+            ~Node() {
+                for (typename Children::iterator it = children.begin();
+                     it != children.end();
+                     it++) {
+                        delete it->second;
+                }
+            }
+
+            const Node* child(const std::string& segment) const {
+                typename Children::const_iterator it = children.find(segment);
+                return it == children.end() ? NULL : it->second;
+            }
+
+            // values stored under the pattern ending at this node
+            std::vector<T> values;
+
+            // child nodes keyed on the next pattern segment
+            Children children;
+        };
+
+        static size_t countNodes(const Node* node) {
+            size_t count = 1;
+            for (typename Node::Children::const_iterator it = node->children.begin();
+                 it != node->children.end();
+                 it++) {
+                    count += countNodes(it->second);
+            }
+            return count;
+        }
+
+        // Removes value from the subtree rooted at node, which is reached by the first pos
+        // segments. Nodes left without values or children are deleted.
+        bool removeFrom(Node* node,
+                        const std::vector<StringData>& segments,
+                        size_t pos,
+                        const T& value) {
+            if (pos == segments.size()) {
+                typename std::vector<T>::iterator it =
+                    std::find(node->values.begin(), node->values.end(), value);
+                if (it == node->values.end())
+                    return false;
+                node->values.erase(it);
+                return true;
+            }
+
+            typename Node::Children::iterator childIt =
+                node->children.find(segments[pos].toString());
+            if (childIt == node->children.end())
+                return false;
+
+            Node* child = childIt->second;
+            if (!removeFrom(child, segments, pos + 1, value))
+                return false;
+
+            if (child->values.empty() && child->children.empty()) {
+                node->children.erase(childIt);
+                delete child;
+            }
+
+            return true;
+        }
+
+        Node* _root;
+        size_t _size;
+    };
+
+}  // namespace mongo
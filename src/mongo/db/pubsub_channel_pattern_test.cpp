@@ -0,0 +1,141 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_channel_pattern.h"
+
+#include <algorithm>
+
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+
+    namespace {
+
+        std::vector<int> find(const ChannelPatternTrie<int>& trie, const StringData& channel) {
+            std::vector<int> out;
+            trie.findMatches(channel, &out);
+            std::sort(out.begin(), out.end());
+            return out;
+        }
+
+    }
+
+    TEST(ChannelPatternTest, IsPattern) {
+        ASSERT_TRUE(ChannelPattern::isPattern("*"));
+        ASSERT_TRUE(ChannelPattern::isPattern("orders.*.eu"));
+        ASSERT_TRUE(ChannelPattern::isPattern("orders.**"));
+        ASSERT_FALSE(ChannelPattern::isPattern("orders"));
+        ASSERT_FALSE(ChannelPattern::isPattern("orders*.eu"));
+        ASSERT_FALSE(ChannelPattern::isPattern("orders.***"));
+        ASSERT_FALSE(ChannelPattern::isPattern(""));
+    }
+
+    TEST(ChannelPatternTest, IsValid) {
+        ASSERT_TRUE(ChannelPattern::isValid("orders.*.eu"));
+        ASSERT_TRUE(ChannelPattern::isValid("orders.**"));
+        ASSERT_TRUE(ChannelPattern::isValid("**"));
+        ASSERT_FALSE(ChannelPattern::isValid("orders.**.eu"));
+    }
+
+    TEST(ChannelPatternTrieTest, ExactSegments) {
+        ChannelPatternTrie<int> trie;
+        trie.insert("orders.*.eu", 1);
+
+        ASSERT_EQUALS(1U, find(trie, "orders.books.eu").size());
+        ASSERT_TRUE(find(trie, "orders.books.europe").empty());
+        ASSERT_TRUE(find(trie, "ordersArchive.books.eu").empty());
+        ASSERT_TRUE(find(trie, "orders.books.eu.west").empty());
+        ASSERT_TRUE(find(trie, "orders.eu").empty());
+        ASSERT_TRUE(find(trie, "orders.a.b.eu").empty());
+    }
+
+    TEST(ChannelPatternTrieTest, TrailingAnySegments) {
+        ChannelPatternTrie<int> trie;
+        trie.insert("orders.**", 1);
+
+        ASSERT_EQUALS(1U, find(trie, "orders.books").size());
+        ASSERT_EQUALS(1U, find(trie, "orders.books.eu.west").size());
+        ASSERT_TRUE(find(trie, "orders").empty());
+        ASSERT_TRUE(find(trie, "ordersArchive.books").empty());
+    }
+
+    TEST(ChannelPatternTrieTest, OverlappingPatterns) {
+        ChannelPatternTrie<int> trie;
+        trie.insert("orders.books.eu", 1);
+        trie.insert("orders.*.eu", 2);
+        trie.insert("*.books.*", 3);
+        trie.insert("orders.**", 4);
+        trie.insert("**", 5);
+        trie.insert("orders.*.us", 6);
+
+        std::vector<int> found = find(trie, "orders.books.eu");
+        ASSERT_EQUALS(5U, found.size());
+        for (int i = 0; i < 5; i++)
+            ASSERT_EQUALS(i + 1, found[i]);
+
+        found = find(trie, "orders.toys.us");
+        ASSERT_EQUALS(3U, found.size());
+        ASSERT_EQUALS(4, found[0]);
+        ASSERT_EQUALS(5, found[1]);
+        ASSERT_EQUALS(6, found[2]);
+    }
+
+    TEST(ChannelPatternTrieTest, WildcardsSkipReservedSegments) {
+        ChannelPatternTrie<int> trie;
+        trie.insert("*", 1);
+        trie.insert("**", 2);
+        trie.insert("$events", 3);
+
+        std::vector<int> found = find(trie, "$events");
+        ASSERT_EQUALS(1U, found.size());
+        ASSERT_EQUALS(3, found[0]);
+        ASSERT_EQUALS(2U, find(trie, "orders").size());
+    }
+
+    TEST(ChannelPatternTrieTest, Remove) {
+        ChannelPatternTrie<int> trie;
+        trie.insert("orders.*.eu", 1);
+        trie.insert("orders.*.eu", 1);
+        trie.insert("orders.**", 2);
+        ASSERT_EQUALS(3U, trie.size());
+        ASSERT_EQUALS(5U, trie.numNodes());
+
+        ASSERT_FALSE(trie.remove("orders.*.us", 1));
+        ASSERT_FALSE(trie.remove("orders.**", 1));
+
+        ASSERT_TRUE(trie.remove("orders.*.eu", 1));
+        ASSERT_EQUALS(2U, find(trie, "orders.books.eu").size());
+        ASSERT_TRUE(trie.remove("orders.*.eu", 1));
+        ASSERT_EQUALS(3U, trie.numNodes());
+
+        ASSERT_TRUE(trie.remove("orders.**", 2));
+        ASSERT_TRUE(trie.empty());
+        ASSERT_EQUALS(1U, trie.numNodes());
+    }
+
+}  // namespace mongo
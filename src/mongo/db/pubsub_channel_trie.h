@@ -0,0 +1,239 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "mongo/base/string_data.h"
+
+namespace mongo {
+
+    /**
+     * Radix tree keyed on the bytes of a channel name, used to route published messages to
+     * subscriptions. Each value is inserted under a key (the channel it subscribed to) and a
+     * lookup on channel c returns every value whose key is a prefix of c.
+     *
+     * Edges are compressed, so a lookup visits at most one node per distinct key that is a
+     * prefix of c and the cost of routing a message depends on the length of its channel and
+     * the number of matching values, not on the total number of values stored.
+     *
+     * Not thread safe. T must be copyable and equality comparable.
+     */
+    template <typename T>
+    class ChannelTrie : boost::noncopyable {
+    public:
+        ChannelTrie() : _root(new Node()), _size(0) {}
+
+        ~ChannelTrie() { delete _root; }
+
+        /**
+         * Stores value under key. A value may be stored under several keys, or several
+         * times under the same key.
+         */
+        void insert(const StringData& key, const T& value) {
+            Node* node = _root;
+            size_t pos = 0;
+
+            while (pos < key.size()) {
+                typename Node::Children::iterator childIt = node->children.find(key[pos]);
+
+                // no edge starting with the next byte, so hang a new leaf for the rest of the key
+                if (childIt == node->children.end()) {
+                    Node* leaf = new Node();
+                    leaf->edge = key.substr(pos).toString();
+                    node->children[key[pos]] = leaf;
+                    node = leaf;
+                    break;
+                }
+
+                Node* child = childIt->second;
+                size_t common = commonPrefixLength(child->edge, key.substr(pos));
+
+                // key diverges in the middle of the child's edge, so split the edge
+                if (common < child->edge.size()) {
+                    Node* middle = new Node();
+                    middle->edge = child->edge.substr(0, common);
+                    child->edge = child->edge.substr(common);
+                    middle->children[child->edge[0]] = child;
+                    childIt->second = middle;
+                    child = middle;
+                }
+
+                node = child;
+                pos += common;
+            }
+
+            node->values.push_back(value);
+            _size++;
+        }
+
+        /**
+         * Removes one instance of value stored under key.
+         * Returns false if value was not stored under key.
+         */
+        bool remove(const StringData& key, const T& value) {
+            if (!removeFrom(_root, key, value))
+                return false;
+            _size--;
+            return true;
+        }
+
+        /**
+         * Appends every value whose key is a prefix of channel (including channel itself and
+         * the empty key) to out, in order of increasing key length.
+         */
+        void findPrefixesOf(const StringData& channel, std::vector<T>* out) const {
+            const Node* node = _root;
+            size_t pos = 0;
+
+            while (true) {
+                out->insert(out->end(), node->values.begin(), node->values.end());
+
+                if (pos == channel.size())
+                    return;
+
+                typename Node::Children::const_iterator childIt =
+                    node->children.find(channel[pos]);
+                if (childIt == node->children.end())
+                    return;
+
+                // keys only end at nodes, so the whole edge must match
+                const Node* child = childIt->second;
+                if (!channel.substr(pos).startsWith(child->edge))
+                    return;
+
+                node = child;
+                pos += child->edge.size();
+            }
+        }
+
+        /**
+         * Number of values stored in the trie.
+         */
+        size_t size() const { return _size; }
+
+        bool empty() const { return _size == 0; }
+
+        /**
+         * Number of nodes in the trie, including the root. Exposed for testing that
+         * edges are split and merged as values are inserted and removed.
+         */
+        size_t numNodes() const { return countNodes(_root); }
+
+    private:
+        struct Node : boost::noncopyable {
+            typedef std::map<char, Node*> Children;
+
+            ~Node() {
+                for (typename Children::iterator it = children.begin();
+                     it != children.end();
+                     it++) {
+                        delete it->second;
+                }
+            }
+
+            // bytes of the key between this node's parent and this node
+            std::string edge;
+
+            // values stored under the key ending at this node
+            std::vector<T> values;
+
+            // child nodes keyed on the first byte of their edge
+            Children children;
+        };
+
+        static size_t commonPrefixLength(const std::string& a, const StringData& b) {
+            size_t len = std::min(a.size(), b.size());
+            size_t i = 0;
+            while (i < len && a[i] == b[i])
+                i++;
+            return i;
+        }
+
+        static size_t countNodes(const Node* node) {
+            size_t count = 1;
+            for (typename Node::Children::const_iterator it = node->children.begin();
+                 it != node->children.end();
+                 it++) {
+                    count += countNodes(it->second);
+            }
+            return count;
+        }
+
+        // Removes value from the subtree rooted at node, where key is relative to node.
+        // Nodes left without values or children are deleted, and nodes left without values
+        // and with a single child are merged with that child so that edges stay compressed.
+        bool removeFrom(Node* node, const StringData& key, const T& value) {
+            if (key.empty()) {
+                typename std::vector<T>::iterator it =
+                    std::find(node->values.begin(), node->values.end(), value);
+                if (it == node->values.end())
+                    return false;
+                node->values.erase(it);
+                return true;
+            }
+
+            typename Node::Children::iterator childIt = node->children.find(key[0]);
+            if (childIt == node->children.end())
+                return false;
+
+            Node* child = childIt->second;
+            if (!key.startsWith(child->edge))
+                return false;
+
+            if (!removeFrom(child, key.substr(child->edge.size()), value))
+                return false;
+
+            if (child->values.empty()) {
+                if (child->children.empty()) {
+                    node->children.erase(childIt);
+                    delete child;
+                }
+                else if (child->children.size() == 1) {
+                    Node* grandchild = child->children.begin()->second;
+                    grandchild->edge = child->edge + grandchild->edge;
+                    child->children.clear();
+                    childIt->second = grandchild;
+                    delete child;
+                }
+            }
+
+            return true;
+        }
+
+        Node* _root;
+        size_t _size;
+    };
+
+}  // namespace mongo
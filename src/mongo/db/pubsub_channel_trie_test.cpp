@@ -0,0 +1,223 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_channel_trie.h"
+
+#include <algorithm>
+
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    namespace {
+
+        std::vector<int> find(const ChannelTrie<int>& trie, const StringData& channel) {
+            std::vector<int> out;
+            trie.findPrefixesOf(channel, &out);
+            std::sort(out.begin(), out.end());
+            return out;
+        }
+
+    }
+
+    TEST(ChannelTrieTest, Empty) {
+        ChannelTrie<int> trie;
+        ASSERT_TRUE(trie.empty());
+        ASSERT_EQUALS(1U, trie.numNodes());
+        ASSERT_TRUE(find(trie, "").empty());
+        ASSERT_TRUE(find(trie, "a").empty());
+    }
+
+    TEST(ChannelTrieTest, ExactMatch) {
+        ChannelTrie<int> trie;
+        trie.insert("orders", 1);
+        ASSERT_EQUALS(1U, trie.size());
+
+        std::vector<int> out = find(trie, "orders");
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(1, out[0]);
+
+        ASSERT_TRUE(find(trie, "order").empty());
+        ASSERT_TRUE(find(trie, "ordet").empty());
+        ASSERT_TRUE(find(trie, "").empty());
+    }
+
+    TEST(ChannelTrieTest, PrefixMatch) {
+        ChannelTrie<int> trie;
+        trie.insert("", 0);
+        trie.insert("a", 1);
+        trie.insert("ab", 2);
+        trie.insert("abc", 3);
+        trie.insert("abd", 4);
+        trie.insert("b", 5);
+
+        std::vector<int> out = find(trie, "abcdef");
+        ASSERT_EQUALS(4U, out.size());
+        ASSERT_EQUALS(0, out[0]);
+        ASSERT_EQUALS(1, out[1]);
+        ASSERT_EQUALS(2, out[2]);
+        ASSERT_EQUALS(3, out[3]);
+
+        out = find(trie, "abd");
+        ASSERT_EQUALS(4U, out.size());
+        ASSERT_EQUALS(4, out[3]);
+
+        out = find(trie, "bcd");
+        ASSERT_EQUALS(2U, out.size());
+        ASSERT_EQUALS(0, out[0]);
+        ASSERT_EQUALS(5, out[1]);
+
+        out = find(trie, "c");
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(0, out[0]);
+    }
+
+    TEST(ChannelTrieTest, PrefixMatchIsOrderedByKeyLength) {
+        ChannelTrie<int> trie;
+        trie.insert("abc", 3);
+        trie.insert("a", 1);
+        trie.insert("ab", 2);
+
+        std::vector<int> out;
+        trie.findPrefixesOf("abcd", &out);
+        ASSERT_EQUALS(3U, out.size());
+        ASSERT_EQUALS(1, out[0]);
+        ASSERT_EQUALS(2, out[1]);
+        ASSERT_EQUALS(3, out[2]);
+    }
+
+    TEST(ChannelTrieTest, SplitEdge) {
+        ChannelTrie<int> trie;
+        trie.insert("ordersArchive", 1);
+        ASSERT_EQUALS(2U, trie.numNodes());
+
+        // inserting a key in the middle of an edge splits it
+        trie.insert("orders", 2);
+        ASSERT_EQUALS(3U, trie.numNodes());
+
+        // diverging from the middle of an edge splits it and adds a leaf
+        trie.insert("ordinal", 3);
+        ASSERT_EQUALS(5U, trie.numNodes());
+
+        ASSERT_EQUALS(2U, find(trie, "ordersArchive").size());
+        ASSERT_EQUALS(1U, find(trie, "orders").size());
+        ASSERT_EQUALS(1U, find(trie, "ordinals").size());
+        ASSERT_TRUE(find(trie, "ord").empty());
+        ASSERT_EQUALS(1U, find(trie, "ordersA").size());
+        ASSERT_EQUALS(2, find(trie, "ordersA")[0]);
+    }
+
+    TEST(ChannelTrieTest, DuplicateValues) {
+        ChannelTrie<int> trie;
+        trie.insert("a", 1);
+        trie.insert("a", 1);
+        ASSERT_EQUALS(2U, trie.size());
+        ASSERT_EQUALS(2U, find(trie, "a").size());
+
+        ASSERT_TRUE(trie.remove("a", 1));
+        ASSERT_EQUALS(1U, find(trie, "a").size());
+        ASSERT_TRUE(trie.remove("a", 1));
+        ASSERT_TRUE(find(trie, "a").empty());
+        ASSERT_FALSE(trie.remove("a", 1));
+    }
+
+    TEST(ChannelTrieTest, RemoveMissing) {
+        ChannelTrie<int> trie;
+        trie.insert("abc", 1);
+        ASSERT_FALSE(trie.remove("abc", 2));
+        ASSERT_FALSE(trie.remove("ab", 1));
+        ASSERT_FALSE(trie.remove("abcd", 1));
+        ASSERT_FALSE(trie.remove("x", 1));
+        ASSERT_EQUALS(1U, trie.size());
+    }
+
+    TEST(ChannelTrieTest, RemoveMergesEdges) {
+        ChannelTrie<int> trie;
+        trie.insert("orders", 1);
+        trie.insert("ordersArchive", 2);
+        trie.insert("ordinal", 3);
+        ASSERT_EQUALS(5U, trie.numNodes());
+
+        // "ord" is left with a single child and no values, so it merges with "ers"
+        ASSERT_TRUE(trie.remove("ordinal", 3));
+        ASSERT_EQUALS(3U, trie.numNodes());
+
+        // "orders" is left with a single child and no values, so it merges with "Archive"
+        ASSERT_TRUE(trie.remove("orders", 1));
+        ASSERT_EQUALS(2U, trie.numNodes());
+        ASSERT_EQUALS(1U, find(trie, "ordersArchive").size());
+        ASSERT_TRUE(find(trie, "orders").empty());
+
+        ASSERT_TRUE(trie.remove("ordersArchive", 2));
+        ASSERT_EQUALS(1U, trie.numNodes());
+        ASSERT_TRUE(trie.empty());
+    }
+
+    TEST(ChannelTrieTest, ReinsertAfterRemove) {
+        ChannelTrie<int> trie;
+        trie.insert("abc", 1);
+        trie.insert("abd", 2);
+        ASSERT_TRUE(trie.remove("abc", 1));
+        trie.insert("ab", 3);
+        trie.insert("abc", 4);
+
+        std::vector<int> out = find(trie, "abcd");
+        ASSERT_EQUALS(2U, out.size());
+        ASSERT_EQUALS(3, out[0]);
+        ASSERT_EQUALS(4, out[1]);
+
+        out = find(trie, "abd");
+        ASSERT_EQUALS(2U, out.size());
+        ASSERT_EQUALS(2, out[0]);
+        ASSERT_EQUALS(3, out[1]);
+    }
+
+    TEST(ChannelTrieTest, ManyChannels) {
+        ChannelTrie<int> trie;
+        const int numChannels = 1000;
+        for (int i = 0; i < numChannels; i++) {
+            trie.insert(std::string(mongoutils::str::stream() << "channel" << i), i);
+        }
+        ASSERT_EQUALS(static_cast<size_t>(numChannels), trie.size());
+
+        // "channel12" is a prefix of "channel123"
+        std::vector<int> out = find(trie, "channel123");
+        ASSERT_EQUALS(3U, out.size());
+        ASSERT_EQUALS(1, out[0]);
+        ASSERT_EQUALS(12, out[1]);
+        ASSERT_EQUALS(123, out[2]);
+
+        for (int i = 0; i < numChannels; i++) {
+            ASSERT_TRUE(trie.remove(std::string(mongoutils::str::stream() << "channel" << i), i));
+        }
+        ASSERT_TRUE(trie.empty());
+        ASSERT_EQUALS(1U, trie.numNodes());
+    }
+
+}  // namespace mongo
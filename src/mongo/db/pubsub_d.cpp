@@ -32,6 +32,7 @@
 #include <zmq.hpp>
 
 #include "mongo/db/pubsub.h"
+#include "mongo/db/pubsub_durable.h"
 #include "mongo/db/pubsub_sendsock.h"
 #include "mongo/db/server_options.h"
 #include "mongo/util/background.h"
@@ -93,6 +94,9 @@ namespace mongo {
                 boost::thread internalProxy(PubSub::proxy,
                                             PubSub::extRecvSocket,
                                             PubSubSendSocket::extSendSocket);
+
+                // send messages published on the config server itself
+                boost::thread messageSender(PubSubSendSocket::sendMessages);
             }
             else {
                 // each mongod in a replica set publishes its messages
@@ -109,9 +113,6 @@ namespace mongo {
                     const std::string kExtPubEndpoint = str::stream() << "tcp://localhost:"
                                                                       << port + 1234;
                     PubSubSendSocket::extSendSocket->connect(kExtPubEndpoint.c_str());
-
-                    // automatically proxy messages from SUB endpoint to client sub sockets
-                    PubSub::intPubSocket.bind(PubSub::kIntPubSubEndpoint);
                 }
                 catch (zmq::error_t& e) {
                     log() << "Error initializing PubSub sockets. Turning off PubSub..."
@@ -121,13 +122,29 @@ namespace mongo {
                     return;
                 }
 
-                // proxy incoming messages to internal publisher to be received by clients
-                boost::thread internalProxy(PubSub::proxy,
-                                            PubSub::extRecvSocket,
-                                            &PubSub::intPubSocket);
+                // send published messages from a single thread which owns the send sockets
+                boost::thread messageSender(PubSubSendSocket::sendMessages);
+
+                // store messages on durable channels before they are routed
+                PubSub::storeDurable = DurableChannels::store;
+                boost::thread durableWriter(DurableChannels::writeMessages);
+                PubSub::openDurableReader = DurableChannels::openReader;
 
-                // clean up subscriptions that have been inactive for at least 10 minutes
+                // route received messages to subscription inboxes
+                PubSub::startDispatchers();
+
+                // serve getMore and killCursors on subscription cursors
+                pubsubGetMore = PubSub::getMore;
+                pubsubKillCursor = PubSub::killCursor;
+
+                // remove the subscriptions bound to a client connection when it closes
+                pubsubConnectionClosed = PubSub::connectionClosed;
+
+                // remove subscriptions that have not been polled for their idle timeout
                 boost::thread subscriptionCleanup(PubSub::subscriptionCleanup);
+
+                // tell the other members of the replica set which data events are watched here
+                boost::thread dataEventAnnouncer(DataEventInterest::announceLoop);
             }
 
         }
@@ -0,0 +1,371 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pubsub_data_event_interest.h"
+
+#include <map>
+#include <vector>
+
+#include "mongo/db/pubsub_sendsock.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/threadlocal.h"
+
+namespace mongo {
+
+    const char DataEventInterest::kEventsChannel[] = "$events";
+    const char DataEventInterest::kAnnounceChannel[] = "$watches";
+
+    namespace {
+
+        const long long kAnnounceIntervalMillis = 2 * 1000;
+
+        // the watches of a member are dropped if it does not announce them again in time
+        const long long kRemoteExpiryMillis = 3 * kAnnounceIntervalMillis;
+
+        // field names of announcements
+        const char kNodeField[] = "node";
+        const char kWatchesField[] = "watches";
+        const char kDbField[] = "db";
+        const char kCollectionField[] = "collection";
+        const char kOpsField[] = "ops";
+        const char kTypeField[] = "type";
+
+        const int kNumOpTypes = 3;
+
+        int opFromName(const StringData& name) {
+            if (name == "insert")
+                return DataEventInterest::kInsert;
+            if (name == "update")
+                return DataEventInterest::kUpdate;
+            if (name == "remove")
+                return DataEventInterest::kRemove;
+            return 0;
+        }
+
+        std::string stringField(const BSONObj& obj, const char* fieldName) {
+            BSONElement e = obj[fieldName];
+            return e.type() == String ? e.String() : std::string();
+        }
+
+        // number of local subscriptions watching each op type of a (db, collection) pair
+        struct OpCounts {
+            OpCounts() {
+                for (int i = 0; i < kNumOpTypes; i++)
+                    counts[i] = 0;
+            }
+
+            int ops() const {
+                int ops = 0;
+                for (int i = 0; i < kNumOpTypes; i++) {
+                    if (counts[i] > 0)
+                        ops |= 1 << i;
+                }
+                return ops;
+            }
+
+            int counts[kNumOpTypes];
+        };
+
+        typedef std::map<std::pair<std::string, std::string>, OpCounts> LocalWatches;
+
+        struct RemoteWatches {
+            long long expires;
+            std::vector<DataEventInterest::Watch> watches;
+        };
+
+        typedef std::map<OID, RemoteWatches> RemoteWatchMap;
+
+        // for locking around the watches below and currentInterest
+        SimpleMutex interestMutex("dataeventinterest");
+        LocalWatches localWatches;
+        RemoteWatchMap remoteWatches;
+
+        // identifies this node in its announcements
+        OID nodeId = OID::gen();
+
+        // set once announceLoop is running, so that local changes are announced right away
+        AtomicUInt32 announcing;
+
+    }
+
+    // The ops watched on each namespace, combined from all local and remote watches.
+    // Immutable once built, and replaced whenever a watch changes.
+    struct DataEventInterestSnapshot {
+        DataEventInterestSnapshot() : anyOps(0), allOps(0) {}
+
+        void add(const DataEventInterest::Watch& watch) {
+            anyOps |= watch.ops;
+            if (watch.db.empty())
+                allOps |= watch.ops;
+            else if (watch.collection.empty())
+                dbOps[watch.db] |= watch.ops;
+            else
+                nsOps[watch.db + "." + watch.collection] |= watch.ops;
+        }
+
+        // ops watched anywhere
+        int anyOps;
+
+        // ops watched on every database
+        int allOps;
+
+        // ops watched on every collection of a database, and on single namespaces
+        std::map<std::string, int> dbOps;
+        std::map<std::string, int> nsOps;
+    };
+
+    // the snapshot a thread last read, and the version it was read at
+    struct CachedDataEventInterest {
+        CachedDataEventInterest() : version(0) {}
+
+        unsigned version;
+        shared_ptr<const DataEventInterestSnapshot> snapshot;
+    };
+
+    TSP_DECLARE(CachedDataEventInterest, cachedDataEventInterest)
+    TSP_DEFINE(CachedDataEventInterest, cachedDataEventInterest)
+
+    namespace {
+
+        shared_ptr<const DataEventInterestSnapshot> currentInterest(
+            new DataEventInterestSnapshot());
+
+        // incremented every time currentInterest is replaced. starts above the version of
+        // a fresh thread's cache so that the first check reads the snapshot.
+        AtomicUInt32 interestVersion(1);
+
+        // must be called with interestMutex held
+        void rebuildInterest() {
+            shared_ptr<DataEventInterestSnapshot> interest(new DataEventInterestSnapshot());
+
+            for (LocalWatches::const_iterator it = localWatches.begin();
+                 it != localWatches.end();
+                 it++) {
+                    DataEventInterest::Watch watch;
+                    watch.db = it->first.first;
+                    watch.collection = it->first.second;
+                    watch.ops = it->second.ops();
+                    interest->add(watch);
+            }
+
+            for (RemoteWatchMap::const_iterator it = remoteWatches.begin();
+                 it != remoteWatches.end();
+                 it++) {
+                    for (size_t i = 0; i < it->second.watches.size(); i++)
+                        interest->add(it->second.watches[i]);
+            }
+
+            currentInterest = interest;
+            interestVersion.fetchAndAdd(1);
+        }
+
+        // publishes the local watches of this node to the other members of its replica set
+        void announce() {
+            BSONObjBuilder b;
+            b.append(kNodeField, nodeId);
+            {
+                BSONArrayBuilder watches(b.subarrayStart(kWatchesField));
+                SimpleMutex::scoped_lock lk(interestMutex);
+                for (LocalWatches::const_iterator it = localWatches.begin();
+                     it != localWatches.end();
+                     it++) {
+                        int ops = it->second.ops();
+                        if (ops == 0)
+                            continue;
+                        BSONObjBuilder watch(watches.subobjStart());
+                        watch.append(kDbField, it->first.first);
+                        watch.append(kCollectionField, it->first.second);
+                        watch.append(kOpsField, ops);
+                        watch.done();
+                }
+                watches.done();
+            }
+
+            if (pubsubEnabled)
+                PubSubSendSocket::publish(DataEventInterest::kAnnounceChannel, b.obj());
+        }
+
+        void updateLocal(const DataEventInterest::Watch& watch, int delta) {
+            {
+                SimpleMutex::scoped_lock lk(interestMutex);
+                OpCounts& counts = localWatches[std::make_pair(watch.db, watch.collection)];
+                for (int i = 0; i < kNumOpTypes; i++) {
+                    if (watch.ops & (1 << i))
+                        counts.counts[i] += delta;
+                }
+                if (counts.ops() == 0)
+                    localWatches.erase(std::make_pair(watch.db, watch.collection));
+                rebuildInterest();
+            }
+
+            if (announcing.load())
+                announce();
+        }
+
+    }
+
+    bool DataEventInterest::watchFor(const std::string& channel,
+                                     const BSONObj& filter,
+                                     Watch* out) {
+        // data events are published on exactly $events, so they reach subscriptions on any
+        // prefix of it and no others
+        if (!StringData(kEventsChannel).startsWith(channel))
+            return false;
+
+        out->db = stringField(filter, kDbField);
+        // a collection can only be watched within a database
+        out->collection = out->db.empty() ? std::string() : stringField(filter, kCollectionField);
+        out->ops = kAllOps;
+
+        BSONElement typeElem = filter[kTypeField];
+        if (typeElem.type() == String)
+            out->ops = opFromName(typeElem.valuestr());
+
+        return out->ops != 0;
+    }
+
+    void DataEventInterest::addLocal(const Watch& watch) {
+        updateLocal(watch, 1);
+    }
+
+    void DataEventInterest::removeLocal(const Watch& watch) {
+        updateLocal(watch, -1);
+    }
+
+    bool DataEventInterest::covers(const Watch& watch, const BSONObj& event) {
+        // a watch on a single namespace only receives events on it
+        if (!watch.collection.empty())
+            return true;
+
+        // the same exclusions as watched, since a namespace being watched by name does not
+        // make it watched by the other subscriptions
+        NamespaceString ns(stringField(event, kDbField), stringField(event, kCollectionField));
+        if (ns.isSystem())
+            return false;
+        return !watch.db.empty() || ns.db() != "local";
+    }
+
+    bool DataEventInterest::watched(const NamespaceString& ns, OpType op) {
+        // dbEventSocket is non-null iff mongod is in a sharded environment
+        if (PubSubSendSocket::dbEventSocket != NULL)
+            return true;
+
+        CachedDataEventInterest* cached = cachedDataEventInterest.getMake();
+        if (cached->version != interestVersion.load()) {
+            SimpleMutex::scoped_lock lk(interestMutex);
+            cached->snapshot = currentInterest;
+            cached->version = interestVersion.load();
+        }
+
+        const DataEventInterestSnapshot& interest = *cached->snapshot;
+        if (!(interest.anyOps & op))
+            return false;
+
+        bool isSystem = ns.isSystem();
+        if ((interest.allOps & op) && !isSystem && ns.db() != "local")
+            return true;
+
+        if (!interest.nsOps.empty()) {
+            std::map<std::string, int>::const_iterator it = interest.nsOps.find(ns.ns());
+            if (it != interest.nsOps.end() && (it->second & op))
+                return true;
+        }
+
+        if (!interest.dbOps.empty() && !isSystem) {
+            std::map<std::string, int>::const_iterator it =
+                interest.dbOps.find(ns.db().toString());
+            if (it != interest.dbOps.end() && (it->second & op))
+                return true;
+        }
+
+        return false;
+    }
+
+    void DataEventInterest::announceLoop() {
+        announcing.store(1);
+        while (true) {
+            bool haveWatches;
+            {
+                SimpleMutex::scoped_lock lk(interestMutex);
+                haveWatches = !localWatches.empty();
+
+                // expire the watches of members which stopped announcing
+                long long now = curTimeMillis64();
+                bool expired = false;
+                RemoteWatchMap::iterator it = remoteWatches.begin();
+                while (it != remoteWatches.end()) {
+                    if (it->second.expires < now) {
+                        remoteWatches.erase(it++);
+                        expired = true;
+                    }
+                    else {
+                        it++;
+                    }
+                }
+                if (expired)
+                    rebuildInterest();
+            }
+
+            // changes are announced as they happen, so an empty set of watches only needs
+            // to be announced once
+            if (haveWatches)
+                announce();
+
+            sleepmillis(kAnnounceIntervalMillis);
+        }
+    }
+
+    void DataEventInterest::receiveAnnouncement(const BSONObj& announcement) {
+        BSONElement nodeElem = announcement[kNodeField];
+        if (nodeElem.type() != jstOID || nodeElem.OID() == nodeId)
+            return;
+
+        RemoteWatches remote;
+        remote.expires = curTimeMillis64() + kRemoteExpiryMillis;
+        BSONObjIterator it(announcement.getObjectField(kWatchesField));
+        while (it.more()) {
+            BSONObj watchObj = it.next().Obj();
+            Watch watch;
+            watch.db = stringField(watchObj, kDbField);
+            watch.collection = stringField(watchObj, kCollectionField);
+            watch.ops = watchObj[kOpsField].numberInt() & kAllOps;
+            remote.watches.push_back(watch);
+        }
+
+        SimpleMutex::scoped_lock lk(interestMutex);
+        if (remote.watches.empty())
+            remoteWatches.erase(nodeElem.OID());
+        else
+            remoteWatches[nodeElem.OID()] = remote;
+        rebuildInterest();
+    }
+
+}  // namespace mongo
@@ -0,0 +1,105 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/namespace_string.h"
+
+namespace mongo {
+
+    /**
+     * Tracks which namespaces and operation types have at least one subscriber watching their
+     * data events, so that writes nobody watches skip building events entirely.
+     *
+     * Subscriptions on this node register their watches directly. Each mongod in a replica
+     * set also announces its watches to the other members on an internal channel, so that
+     * writes on the primary are published for subscribers on any member. Announcements are
+     * repeated periodically, and the watches of a member which stops announcing expire.
+     *
+     * Watches on every database do not cover the local database or system collections, and
+     * watches on a whole database do not cover its system collections. Those are only
+     * published if watched by name, and are then only delivered to the subscriptions which
+     * named them, see covers().
+     *
+     * Mongods in a sharded cluster cannot hear from the mongoses their subscribers are on, so
+     * they treat every namespace as watched.
+     */
+    class DataEventInterest {
+    public:
+        enum OpType {
+            kInsert = 1 << 0,
+            kUpdate = 1 << 1,
+            kRemove = 1 << 2
+        };
+        static const int kAllOps = kInsert | kUpdate | kRemove;
+
+        // The data events a subscription receives. An empty db watches every database and an
+        // empty collection every collection of db. ops is a mask of OpType.
+        struct Watch {
+            Watch() : ops(0) {}
+
+            std::string db;
+            std::string collection;
+            int ops;
+        };
+
+        // Fills in the watch of a subscription to channel with filter. Returns false if the
+        // subscription receives no data events. Only top-level string equality on the db,
+        // collection and type fields of the filter narrows the watch.
+        static bool watchFor(const std::string& channel, const BSONObj& filter, Watch* out);
+
+        // register and unregister the watch of a subscription on this node
+        static void addLocal(const Watch& watch);
+        static void removeLocal(const Watch& watch);
+
+        // Returns true if watch covers event, a data event on kEventsChannel. Subscriptions
+        // whose watch does not cover an event do not receive it, even if their filter matches.
+        static bool covers(const Watch& watch, const BSONObj& event);
+
+        // Returns true if op on ns is watched. Called on every write, so it only takes a lock
+        // when the watches have changed since the calling thread last checked.
+        static bool watched(const NamespaceString& ns, OpType op);
+
+        // channel data events are published on
+        static const char kEventsChannel[];
+
+        // internal channel the watches of replica set members are announced on
+        static const char kAnnounceChannel[];
+
+        // Runs in a background thread on replica set members. Announces the watches of this
+        // node periodically and expires the watches of members which stopped announcing.
+        static void announceLoop();
+
+        // Applies an announcement received on kAnnounceChannel.
+        static void receiveAnnouncement(const BSONObj& announcement);
+    };
+
+}  // namespace mongo
@@ -0,0 +1,231 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pubsub_data_events.h"
+
+#include <vector>
+
+#include "mongo/db/server_parameters.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/threadlocal.h"
+
+namespace mongo {
+
+    namespace {
+
+        const char kEventsChannel[] = "$events";
+
+        // buffers larger than this are freed once published, so a single large write does
+        // not pin its memory to the thread
+        const int kMaxRetainedBufferBytes = 1024 * 1024;
+
+        void appendEventHeader(BSONObjBuilder& event,
+                               const NamespaceString& ns,
+                               const char* type) {
+            event.append("db", ns.db());
+            event.append("collection", ns.coll());
+            event.append("type", type);
+        }
+
+        enum UpdateFormat {
+            kUpdateFull,
+            kUpdateDelta,
+            kUpdateDeltaAndNew
+        };
+
+        // read on every update, so kept as an UpdateFormat rather than the parameter's string
+        AtomicUInt32 updateFormat(kUpdateFull);
+
+        class DataEventUpdateFormat : public ServerParameter {
+        public:
+            DataEventUpdateFormat()
+                : ServerParameter(ServerParameterSet::getGlobal(), "dataEventUpdateFormat") {}
+
+            virtual void append(BSONObjBuilder& b, const std::string& name) {
+                switch (updateFormat.load()) {
+                case kUpdateDelta:
+                    b.append(name, "delta");
+                    break;
+                case kUpdateDeltaAndNew:
+                    b.append(name, "deltaAndNew");
+                    break;
+                default:
+                    b.append(name, "full");
+                }
+            }
+
+            virtual Status set(const BSONElement& newValueElement) {
+                if (newValueElement.type() != String) {
+                    return Status(ErrorCodes::BadValue,
+                                  "dataEventUpdateFormat must be a string");
+                }
+                return setFromString(newValueElement.String());
+            }
+
+            virtual Status setFromString(const std::string& format) {
+                if (format == "full")
+                    updateFormat.store(kUpdateFull);
+                else if (format == "delta")
+                    updateFormat.store(kUpdateDelta);
+                else if (format == "deltaAndNew")
+                    updateFormat.store(kUpdateDeltaAndNew);
+                else {
+                    return Status(ErrorCodes::BadValue,
+                                  "dataEventUpdateFormat must be one of full, delta or "
+                                  "deltaAndNew");
+                }
+                return Status::OK();
+            }
+        } dataEventUpdateFormat;
+
+    }
+
+    // events recorded by a thread and not yet published. each event is a complete
+    // { db, collection, type, doc } document built in place in buf.
+    struct DataEventBuffer {
+        DataEventBuffer() : buf(4096), pendingUpdateOffset(0), pendingUpdateFormat(0) {}
+
+        BufBuilder buf;
+
+        // offset in buf of each recorded event
+        std::vector<int> offsets;
+
+        // the update event being built between beginUpdate and finishUpdate
+        scoped_ptr<BSONObjBuilder> pendingUpdate;
+        scoped_ptr<BSONObjBuilder> pendingUpdateDoc;
+        int pendingUpdateOffset;
+
+        // the UpdateFormat the pending update was begun with
+        unsigned pendingUpdateFormat;
+
+        void discardPendingUpdate() {
+            if (!pendingUpdate)
+                return;
+            pendingUpdateDoc.reset();
+            pendingUpdate.reset();
+            buf.setlen(pendingUpdateOffset);
+        }
+    };
+
+    TSP_DECLARE(DataEventBuffer, dataEventBuffer)
+    TSP_DEFINE(DataEventBuffer, dataEventBuffer)
+
+    namespace {
+
+        void recordDocument(const NamespaceString& ns, const char* type, const BSONObj& doc) {
+            DataEventBuffer* buffer = dataEventBuffer.getMake();
+            buffer->discardPendingUpdate();
+
+            int offset = buffer->buf.len();
+            BSONObjBuilder event(buffer->buf);
+            appendEventHeader(event, ns, type);
+            event.append("doc", doc);
+            event.done();
+            buffer->offsets.push_back(offset);
+        }
+
+    }
+
+    void DataEvents::recordInsert(const NamespaceString& ns, const BSONObj& doc) {
+        recordDocument(ns, "insert", doc);
+    }
+
+    void DataEvents::recordRemove(const NamespaceString& ns, const BSONObj& doc) {
+        recordDocument(ns, "remove", doc);
+    }
+
+    void DataEvents::beginUpdate(const NamespaceString& ns, const BSONObj& oldDoc) {
+        DataEventBuffer* buffer = dataEventBuffer.getMake();
+        buffer->discardPendingUpdate();
+
+        buffer->pendingUpdateOffset = buffer->buf.len();
+        buffer->pendingUpdate.reset(new BSONObjBuilder(buffer->buf));
+        appendEventHeader(*buffer->pendingUpdate, ns, "update");
+        buffer->pendingUpdateDoc.reset(
+            new BSONObjBuilder(buffer->pendingUpdate->subobjStart("doc")));
+
+        // the format is fixed when the update begins so that a concurrent change of the
+        // parameter cannot mix the two layouts in one event
+        buffer->pendingUpdateFormat = updateFormat.load();
+        if (buffer->pendingUpdateFormat == kUpdateFull)
+            buffer->pendingUpdateDoc->append("old", oldDoc);
+        else if (oldDoc.hasField("_id"))
+            buffer->pendingUpdateDoc->append(oldDoc["_id"]);
+    }
+
+    void DataEvents::finishUpdate(const BSONObj& newDoc, const BSONObj& delta) {
+        DataEventBuffer* buffer = dataEventBuffer.get();
+        if (!buffer || !buffer->pendingUpdate)
+            return;
+
+        if (buffer->pendingUpdateFormat != kUpdateFull)
+            buffer->pendingUpdateDoc->append("delta", delta);
+        if (buffer->pendingUpdateFormat != kUpdateDelta)
+            buffer->pendingUpdateDoc->append("new", newDoc);
+        buffer->pendingUpdateDoc->done();
+        buffer->pendingUpdate->done();
+        buffer->pendingUpdateDoc.reset();
+        buffer->pendingUpdate.reset();
+        buffer->offsets.push_back(buffer->pendingUpdateOffset);
+    }
+
+    void DataEvents::publishRecorded() {
+        DataEventBuffer* buffer = dataEventBuffer.get();
+        if (!buffer || (buffer->offsets.empty() && !buffer->pendingUpdate))
+            return;
+
+        // an update interrupted by an exception is never finished
+        buffer->discardPendingUpdate();
+
+        try {
+            if (!buffer->offsets.empty() && pubsubEnabled) {
+                std::vector<PubSubSendSocket::ChannelMessage> messages;
+                messages.reserve(buffer->offsets.size());
+                for (size_t i = 0; i < buffer->offsets.size(); i++) {
+                    messages.push_back(std::make_pair(
+                        std::string(kEventsChannel),
+                        BSONObj(buffer->buf.buf() + buffer->offsets[i])));
+                }
+
+                bool success = PubSubSendSocket::publish(messages);
+                if (!success)
+                    log() << "Error publishing DB event." << endl;
+            }
+        }
+        catch (const std::exception& e) {
+            // called while unlocking, possibly during stack unwinding, so must not throw
+            log() << "Error publishing DB event." << causedBy(e) << endl;
+        }
+
+        buffer->offsets.clear();
+        buffer->buf.reset(kMaxRetainedBufferBytes);
+    }
+
+}  // namespace mongo
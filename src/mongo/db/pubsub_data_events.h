@@ -0,0 +1,79 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/namespace_string.h"
+#include "mongo/db/pubsub_data_event_interest.h"
+#include "mongo/db/pubsub_sendsock.h"
+
+namespace mongo {
+
+    /**
+     * Database write events, published on the $events channel when publishDataEvents is on.
+     *
+     * Writes happen under the write lock, so rather than publishing, each write records its
+     * event in a buffer owned by the writing thread. The buffer is published once the thread
+     * releases the global lock (see d_concurrency.cpp), which keeps lock hold times the same
+     * whether or not events are published. A document is copied once, into the buffer, while
+     * the lock is held.
+     *
+     * Only writes which some subscriber watches are recorded, see DataEventInterest.
+     */
+    class DataEvents {
+    public:
+        // Returns true if op on ns should be recorded. Writes check this before building
+        // anything for the event.
+        static bool enabled(const NamespaceString& ns, DataEventInterest::OpType op) {
+            return pubsubEnabled && publishDataEvents && DataEventInterest::watched(ns, op);
+        }
+
+        // The documents passed in are copied, so they only need to be valid for the call.
+        static void recordInsert(const NamespaceString& ns, const BSONObj& doc);
+        static void recordRemove(const NamespaceString& ns, const BSONObj& doc);
+
+        // Updates are recorded in two steps because the old document may be modified in
+        // place: beginUpdate must be called before the document is written and finishUpdate
+        // after, with the oplog-style description of the change. An update which is begun but
+        // never finished is discarded.
+        //
+        // The contents of the update event's doc depend on the dataEventUpdateFormat server
+        // parameter:
+        //   full          { old: <old document>, new: <new document> }
+        //   delta         { _id: <_id>, delta: <oplog entry of the update> }
+        //   deltaAndNew   { _id: <_id>, delta: <oplog entry of the update>, new: <new document> }
+        static void beginUpdate(const NamespaceString& ns, const BSONObj& oldDoc);
+        static void finishUpdate(const BSONObj& newDoc, const BSONObj& delta);
+
+        // Publishes and clears the events recorded by this thread. Called by the lock
+        // manager after a thread releases the global lock. Never throws.
+        static void publishRecorded();
+    };
+
+}  // namespace mongo
@@ -0,0 +1,389 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pubsub_durable.h"
+
+#include <boost/thread/condition.hpp>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/db/catalog/collection.h"
+#include "mongo/db/catalog/database.h"
+#include "mongo/db/client.h"
+#include "mongo/db/d_concurrency.h"
+#include "mongo/db/instance.h"
+#include "mongo/db/namespace_string.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    // total size of the messages waiting for the writer to store and route them. past it, a
+    // dispatcher with a message for the writer waits for room. 0 or less is unlimited.
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubDurableQueueBytes, int, 64 * 1024 * 1024);
+
+    namespace {
+
+        const char kDatabase[] = "local";
+        const char kCollectionPrefix[] = "pubsub.";
+        const char kMessageField[] = "msg";
+
+        // for locking around durableChannels and channelsLoaded
+        SimpleMutex durableMutex("durablechannels");
+        std::set<std::string> durableChannels;
+        bool channelsLoaded = false;
+
+        // mirrors durableChannels.size() once channelsLoaded is set, so that messages on
+        // ordinary channels are dispatched without taking durableMutex when there are none
+        AtomicUInt32 numDurableChannels;
+        AtomicUInt32 loaded;
+
+        std::string collectionFor(const std::string& channel) {
+            return std::string(kCollectionPrefix) + channel;
+        }
+
+        std::string nsFor(const std::string& channel) {
+            return std::string(kDatabase) + "." + collectionFor(channel);
+        }
+
+        // finds the durable channels created before this process started
+        void loadChannels() {
+            std::list<std::string> namespaces;
+            {
+                Client::ReadContext ctx(kDatabase);
+                ctx.ctx().db()->namespaceIndex().getNamespaces(namespaces);
+            }
+
+            const std::string prefix = nsFor("");
+            SimpleMutex::scoped_lock lk(durableMutex);
+            if (channelsLoaded)
+                return;
+            for (std::list<std::string>::const_iterator it = namespaces.begin();
+                 it != namespaces.end();
+                 it++) {
+                    if (StringData(*it).startsWith(prefix))
+                        durableChannels.insert(it->substr(prefix.size()));
+            }
+            channelsLoaded = true;
+            numDurableChannels.store(durableChannels.size());
+            loaded.store(1);
+        }
+
+        bool isDurable(const std::string& channel) {
+            if (!loaded.load())
+                loadChannels();
+            if (numDurableChannels.load() == 0)
+                return false;
+            SimpleMutex::scoped_lock lk(durableMutex);
+            return durableChannels.count(channel) > 0;
+        }
+
+        void setDurable(const std::string& channel, bool durable) {
+            SimpleMutex::scoped_lock lk(durableMutex);
+            if (durable)
+                durableChannels.insert(channel);
+            else
+                durableChannels.erase(channel);
+            numDurableChannels.store(durableChannels.size());
+        }
+
+        // for locking around the writer's queue, its size and pendingMessages. writerCondition
+        // is notified when messages are queued, and writerSpace when the writer is done with
+        // some.
+        mongo::mutex writerMutex("durablewriter");
+        boost::condition writerCondition;
+        boost::condition writerSpace;
+        std::deque<shared_ptr<ReceivedMessage> > writerQueue;
+
+        // size of the messages queued or being stored and routed by the writer
+        size_t writerQueueBytes = 0;
+
+        // number of messages on each channel queued or being stored by the writer. later
+        // messages on these channels are queued behind them, even if the channel is no longer
+        // durable, so that they are not routed ahead of them.
+        std::map<std::string, size_t> pendingMessages;
+
+        // mirrors the total of pendingMessages, so that messages are dispatched without
+        // taking writerMutex when there are no durable channels and nothing is queued
+        AtomicUInt32 numPending;
+
+        // whether a dispatcher had to wait for room when the last message was queued, to log
+        // once each time the writer falls behind
+        bool writerOverflowing = false;
+
+        // Stores the messages in [begin, end), all on channel, under one lock and sets their
+        // storedId. Messages which could not be stored keep an unset storedId.
+        void storeMessages(const std::string& channel,
+                           std::vector<shared_ptr<ReceivedMessage> >::const_iterator begin,
+                           std::vector<shared_ptr<ReceivedMessage> >::const_iterator end) {
+            try {
+                if (!isDurable(channel))
+                    return;
+
+                const std::string ns = nsFor(channel);
+                Lock::DBWrite lk(ns);
+                Client::Context ctx(ns);
+                Collection* collection = ctx.db()->getCollection(ns);
+
+                // the collection was dropped, so the channel is no longer durable
+                if (!collection || !collection->isCapped()) {
+                    setDurable(channel, false);
+                    return;
+                }
+
+                for (std::vector<shared_ptr<ReceivedMessage> >::const_iterator it = begin;
+                     it != end;
+                     it++) {
+                        BSONObj message = (*it)->body();
+                        OID id = OID::gen();
+                        BSONObjBuilder b(message.objsize() + 32);
+                        b.append("_id", id);
+                        b.append(kMessageField, message);
+
+                        StatusWith<DiskLoc> status = collection->insertDocument(b.obj(), false);
+                        if (!status.isOK()) {
+                            log() << "Error storing message on durable channel " << channel
+                                  << causedBy(status.getStatus()) << endl;
+                            continue;
+                        }
+                        (*it)->storedId = id;
+                }
+            }
+            catch (const DBException& e) {
+                log() << "Error storing message on durable channel " << channel << causedBy(e)
+                      << endl;
+            }
+        }
+
+        class StoredMessageReader : public DurableChannelReader {
+        public:
+            StoredMessageReader(const std::string& ns, const BSONElement& startAt)
+                : _ns(ns), _checkPosition(false) {
+                if (startAt.type() == jstOID) {
+                    _position = startAt.OID();
+                    _checkPosition = true;
+                    _inclusive = false;
+                }
+                else {
+                    // the smallest _id generated at or after the date
+                    _position.init(startAt.date());
+                    _inclusive = true;
+                }
+            }
+
+            virtual bool readMore(size_t maxMessages, std::vector<BSONObj>* out) {
+                DBDirectClient client;
+
+                // the position is lost if it was overwritten along with messages after it
+                if (_checkPosition) {
+                    BSONObj oldest = client.findOne(_ns, Query().sort(BSON("_id" << 1)));
+                    uassert(18575,
+                            mongoutils::str::stream() << "Messages after " << _position
+                                                      << " are no longer stored in " << _ns,
+                            oldest.isEmpty() ||
+                            oldest["_id"].OID() <= _position ||
+                            !client.findOne(_ns, QUERY("_id" << _position)).isEmpty());
+                }
+
+                Query query(BSON("_id" << BSON((_inclusive ? "$gte" : "$gt") << _position)));
+                query.sort(BSON("_id" << 1));
+
+                // one more than wanted is asked for to find out whether more are stored
+                int limit = maxMessages > 0 ? static_cast<int>(maxMessages) + 1 : 0;
+                auto_ptr<DBClientCursor> cursor = client.query(_ns, query, limit);
+                uassert(18576, mongoutils::str::stream() << "Could not read from " << _ns,
+                        cursor.get());
+
+                size_t numMessages = 0;
+                while (cursor->more()) {
+                    if (maxMessages > 0 && numMessages == maxMessages)
+                        return false;
+
+                    BSONObj message = cursor->nextSafe().getOwned();
+                    _position = message["_id"].OID();
+                    _inclusive = false;
+                    _checkPosition = true;
+                    out->push_back(message);
+                    numMessages++;
+                }
+                return true;
+            }
+
+        private:
+            const std::string _ns;
+
+            // messages are read from the first _id after _position, or at it if _inclusive
+            OID _position;
+            bool _inclusive;
+
+            // set once _position is the _id of a message, which must still be stored
+            bool _checkPosition;
+        };
+
+    }
+
+    void DurableChannels::create(const std::string& channel,
+                                 long long sizeBytes,
+                                 long long maxMessages) {
+        BSONObjBuilder cmd;
+        cmd.append("create", collectionFor(channel));
+        cmd.append("capped", true);
+        cmd.append("size", sizeBytes);
+        if (maxMessages > 0)
+            cmd.append("max", maxMessages);
+        // capped collections in the local database have no _id index unless asked for
+        cmd.append("autoIndexId", true);
+
+        DBDirectClient client;
+        BSONObj info;
+        uassert(18577,
+                mongoutils::str::stream() << "Could not create durable channel " << channel
+                                          << causedBy(info["errmsg"].str()),
+                client.runCommand(kDatabase, cmd.obj(), info));
+
+        if (!loaded.load())
+            loadChannels();
+        setDurable(channel, true);
+    }
+
+    bool DurableChannels::store(const shared_ptr<ReceivedMessage>& received) {
+        const std::string& channel = received->channel;
+
+        // channels starting with $ are reserved and are never durable
+        if ((loaded.load() && numDurableChannels.load() == 0 && numPending.load() == 0) ||
+            StringData(channel).startsWith("$")) {
+            return false;
+        }
+
+        bool durable;
+        try {
+            Client::initThreadIfNotAlready("pubsubDispatcher");
+            durable = isDurable(channel);
+        }
+        catch (const DBException& e) {
+            log() << "Error finding durable channels" << causedBy(e) << endl;
+            return false;
+        }
+
+        mongo::mutex::scoped_lock lk(writerMutex);
+        if (!durable && pendingMessages.count(channel) == 0)
+            return false;
+
+        // rather than queue without bound while inserts are blocked, e.g. by fsyncLock, or
+        // route the message unstored and ahead of those queued on its channel, the
+        // dispatcher waits for room. the other channels of the dispatcher wait with it. a
+        // message larger than the limit is queued once the writer is idle.
+        size_t bytes = received->frame.size();
+        bool waited = false;
+        while (true) {
+            int maxBytes = pubsubDurableQueueBytes;
+            if (maxBytes <= 0 || writerQueueBytes == 0 ||
+                writerQueueBytes + bytes <= size_t(maxBytes)) {
+                break;
+            }
+            if (!writerOverflowing) {
+                log() << "Durable channel writer is " << writerQueueBytes << " bytes behind. "
+                      << "Waiting to queue messages on durable channels until it catches up."
+                      << endl;
+                writerOverflowing = true;
+            }
+            waited = true;
+            writerSpace.wait(lk.boost());
+        }
+        if (!waited)
+            writerOverflowing = false;
+
+        pendingMessages[channel]++;
+        numPending.addAndFetch(1);
+        writerQueue.push_back(received);
+        writerQueueBytes += bytes;
+        writerCondition.notify_one();
+        return true;
+    }
+
+    void DurableChannels::writeMessages() {
+        Client::initThread("pubsubDurableWriter");
+
+        std::vector<shared_ptr<ReceivedMessage> > batch;
+        while (true) {
+            batch.clear();
+            {
+                mongo::mutex::scoped_lock lk(writerMutex);
+                while (writerQueue.empty())
+                    writerCondition.wait(lk.boost());
+                batch.assign(writerQueue.begin(), writerQueue.end());
+                writerQueue.clear();
+            }
+
+            // consecutive messages on the same channel are stored under one lock, and routed
+            // once they are stored. they are routed even if storing them failed.
+            std::vector<shared_ptr<ReceivedMessage> >::const_iterator begin = batch.begin();
+            while (begin != batch.end()) {
+                std::vector<shared_ptr<ReceivedMessage> >::const_iterator end = begin + 1;
+                while (end != batch.end() && (*end)->channel == (*begin)->channel)
+                    end++;
+
+                storeMessages((*begin)->channel, begin, end);
+                for (std::vector<shared_ptr<ReceivedMessage> >::const_iterator it = begin;
+                     it != end;
+                     it++) {
+                        PubSub::routeReceived(*it);
+                }
+                begin = end;
+            }
+
+            // only now may the dispatchers route later messages on these channels themselves,
+            // and queue more in place of these
+            mongo::mutex::scoped_lock lk(writerMutex);
+            for (size_t i = 0; i < batch.size(); i++) {
+                std::map<std::string, size_t>::iterator pending =
+                    pendingMessages.find(batch[i]->channel);
+                if (--pending->second == 0)
+                    pendingMessages.erase(pending);
+                writerQueueBytes -= batch[i]->frame.size();
+            }
+            numPending.subtractAndFetch(batch.size());
+            writerSpace.notify_all();
+        }
+    }
+
+    DurableChannelReader* DurableChannels::openReader(const std::string& channel,
+                                                      const BSONElement& startAt) {
+        uassert(18574, mongoutils::str::stream() << channel << " is not a durable channel",
+                isDurable(channel));
+        return new StoredMessageReader(nsFor(channel), startAt);
+    }
+
+}  // namespace mongo
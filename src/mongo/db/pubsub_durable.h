@@ -0,0 +1,75 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/pubsub.h"
+
+namespace mongo {
+
+    /**
+     * Durable channels keep the messages published on them in a capped collection,
+     * local.pubsub.<channel>, so that a subscriber can start from a past position and read
+     * what it missed before receiving messages as they are published.
+     *
+     * Each mongod stores the messages it receives in its own local database, so a channel is
+     * only durable on the members it was created on. Messages are stored unchanged as
+     * { _id: <ObjectId>, msg: <message> }, the _id being generated in the order they are
+     * received. The _id index is used to resume reading.
+     *
+     * The dispatchers hand messages on durable channels to a single writer thread, so that a
+     * slow or blocked insert does not hold up the routing of other channels. The writer
+     * routes each message once it is stored, which keeps the messages of a channel in order.
+     *
+     * Installed as PubSub::storeDurable and PubSub::openDurableReader by mongod.
+     */
+    class DurableChannels {
+    public:
+        // Creates the capped collection of channel. maxMessages of 0 is unlimited.
+        static void create(const std::string& channel, long long sizeBytes, long long maxMessages);
+
+        // Queues received to be stored and then routed by the writer thread if its channel is
+        // durable, or if earlier messages on its channel are still queued. Waits while more
+        // than pubsubDurableQueueBytes are queued. Returns false if the caller should route
+        // it itself. Never throws.
+        static bool store(const shared_ptr<ReceivedMessage>& received);
+
+        // Runs in a background thread. Stores the queued messages and routes them.
+        static void writeMessages();
+
+        // Returns a reader of the messages stored for channel after startAt, which is either
+        // the ObjectId of the last message already received or the Date to start from.
+        // Throws if channel is not durable.
+        static DurableChannelReader* openReader(const std::string& channel,
+                                                const BSONElement& startAt);
+    };
+
+}  // namespace mongo
@@ -0,0 +1,196 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_envelope.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace mongo {
+
+    namespace {
+
+        const size_t kTimestampBytes = sizeof(unsigned long long);
+
+        void appendLittleEndian(uint32_t value, size_t bytes, std::string* out) {
+            for (size_t i = 0; i < bytes; i++)
+                out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+
+        uint32_t readLittleEndian(const char* data, size_t bytes) {
+            uint32_t value = 0;
+            for (size_t i = 0; i < bytes; i++)
+                value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+            return value;
+        }
+
+        // Adds the hash of field and value to hashes, if value can be used in a hash lookup.
+        // Returns false, with hashes cleared, if there would be too many.
+        bool addFieldHash(const StringData& field,
+                          const BSONElement& value,
+                          std::string* key,
+                          std::vector<uint32_t>* hashes) {
+            key->clear();
+            if (!PubSubEnvelope::valueKey(value, key))
+                return true;
+
+            if (hashes->size() == PubSubEnvelope::kMaxFieldHashes) {
+                hashes->clear();
+                return false;
+            }
+            hashes->push_back(PubSubEnvelope::fieldHash(field, *key));
+            return true;
+        }
+
+    }
+
+    void PubSubEnvelope::computeFieldHashes(const BSONObj& body) {
+        fieldHashes.clear();
+        hasFieldHashes = false;
+
+        std::string key;
+        BSONObjIterator fields(body);
+        while (fields.more()) {
+            BSONElement field = fields.next();
+            if (field.type() != Array) {
+                if (!addFieldHash(field.fieldNameStringData(), field, &key, &fieldHashes))
+                    return;
+                continue;
+            }
+
+            // a filter on a field holding an array matches any of its elements
+            BSONObjIterator elements(field.embeddedObject());
+            while (elements.more()) {
+                if (!addFieldHash(field.fieldNameStringData(), elements.next(), &key,
+                                  &fieldHashes))
+                    return;
+            }
+        }
+
+        std::sort(fieldHashes.begin(), fieldHashes.end());
+        fieldHashes.erase(std::unique(fieldHashes.begin(), fieldHashes.end()),
+                          fieldHashes.end());
+        hasFieldHashes = true;
+    }
+
+    bool PubSubEnvelope::hasFieldHash(uint32_t hash) const {
+        return std::binary_search(fieldHashes.begin(), fieldHashes.end(), hash);
+    }
+
+    void PubSubEnvelope::encode(std::string* out) const {
+        out->clear();
+        out->append(reinterpret_cast<const char*>(&timestamp), kTimestampBytes);
+        out->push_back(kVersion);
+        out->push_back(hasFieldHashes ? kHasFieldHashes : 0);
+        if (hasFieldHashes) {
+            appendLittleEndian(fieldHashes.size(), 2, out);
+            for (size_t i = 0; i < fieldHashes.size(); i++)
+                appendLittleEndian(fieldHashes[i], 4, out);
+        }
+    }
+
+    bool PubSubEnvelope::decode(const char* data, size_t size, PubSubEnvelope* out) {
+        if (size < kTimestampBytes)
+            return false;
+
+        memcpy(&out->timestamp, data, kTimestampBytes);
+        out->hasFieldHashes = false;
+        out->fieldHashes.clear();
+
+        // version and flags
+        if (size < kTimestampBytes + 2 || data[kTimestampBytes] < 1)
+            return true;
+        char flags = data[kTimestampBytes + 1];
+        const char* cur = data + kTimestampBytes + 2;
+        const char* end = data + size;
+
+        if (flags & kHasFieldHashes) {
+            if (end - cur < 2)
+                return true;
+            size_t numHashes = readLittleEndian(cur, 2);
+            cur += 2;
+            if (static_cast<size_t>(end - cur) < numHashes * 4)
+                return true;
+
+            out->fieldHashes.reserve(numHashes);
+            for (size_t i = 0; i < numHashes; i++, cur += 4)
+                out->fieldHashes.push_back(readLittleEndian(cur, 4));
+            out->hasFieldHashes = true;
+        }
+
+        return true;
+    }
+
+    bool PubSubEnvelope::valueKey(const BSONElement& e, std::string* out) {
+        out->push_back(static_cast<char>(e.canonicalType()));
+
+        switch (e.type()) {
+        case NumberDouble:
+        case NumberInt:
+        case NumberLong: {
+            // all numbers compare by value, so encode them as a double. distinct longs which
+            // round to the same double only cost an extra evaluation of the full filter.
+            double d = e.numberDouble();
+            if (d == 0)
+                d = 0; // -0.0 == 0.0
+            else if (d != d)
+                d = std::numeric_limits<double>::quiet_NaN();
+            out->append(reinterpret_cast<const char*>(&d), sizeof(d));
+            return true;
+        }
+        case String:
+        case Symbol:
+            out->append(e.valuestr(), e.valuestrsize() - 1);
+            return true;
+        case Bool:
+            out->push_back(e.boolean() ? 1 : 0);
+            return true;
+        case jstOID:
+        case Date:
+        case Timestamp:
+            out->append(e.value(), e.valuesize());
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    uint32_t PubSubEnvelope::fieldHash(const StringData& field, const StringData& valueKey) {
+        // 32 bit FNV-1a over the field name, its terminating NUL and the value key. the hash
+        // must be the same on every node, and a collision only costs evaluating a filter.
+        uint32_t hash = 2166136261U;
+        for (size_t i = 0; i < field.size(); i++)
+            hash = (hash ^ static_cast<unsigned char>(field[i])) * 16777619U;
+        hash = (hash ^ 0) * 16777619U;
+        for (size_t i = 0; i < valueKey.size(); i++)
+            hash = (hash ^ static_cast<unsigned char>(valueKey[i])) * 16777619U;
+        return hash;
+    }
+
+}  // namespace mongo
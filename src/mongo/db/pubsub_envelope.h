@@ -0,0 +1,97 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mongo/base/string_data.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    /**
+     * Header sent with every pubsub message between nodes, after the channel and body frames.
+     * It is built once by the publishing node, and relayed unchanged by config servers and
+     * mongoses, so that receivers can route a message without reading its body.
+     *
+     * Wire format, version 1:
+     *   timestamp: 8 bytes, the publish time in microseconds
+     *   version: 1 byte
+     *   flags: 1 byte, kHasFieldHashes
+     *   numFieldHashes: 2 bytes, little endian, present if kHasFieldHashes
+     *   fieldHashes: 4 bytes each, little endian, ascending
+     *
+     * Version 0 envelopes are the bare 8 byte timestamp sent by older nodes, which also read
+     * only the first 8 bytes of newer envelopes. Later versions only append fields, and
+     * readers ignore any bytes they do not know.
+     */
+    class PubSubEnvelope {
+    public:
+        static const char kVersion = 1;
+
+        // set if fieldHashes holds the hash of every top level field of the body and every
+        // value of that field which can be used in a hash lookup, see valueKey
+        static const char kHasFieldHashes = 0x01;
+
+        // bodies with more hashes than this are sent without any
+        static const size_t kMaxFieldHashes = 64;
+
+        PubSubEnvelope() : timestamp(0), hasFieldHashes(false) {}
+
+        // Sets fieldHashes from body. Array fields contribute one hash per element.
+        void computeFieldHashes(const BSONObj& body);
+
+        // Returns true if hash is in fieldHashes.
+        bool hasFieldHash(uint32_t hash) const;
+
+        void encode(std::string* out) const;
+
+        // Returns false if data is too short to hold a timestamp. Anything after the
+        // timestamp which cannot be read is ignored.
+        static bool decode(const char* data, size_t size, PubSubEnvelope* out);
+
+        /**
+         * Encodes the value of e such that values which compare equal in a match expression
+         * (e.g. 1, 1.0 and NumberLong(1)) have the same encoding. Returns false if values of
+         * e's type are not supported for hash lookups.
+         */
+        static bool valueKey(const BSONElement& e, std::string* out);
+
+        // Hash of a top level field and the valueKey of its value.
+        static uint32_t fieldHash(const StringData& field, const StringData& valueKey);
+
+        unsigned long long timestamp;
+
+        bool hasFieldHashes;
+        std::vector<uint32_t> fieldHashes;
+    };
+
+}  // namespace mongo
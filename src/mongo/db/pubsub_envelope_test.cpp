@@ -0,0 +1,145 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_envelope.h"
+
+#include "mongo/db/json.h"
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+
+    namespace {
+
+        uint32_t hashOf(const StringData& field, const BSONObj& holder) {
+            std::string key;
+            ASSERT_TRUE(PubSubEnvelope::valueKey(holder.firstElement(), &key));
+            return PubSubEnvelope::fieldHash(field, key);
+        }
+
+        PubSubEnvelope roundTrip(const PubSubEnvelope& envelope) {
+            std::string encoded;
+            envelope.encode(&encoded);
+            PubSubEnvelope decoded;
+            ASSERT_TRUE(PubSubEnvelope::decode(encoded.data(), encoded.size(), &decoded));
+            return decoded;
+        }
+
+    }
+
+    TEST(PubSubEnvelopeTest, EqualValuesHaveEqualKeys) {
+        ASSERT_EQUALS(hashOf("a", BSON("" << 1)), hashOf("a", BSON("" << 1.0)));
+        ASSERT_EQUALS(hashOf("a", BSON("" << 1)), hashOf("a", BSON("" << 1LL)));
+        ASSERT_EQUALS(hashOf("a", BSON("" << 0.0)), hashOf("a", BSON("" << -0.0)));
+        ASSERT_NOT_EQUALS(hashOf("a", BSON("" << 1)), hashOf("a", BSON("" << "1")));
+        ASSERT_NOT_EQUALS(hashOf("a", BSON("" << 1)), hashOf("b", BSON("" << 1)));
+        ASSERT_NOT_EQUALS(hashOf("ab", BSON("" << "c")), hashOf("a", BSON("" << "bc")));
+
+        std::string key;
+        ASSERT_FALSE(PubSubEnvelope::valueKey(BSON("" << BSON("a" << 1)).firstElement(), &key));
+        key.clear();
+        ASSERT_FALSE(PubSubEnvelope::valueKey(BSON("" << BSONNULL).firstElement(), &key));
+    }
+
+    TEST(PubSubEnvelopeTest, FieldHashes) {
+        PubSubEnvelope envelope;
+        envelope.computeFieldHashes(fromjson("{a: 1, b: 'x', c: {d: 1}, e: [2, 'y', [3]]}"));
+        ASSERT_TRUE(envelope.hasFieldHashes);
+        ASSERT_EQUALS(4U, envelope.fieldHashes.size());
+        ASSERT_TRUE(envelope.hasFieldHash(hashOf("a", BSON("" << 1.0))));
+        ASSERT_TRUE(envelope.hasFieldHash(hashOf("b", BSON("" << "x"))));
+        ASSERT_TRUE(envelope.hasFieldHash(hashOf("e", BSON("" << 2))));
+        ASSERT_TRUE(envelope.hasFieldHash(hashOf("e", BSON("" << "y"))));
+        ASSERT_FALSE(envelope.hasFieldHash(hashOf("e", BSON("" << 3))));
+        ASSERT_FALSE(envelope.hasFieldHash(hashOf("d", BSON("" << 1))));
+    }
+
+    TEST(PubSubEnvelopeTest, TooManyFieldHashes) {
+        BSONObjBuilder b;
+        for (size_t i = 0; i <= PubSubEnvelope::kMaxFieldHashes; i++)
+            b.append(BSONObjBuilder::numStr(i), static_cast<int>(i));
+
+        PubSubEnvelope envelope;
+        envelope.computeFieldHashes(b.obj());
+        ASSERT_FALSE(envelope.hasFieldHashes);
+        ASSERT_TRUE(envelope.fieldHashes.empty());
+    }
+
+    TEST(PubSubEnvelopeTest, RoundTrip) {
+        PubSubEnvelope envelope;
+        envelope.timestamp = 1234567890123ULL;
+        envelope.computeFieldHashes(fromjson("{a: 1, b: 'x'}"));
+
+        PubSubEnvelope decoded = roundTrip(envelope);
+        ASSERT_EQUALS(envelope.timestamp, decoded.timestamp);
+        ASSERT_TRUE(decoded.hasFieldHashes);
+        ASSERT_TRUE(envelope.fieldHashes == decoded.fieldHashes);
+
+        envelope.computeFieldHashes(BSONObj());
+        envelope.hasFieldHashes = false;
+        decoded = roundTrip(envelope);
+        ASSERT_EQUALS(envelope.timestamp, decoded.timestamp);
+        ASSERT_FALSE(decoded.hasFieldHashes);
+    }
+
+    TEST(PubSubEnvelopeTest, DecodesTimestampOnly) {
+        // the format sent by nodes without envelopes
+        unsigned long long timestamp = 42;
+        PubSubEnvelope decoded;
+        ASSERT_TRUE(PubSubEnvelope::decode(reinterpret_cast<const char*>(&timestamp),
+                                           sizeof(timestamp),
+                                           &decoded));
+        ASSERT_EQUALS(42ULL, decoded.timestamp);
+        ASSERT_FALSE(decoded.hasFieldHashes);
+
+        ASSERT_FALSE(PubSubEnvelope::decode(reinterpret_cast<const char*>(&timestamp),
+                                            sizeof(timestamp) - 1,
+                                            &decoded));
+    }
+
+    TEST(PubSubEnvelopeTest, IgnoresTruncatedAndUnknownFields) {
+        PubSubEnvelope envelope;
+        envelope.timestamp = 7;
+        envelope.computeFieldHashes(fromjson("{a: 1, b: 2}"));
+        std::string encoded;
+        envelope.encode(&encoded);
+
+        // hashes cut short are dropped rather than misread
+        PubSubEnvelope decoded;
+        ASSERT_TRUE(PubSubEnvelope::decode(encoded.data(), encoded.size() - 1, &decoded));
+        ASSERT_EQUALS(7ULL, decoded.timestamp);
+        ASSERT_FALSE(decoded.hasFieldHashes);
+
+        // fields appended by a later version are skipped
+        encoded[sizeof(unsigned long long)] = PubSubEnvelope::kVersion + 1;
+        encoded.append("later");
+        ASSERT_TRUE(PubSubEnvelope::decode(encoded.data(), encoded.size(), &decoded));
+        ASSERT_TRUE(decoded.hasFieldHashes);
+        ASSERT_TRUE(envelope.fieldHashes == decoded.fieldHashes);
+    }
+
+}  // namespace mongo
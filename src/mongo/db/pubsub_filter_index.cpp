@@ -0,0 +1,120 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pubsub_filter_index.h"
+
+#include "mongo/db/matcher/expression_leaf.h"
+#include "mongo/db/matcher/expression_parser.h"
+#include "mongo/db/query/canonical_query.h"
+
+namespace mongo {
+
+    namespace {
+
+        // paths with a numeric component can refer to an array position, which
+        // BSONObj::getFieldsDotted does not resolve the same way the matcher does
+        bool isIndexablePath(const StringData& path) {
+            if (path.empty())
+                return false;
+
+            size_t start = 0;
+            while (start <= path.size()) {
+                size_t end = path.find('.', start);
+                if (end == string::npos)
+                    end = path.size();
+
+                StringData part = path.substr(start, end - start);
+                if (part.empty())
+                    return false;
+
+                bool allDigits = true;
+                for (size_t i = 0; i < part.size() && allDigits; i++)
+                    allDigits = isdigit(part[i]);
+                if (allDigits)
+                    return false;
+
+                start = end + 1;
+            }
+            return true;
+        }
+
+    }
+
+    PubSubFilter::PubSubFilter(const BSONObj& filter) : _filter(filter.getOwned()) {
+        StatusWithMatchExpression result = MatchExpressionParser::parse(_filter);
+        uassert(18593,
+                mongoutils::str::stream() << "bad query: " << result.toString(),
+                result.isOK());
+
+        // same normalization as a CanonicalQuery, so equivalent filters share a key
+        MatchExpression* root = CanonicalQuery::normalizeTree(result.getValue());
+        CanonicalQuery::sortTree(root);
+        _expression.reset(root);
+
+        _key = _expression->toString();
+        initIndexedEquality(_expression.get());
+    }
+
+    bool PubSubFilter::matches(const BSONObj& message) const {
+        return _expression->matchesBSON(message);
+    }
+
+    bool PubSubFilter::equivalent(const PubSubFilter& other) const {
+        return _expression->equivalent(other._expression.get());
+    }
+
+    void PubSubFilter::initIndexedEquality(const MatchExpression* root) {
+        std::vector<const MatchExpression*> clauses;
+        if (root->matchType() == MatchExpression::AND) {
+            for (size_t i = 0; i < root->numChildren(); i++)
+                clauses.push_back(root->getChild(i));
+        }
+        else {
+            clauses.push_back(root);
+        }
+
+        for (size_t i = 0; i < clauses.size(); i++) {
+            if (clauses[i]->matchType() != MatchExpression::EQ)
+                continue;
+
+            const EqualityMatchExpression* eq =
+                static_cast<const EqualityMatchExpression*>(clauses[i]);
+            std::string value;
+            if (!isIndexablePath(eq->path()) ||
+                !PubSubEnvelope::valueKey(eq->getData(), &value))
+                continue;
+
+            _equalityPath = eq->path().toString();
+            _equalityValue = value;
+            return;
+        }
+    }
+
+}  // namespace mongo
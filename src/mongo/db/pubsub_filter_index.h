@@ -0,0 +1,364 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/matcher/expression.h"
+#include "mongo/db/pubsub_envelope.h"
+#include "mongo/platform/unordered_map.h"
+
+namespace mongo {
+
+    /**
+     * A subscription filter in canonical form. The filter is parsed and then normalized and
+     * sorted the same way CanonicalQuery does for queries, so logically identical filters
+     * such as {a: 1, b: 2} and {b: 2, a: 1} have the same key() and can share evaluation.
+     * The key is not exact, so filters with the same key are only shared once equivalent()
+     * confirms them.
+     *
+     * If the filter requires a field to equal a scalar value, either on its own or as one
+     * clause of a top level $and, that equality is exposed so the filter can be found through
+     * a hash lookup on the value of the field in a message instead of being evaluated.
+     */
+    class PubSubFilter : boost::noncopyable {
+    public:
+        // uasserts if the filter cannot be parsed
+        explicit PubSubFilter(const BSONObj& filter);
+
+        bool matches(const BSONObj& message) const;
+
+        // string form of the normalized expression, equal for equivalent filters. may also
+        // be equal for filters which are not, since numbers are printed rounded, so that
+        // {a: 0.1} and {a: 0.10000000000000002} have the same key.
+        const std::string& key() const { return _key; }
+
+        // true if the normalized expressions are the same, comparing values exactly
+        bool equivalent(const PubSubFilter& other) const;
+
+        // true if the filter has an equality predicate usable for a hash lookup
+        bool hasIndexedEquality() const { return !_equalityPath.empty(); }
+        const std::string& equalityPath() const { return _equalityPath; }
+        // the required value encoded by PubSubEnvelope::valueKey
+        const std::string& equalityValue() const { return _equalityValue; }
+
+    private:
+        void initIndexedEquality(const MatchExpression* root);
+
+        BSONObj _filter;
+
+        // points into _filter
+        boost::scoped_ptr<MatchExpression> _expression;
+
+        std::string _key;
+
+        // empty if the filter has no indexed equality predicate
+        std::string _equalityPath;
+        std::string _equalityValue;
+    };
+
+    /**
+     * Index over the filters of the subscriptions on one channel. Values with identical
+     * canonical filters are grouped so each distinct filter is evaluated at most once per
+     * message. Groups with an equality predicate are found through a per-field hash table
+     * keyed on the required value, so a message only visits the groups whose equality
+     * predicate it satisfies rather than scanning every filter on the channel.
+     *
+     * Not thread safe. T must be copyable and equality comparable.
+     */
+    template <typename T>
+    class FilterIndex : boost::noncopyable {
+    public:
+        FilterIndex() : _numFilters(0), _size(0) {}
+
+        /**
+         * Adds value to the index. A NULL filter matches every message.
+         */
+        void add(const boost::shared_ptr<PubSubFilter>& filter, const T& value) {
+            _size++;
+
+            if (!filter) {
+                _unfiltered.push_back(value);
+                return;
+            }
+
+            GroupList& groups = _groups[filter->key()];
+            typename GroupList::iterator groupIt = findGroup(&groups, *filter);
+            if (groupIt == groups.end()) {
+                groupIt = groups.insert(groups.end(), FilterGroup());
+                _numFilters++;
+                FilterGroup* group = &*groupIt;
+                group->filter = filter;
+
+                if (filter->hasIndexedEquality()) {
+                    _equalityTables[filter->equalityPath()][filter->equalityValue()]
+                        .push_back(group);
+                    if (isTopLevel(filter->equalityPath()))
+                        _fieldHashGroups[fieldHash(*filter)].push_back(group);
+                }
+                else {
+                    _scanGroups.push_back(group);
+                }
+            }
+
+            groupIt->values.push_back(value);
+        }
+
+        /**
+         * Removes one instance of value added with an equivalent filter.
+         * Returns false if it was not found.
+         */
+        bool remove(const PubSubFilter* filter, const T& value) {
+            if (!filter) {
+                if (!eraseOne(&_unfiltered, value))
+                    return false;
+                _size--;
+                return true;
+            }
+
+            typename GroupMap::iterator keyIt = _groups.find(filter->key());
+            if (keyIt == _groups.end())
+                return false;
+            typename GroupList::iterator groupIt = findGroup(&keyIt->second, *filter);
+            if (groupIt == keyIt->second.end())
+                return false;
+
+            FilterGroup* group = &*groupIt;
+            if (!eraseOne(&group->values, value))
+                return false;
+            _size--;
+
+            if (!group->values.empty())
+                return true;
+
+            // last value with this filter, so drop the group from the lookup structures
+            if (filter->hasIndexedEquality()) {
+                typename EqualityTables::iterator tableIt =
+                    _equalityTables.find(filter->equalityPath());
+                ValueTable& table = tableIt->second;
+                typename ValueTable::iterator valueIt = table.find(filter->equalityValue());
+                eraseOne(&valueIt->second, group);
+                if (valueIt->second.empty())
+                    table.erase(valueIt);
+                if (table.empty())
+                    _equalityTables.erase(tableIt);
+
+                if (isTopLevel(filter->equalityPath())) {
+                    typename FieldHashGroups::iterator hashIt =
+                        _fieldHashGroups.find(fieldHash(*filter));
+                    eraseOne(&hashIt->second, group);
+                    if (hashIt->second.empty())
+                        _fieldHashGroups.erase(hashIt);
+                }
+            }
+            else {
+                eraseOne(&_scanGroups, group);
+            }
+
+            keyIt->second.erase(groupIt);
+            if (keyIt->second.empty())
+                _groups.erase(keyIt);
+            _numFilters--;
+            return true;
+        }
+
+        /**
+         * Appends every value whose filter matches message to out. If given, numEvaluated and
+         * numRejected are incremented by the number of filters evaluated and of those which
+         * did not match.
+         *
+         * If envelope has the message's field hashes, groups requiring a top level field to
+         * equal a value are found from the hashes rather than by reading the message.
+         */
+        void findMatches(const BSONObj& message,
+                         std::vector<T>* out,
+                         size_t* numEvaluated = NULL,
+                         size_t* numRejected = NULL,
+                         const PubSubEnvelope* envelope = NULL) const {
+            out->insert(out->end(), _unfiltered.begin(), _unfiltered.end());
+
+            bool useFieldHashes = envelope && envelope->hasFieldHashes;
+
+            // equality groups: one hash lookup per value of each indexed field in the message.
+            // the group's full filter is still evaluated since it may have other clauses, and
+            // a hash collision only adds a candidate which that evaluation rejects.
+            std::vector<const FilterGroup*> candidates;
+            if (useFieldHashes && !_fieldHashGroups.empty()) {
+                for (size_t i = 0; i < envelope->fieldHashes.size(); i++) {
+                    typename FieldHashGroups::const_iterator hashIt =
+                        _fieldHashGroups.find(envelope->fieldHashes[i]);
+                    if (hashIt != _fieldHashGroups.end()) {
+                        candidates.insert(candidates.end(),
+                                          hashIt->second.begin(),
+                                          hashIt->second.end());
+                    }
+                }
+            }
+
+            for (typename EqualityTables::const_iterator tableIt = _equalityTables.begin();
+                 tableIt != _equalityTables.end();
+                 tableIt++) {
+                    if (useFieldHashes && isTopLevel(tableIt->first))
+                        continue;
+
+                    BSONElementSet elements;
+                    message.getFieldsDotted(tableIt->first, elements);
+
+                    std::string valueKey;
+                    for (BSONElementSet::const_iterator it = elements.begin();
+                         it != elements.end();
+                         it++) {
+                            valueKey.clear();
+                            if (!PubSubEnvelope::valueKey(*it, &valueKey))
+                                continue;
+
+                            typename ValueTable::const_iterator valueIt =
+                                tableIt->second.find(valueKey);
+                            if (valueIt != tableIt->second.end()) {
+                                candidates.insert(candidates.end(),
+                                                  valueIt->second.begin(),
+                                                  valueIt->second.end());
+                            }
+                    }
+            }
+
+            // several values of an array field may lead to the same group
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                             candidates.end());
+
+            size_t rejected = 0;
+            for (size_t i = 0; i < candidates.size(); i++) {
+                if (candidates[i]->filter->matches(message)) {
+                    out->insert(out->end(),
+                                candidates[i]->values.begin(),
+                                candidates[i]->values.end());
+                }
+                else {
+                    rejected++;
+                }
+            }
+
+            // everything else is evaluated once per distinct filter
+            for (size_t i = 0; i < _scanGroups.size(); i++) {
+                if (_scanGroups[i]->filter->matches(message)) {
+                    out->insert(out->end(),
+                                _scanGroups[i]->values.begin(),
+                                _scanGroups[i]->values.end());
+                }
+                else {
+                    rejected++;
+                }
+            }
+
+            if (numEvaluated)
+                *numEvaluated += candidates.size() + _scanGroups.size();
+            if (numRejected)
+                *numRejected += rejected;
+        }
+
+        // number of values in the index
+        size_t size() const { return _size; }
+
+        bool empty() const { return _size == 0; }
+
+        // number of distinct filters in the index
+        size_t numFilters() const { return _numFilters; }
+
+    private:
+        struct FilterGroup {
+            boost::shared_ptr<PubSubFilter> filter;
+            std::vector<T> values;
+        };
+
+        static bool isTopLevel(const std::string& path) {
+            return path.find('.') == std::string::npos;
+        }
+
+        static uint32_t fieldHash(const PubSubFilter& filter) {
+            return PubSubEnvelope::fieldHash(filter.equalityPath(), filter.equalityValue());
+        }
+
+        template <typename V>
+        static bool eraseOne(std::vector<V>* values, const V& value) {
+            typename std::vector<V>::iterator it =
+                std::find(values->begin(), values->end(), value);
+            if (it == values->end())
+                return false;
+            values->erase(it);
+            return true;
+        }
+
+        // groups keyed on the canonical filter key, several if filters which are not
+        // equivalent share a key. list nodes are stable, so the lookup structures below point
+        // into them.
+        typedef std::list<FilterGroup> GroupList;
+        typedef std::map<std::string, GroupList> GroupMap;
+        GroupMap _groups;
+        size_t _numFilters;
+
+        // the group in groups whose filter is equivalent to filter, or groups->end()
+        static typename GroupList::iterator findGroup(GroupList* groups,
+                                                      const PubSubFilter& filter) {
+            typename GroupList::iterator it = groups->begin();
+            while (it != groups->end() && !it->filter->equivalent(filter))
+                it++;
+            return it;
+        }
+
+        // field path -> encoded required value -> groups requiring that value
+        typedef unordered_map<std::string, std::vector<FilterGroup*> > ValueTable;
+        typedef std::map<std::string, ValueTable> EqualityTables;
+        EqualityTables _equalityTables;
+
+        // PubSubEnvelope::fieldHash of a top level field path and required value -> groups
+        // requiring that value. these groups are also in _equalityTables, which is used for
+        // messages without field hashes.
+        typedef unordered_map<uint32_t, std::vector<FilterGroup*> > FieldHashGroups;
+        FieldHashGroups _fieldHashGroups;
+
+        // groups without an indexed equality predicate
+        std::vector<FilterGroup*> _scanGroups;
+
+        // values without a filter
+        std::vector<T> _unfiltered;
+
+        size_t _size;
+    };
+
+}  // namespace mongo
@@ -0,0 +1,285 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_filter_index.h"
+
+#include <algorithm>
+
+#include "mongo/db/json.h"
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+
+    namespace {
+
+        boost::shared_ptr<PubSubFilter> filter(const char* json) {
+            return boost::shared_ptr<PubSubFilter>(new PubSubFilter(fromjson(json)));
+        }
+
+        std::vector<int> find(const FilterIndex<int>& index, const char* json) {
+            std::vector<int> out;
+            index.findMatches(fromjson(json), &out);
+            std::sort(out.begin(), out.end());
+            return out;
+        }
+
+    }
+
+    TEST(PubSubFilterTest, EquivalentFiltersShareKey) {
+        ASSERT_EQUALS(filter("{a: 1, b: 2}")->key(), filter("{b: 2, a: 1}")->key());
+        ASSERT_EQUALS(filter("{a: 1}")->key(), filter("{$and: [{a: 1}]}")->key());
+        ASSERT_NOT_EQUALS(filter("{a: 1}")->key(), filter("{a: 2}")->key());
+        ASSERT_NOT_EQUALS(filter("{a: 1}")->key(), filter("{b: 1}")->key());
+    }
+
+    TEST(PubSubFilterTest, IndexedEquality) {
+        ASSERT_TRUE(filter("{a: 1}")->hasIndexedEquality());
+        ASSERT_EQUALS("a", filter("{a: 1}")->equalityPath());
+        ASSERT_TRUE(filter("{'a.b': 'x', c: {$gt: 1}}")->hasIndexedEquality());
+        ASSERT_EQUALS("a.b", filter("{'a.b': 'x', c: {$gt: 1}}")->equalityPath());
+
+        ASSERT_FALSE(filter("{a: {$gt: 1}}")->hasIndexedEquality());
+        ASSERT_FALSE(filter("{a: null}")->hasIndexedEquality());
+        ASSERT_FALSE(filter("{a: {b: 1}}")->hasIndexedEquality());
+        ASSERT_FALSE(filter("{'a.0': 1}")->hasIndexedEquality());
+        ASSERT_FALSE(filter("{$or: [{a: 1}, {b: 1}]}")->hasIndexedEquality());
+    }
+
+    TEST(PubSubFilterTest, NumericEqualityKeys) {
+        ASSERT_EQUALS(filter("{a: 1}")->equalityValue(),
+                      filter("{a: 1.0}")->equalityValue());
+        ASSERT_EQUALS(filter("{a: 1}")->equalityValue(),
+                      filter("{a: NumberLong(1)}")->equalityValue());
+        ASSERT_NOT_EQUALS(filter("{a: 1}")->equalityValue(),
+                          filter("{a: '1'}")->equalityValue());
+    }
+
+    TEST(PubSubFilterTest, BadFilter) {
+        ASSERT_THROWS(PubSubFilter(fromjson("{a: {$bad: 1}}")), UserException);
+    }
+
+    TEST(FilterIndexTest, Unfiltered) {
+        FilterIndex<int> index;
+        index.add(boost::shared_ptr<PubSubFilter>(), 1);
+        ASSERT_EQUALS(1U, find(index, "{}").size());
+        ASSERT_EQUALS(1U, find(index, "{a: 1}").size());
+        ASSERT_TRUE(index.remove(NULL, 1));
+        ASSERT_TRUE(index.empty());
+    }
+
+    TEST(FilterIndexTest, IdenticalFiltersAreGrouped) {
+        FilterIndex<int> index;
+        index.add(filter("{a: 1, b: {$gt: 0}}"), 1);
+        index.add(filter("{b: {$gt: 0}, a: 1}"), 2);
+        index.add(filter("{b: {$gt: 0}}"), 3);
+        index.add(filter("{b: {$gt: 0}}"), 4);
+        ASSERT_EQUALS(4U, index.size());
+        ASSERT_EQUALS(2U, index.numFilters());
+
+        std::vector<int> out = find(index, "{a: 1, b: 1}");
+        ASSERT_EQUALS(4U, out.size());
+
+        out = find(index, "{a: 2, b: 1}");
+        ASSERT_EQUALS(2U, out.size());
+        ASSERT_EQUALS(3, out[0]);
+        ASSERT_EQUALS(4, out[1]);
+
+        ASSERT_TRUE(find(index, "{a: 1, b: 0}").empty());
+    }
+
+    TEST(FilterIndexTest, EqualityLookup) {
+        FilterIndex<int> index;
+        for (int i = 0; i < 100; i++) {
+            index.add(filter(std::string(mongoutils::str::stream() << "{user: " << i << "}")
+                             .c_str()),
+                      i);
+        }
+        ASSERT_EQUALS(100U, index.numFilters());
+
+        std::vector<int> out = find(index, "{user: 42}");
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(42, out[0]);
+
+        // numbers of different types compare equal
+        out = find(index, "{user: 42.0}");
+        ASSERT_EQUALS(1U, out.size());
+        out = find(index, "{user: NumberLong(42)}");
+        ASSERT_EQUALS(1U, out.size());
+
+        ASSERT_TRUE(find(index, "{user: '42'}").empty());
+        ASSERT_TRUE(find(index, "{user: 100}").empty());
+        ASSERT_TRUE(find(index, "{other: 42}").empty());
+    }
+
+    TEST(FilterIndexTest, EqualityLookupOnArraysAndSubdocuments) {
+        FilterIndex<int> index;
+        index.add(filter("{tags: 'a'}"), 1);
+        index.add(filter("{tags: 'b'}"), 2);
+        index.add(filter("{'x.y': 5}"), 3);
+
+        std::vector<int> out = find(index, "{tags: ['a', 'b', 'c']}");
+        ASSERT_EQUALS(2U, out.size());
+        ASSERT_EQUALS(1, out[0]);
+        ASSERT_EQUALS(2, out[1]);
+
+        out = find(index, "{x: [{y: 4}, {y: 5}]}");
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(3, out[0]);
+
+        out = find(index, "{x: {y: [5, 6]}}");
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(3, out[0]);
+    }
+
+    TEST(FilterIndexTest, EqualityWithOtherClauses) {
+        FilterIndex<int> index;
+        index.add(filter("{a: 1, b: {$gt: 5}}"), 1);
+        index.add(filter("{a: 1}"), 2);
+
+        std::vector<int> out = find(index, "{a: 1, b: 6}");
+        ASSERT_EQUALS(2U, out.size());
+
+        out = find(index, "{a: 1, b: 4}");
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(2, out[0]);
+    }
+
+    TEST(FilterIndexTest, Remove) {
+        FilterIndex<int> index;
+        boost::shared_ptr<PubSubFilter> eq = filter("{a: 1}");
+        boost::shared_ptr<PubSubFilter> range = filter("{a: {$gt: 1}}");
+        index.add(eq, 1);
+        index.add(eq, 2);
+        index.add(range, 3);
+
+        ASSERT_FALSE(index.remove(eq.get(), 3));
+        ASSERT_FALSE(index.remove(filter("{b: 1}").get(), 1));
+
+        ASSERT_TRUE(index.remove(eq.get(), 1));
+        ASSERT_EQUALS(1U, find(index, "{a: 1}").size());
+        ASSERT_EQUALS(2U, index.numFilters());
+
+        // an equivalent filter object removes from the same group
+        ASSERT_TRUE(index.remove(filter("{a: 1}").get(), 2));
+        ASSERT_TRUE(find(index, "{a: 1}").empty());
+        ASSERT_EQUALS(1U, index.numFilters());
+
+        ASSERT_TRUE(index.remove(range.get(), 3));
+        ASSERT_TRUE(index.empty());
+        ASSERT_EQUALS(0U, index.numFilters());
+        ASSERT_TRUE(find(index, "{a: 2}").empty());
+    }
+
+    TEST(FilterIndexTest, FiltersWithSameKeyAreNotGroupedUnlessEquivalent) {
+        // the key prints doubles rounded, so these share a key though they differ
+        boost::shared_ptr<PubSubFilter> lower = filter("{a: {$gt: 0.1}}");
+        boost::shared_ptr<PubSubFilter> higher = filter("{a: {$gt: 0.10000000000000002}}");
+        ASSERT_EQUALS(lower->key(), higher->key());
+        ASSERT_FALSE(lower->equivalent(*higher));
+
+        FilterIndex<int> index;
+        index.add(lower, 1);
+        index.add(higher, 2);
+        index.add(filter("{a: 0.1}"), 3);
+        index.add(filter("{a: 0.10000000000000002}"), 4);
+        ASSERT_EQUALS(4U, index.numFilters());
+
+        std::vector<int> out = find(index, "{a: 0.10000000000000002}");
+        ASSERT_EQUALS(2U, out.size());
+        ASSERT_EQUALS(1, out[0]);
+        ASSERT_EQUALS(4, out[1]);
+
+        ASSERT_FALSE(index.remove(filter("{a: {$gt: 0.10000000000000004}}").get(), 2));
+        ASSERT_TRUE(index.remove(filter("{a: {$gt: 0.10000000000000002}}").get(), 2));
+        ASSERT_EQUALS(3U, index.numFilters());
+        out = find(index, "{a: 0.2}");
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(1, out[0]);
+    }
+
+    TEST(FilterIndexTest, CountsEvaluations) {
+        FilterIndex<int> index;
+        index.add(boost::shared_ptr<PubSubFilter>(), 1);
+        index.add(filter("{a: 1, b: 1}"), 2);
+        index.add(filter("{a: 2}"), 3);
+        index.add(filter("{b: {$gt: 0}}"), 4);
+
+        // unfiltered values are not evaluated, and equality groups only when their value
+        // is present in the message
+        size_t evaluated = 0;
+        size_t rejected = 0;
+        std::vector<int> out;
+        index.findMatches(fromjson("{a: 1, b: 0}"), &out, &evaluated, &rejected);
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(2U, evaluated);
+        ASSERT_EQUALS(2U, rejected);
+
+        index.findMatches(fromjson("{a: 2, b: 1}"), &out, &evaluated, &rejected);
+        ASSERT_EQUALS(4U, out.size());
+        ASSERT_EQUALS(4U, evaluated);
+        ASSERT_EQUALS(2U, rejected);
+    }
+
+    TEST(FilterIndexTest, UsesFieldHashes) {
+        FilterIndex<int> index;
+        index.add(filter("{a: 1}"), 1);
+        index.add(filter("{a: 2, b: 'x'}"), 2);
+        index.add(filter("{'c.d': 3}"), 3);
+
+        BSONObj message = fromjson("{a: [1, 2], b: 'x', c: {d: 3}}");
+        PubSubEnvelope envelope;
+        envelope.computeFieldHashes(message);
+
+        std::vector<int> out;
+        index.findMatches(message, &out, NULL, NULL, &envelope);
+        std::sort(out.begin(), out.end());
+        ASSERT_EQUALS(3U, out.size());
+
+        // top level equality groups are found from the hashes alone, so a message whose
+        // envelope lacks them is not matched against those groups. dotted paths still read
+        // the message.
+        PubSubEnvelope other;
+        other.computeFieldHashes(fromjson("{a: 3}"));
+        out.clear();
+        index.findMatches(message, &out, NULL, NULL, &other);
+        ASSERT_EQUALS(1U, out.size());
+        ASSERT_EQUALS(3, out[0]);
+
+        // without hashes the message is read
+        other.hasFieldHashes = false;
+        out.clear();
+        index.findMatches(message, &out, NULL, NULL, &other);
+        ASSERT_EQUALS(3U, out.size());
+
+        ASSERT_TRUE(index.remove(filter("{a: 1}").get(), 1));
+        out.clear();
+        index.findMatches(message, &out, NULL, NULL, &envelope);
+        ASSERT_EQUALS(2U, out.size());
+    }
+
+}  // namespace mongo
@@ -0,0 +1,91 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include "mongo/platform/atomic_word.h"
+
+namespace mongo {
+
+    /**
+     * Unbounded multi-producer, single-consumer queue which never blocks. Elements are
+     * linked through their own "T* next" member, so pushing does not allocate. Producers
+     * push onto a lock-free stack with a compare and swap, and the consumer takes the whole
+     * stack at once with a single swap and reverses it, so a drain costs one atomic
+     * operation however many elements it returns.
+     *
+     * Any number of threads may call push. Only one thread at a time may call popAll. There
+     * is no ABA problem because elements are only ever removed all at once.
+     */
+    template <typename T>
+    class MPSCQueue : boost::noncopyable {
+    public:
+        MPSCQueue() : _head(NULL) {}
+
+        /**
+         * Appends element. The queue does not take ownership. Returns true if the queue was
+         * empty, so producers can wake up a consumer that sleeps on an empty queue.
+         */
+        bool push(T* element) {
+            T* head = _head.load();
+            while (true) {
+                element->next = head;
+                T* actual = _head.compareAndSwap(head, element);
+                if (actual == head)
+                    return head == NULL;
+                head = actual;
+            }
+        }
+
+        /**
+         * Removes every element in the queue and returns the oldest, or NULL if the queue
+         * was empty. The rest follow it through next, in push order.
+         */
+        T* popAll() {
+            T* head = _head.swap(NULL);
+            T* oldest = NULL;
+            while (head != NULL) {
+                T* next = head->next;
+                head->next = oldest;
+                oldest = head;
+                head = next;
+            }
+            return oldest;
+        }
+
+        bool empty() const {
+            return _head.load() == NULL;
+        }
+
+    private:
+        AtomicWord<T*> _head;
+    };
+
+}  // namespace mongo
@@ -0,0 +1,116 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_mpsc_queue.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+
+    namespace {
+
+        struct Element {
+            Element(int _producer, int _value) : producer(_producer), value(_value), next(NULL) {}
+
+            int producer;
+            int value;
+            Element* next;
+        };
+
+        void produce(MPSCQueue<Element>* queue, int producer, int count) {
+            for (int i = 0; i < count; i++)
+                queue->push(new Element(producer, i));
+        }
+
+    }
+
+    TEST(MPSCQueueTest, Empty) {
+        MPSCQueue<Element> queue;
+        ASSERT_TRUE(queue.empty());
+        ASSERT_TRUE(queue.popAll() == NULL);
+    }
+
+    TEST(MPSCQueueTest, PopAllInPushOrder) {
+        MPSCQueue<Element> queue;
+        std::vector<Element> elements;
+        for (int i = 0; i < 10; i++)
+            elements.push_back(Element(0, i));
+
+        ASSERT_TRUE(queue.push(&elements[0]));
+        for (int i = 1; i < 10; i++)
+            ASSERT_FALSE(queue.push(&elements[i]));
+        ASSERT_FALSE(queue.empty());
+
+        Element* e = queue.popAll();
+        for (int i = 0; i < 10; i++) {
+            ASSERT_TRUE(e == &elements[i]);
+            e = e->next;
+        }
+        ASSERT_TRUE(e == NULL);
+        ASSERT_TRUE(queue.empty());
+
+        // the queue reports being empty again once drained
+        ASSERT_TRUE(queue.push(&elements[0]));
+    }
+
+    TEST(MPSCQueueTest, ConcurrentProducers) {
+        const int kProducers = 8;
+        const int kCount = 10000;
+
+        MPSCQueue<Element> queue;
+        std::vector<boost::thread*> producers;
+        for (int i = 0; i < kProducers; i++)
+            producers.push_back(new boost::thread(boost::bind(produce, &queue, i, kCount)));
+
+        // each producer's elements arrive in the order it pushed them, and none are lost
+        std::vector<int> next(kProducers, 0);
+        int received = 0;
+        while (received < kProducers * kCount) {
+            Element* e = queue.popAll();
+            while (e != NULL) {
+                ASSERT_EQUALS(next[e->producer], e->value);
+                next[e->producer]++;
+                received++;
+                Element* done = e;
+                e = e->next;
+                delete done;
+            }
+        }
+
+        for (int i = 0; i < kProducers; i++) {
+            producers[i]->join();
+            delete producers[i];
+        }
+        ASSERT_TRUE(queue.empty());
+    }
+
+}  // namespace mongo
@@ -0,0 +1,162 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mongo {
+
+    /**
+     * Keeps the most recent messages received on every channel, up to a total size, so that
+     * messages whose delivery to a client was lost can be delivered again. Once the total size
+     * is exceeded, the oldest messages across all channels are evicted first.
+     *
+     * Messages are numbered as they are added, by a sequence number which increases by one
+     * with each message on their channel. Only the channels with messages held are kept, so
+     * that their number does not grow with every channel ever seen. A channel whose messages
+     * were all evicted restarts numbering after the highest number given on any channel
+     * forgotten so far, so its numbers keep increasing and the messages lost with it are
+     * reported as missing by find.
+     *
+     * Not thread safe.
+     */
+    template <typename T>
+    class ReplayBuffer : boost::noncopyable {
+    public:
+        explicit ReplayBuffer(size_t maxBytes)
+            : _maxBytes(maxBytes), _bytes(0), _forgottenThrough(0) {}
+
+        /**
+         * Adds value, the next message on channel, and returns its sequence number.
+         */
+        unsigned long long add(const std::string& channel, size_t bytes, const T& value) {
+            typename ChannelMap::iterator it = _channels.find(channel);
+            if (it == _channels.end()) {
+                it = _channels.insert(std::make_pair(channel, Channel())).first;
+                it->second.lastSeq = _forgottenThrough;
+            }
+            unsigned long long seq = ++it->second.lastSeq;
+            it->second.messages.push_back(Message(seq, bytes, value));
+            _arrivals.push_back(it);
+            _bytes += bytes;
+            evict();
+            return seq;
+        }
+
+        /**
+         * Appends the messages on channel numbered after afterSeq and up to lastSeq to out,
+         * in order. Returns the highest sequence number in that range which is not held,
+         * because it was evicted or never added, or afterSeq if all are held.
+         */
+        unsigned long long find(const std::string& channel,
+                                unsigned long long afterSeq,
+                                unsigned long long lastSeq,
+                                std::vector<T>* out) const {
+            typename ChannelMap::const_iterator it = _channels.find(channel);
+            if (it == _channels.end())
+                return std::max(afterSeq, lastSeq);
+
+            // the messages held on a channel have consecutive sequence numbers, so the ones
+            // missing from the range are those before the first held, and the first message
+            // wanted is found by offset
+            const std::deque<Message>& messages = it->second.messages;
+            unsigned long long firstSeq = messages.front().seq;
+            unsigned long long missingThrough = std::min(firstSeq - 1, lastSeq);
+            size_t i = afterSeq >= firstSeq ? afterSeq + 1 - firstSeq : 0;
+            for (; i < messages.size() && messages[i].seq <= lastSeq; i++)
+                out->push_back(messages[i].value);
+
+            return std::max(afterSeq, missingThrough);
+        }
+
+        void setMaxBytes(size_t maxBytes) {
+            _maxBytes = maxBytes;
+            evict();
+        }
+
+        size_t bytes() const { return _bytes; }
+
+        // number of channels with messages held
+        size_t numChannels() const { return _channels.size(); }
+
+    private:
+        struct Message {
+            Message(unsigned long long _seq, size_t _bytes, const T& _value)
+                : seq(_seq), bytes(_bytes), value(_value) {}
+
+            unsigned long long seq;
+            size_t bytes;
+            T value;
+        };
+
+        struct Channel {
+            // number of the last message added on the channel
+            unsigned long long lastSeq;
+            std::deque<Message> messages;
+        };
+
+        // a channel is erased along with its last message, which is also its last entry in
+        // _arrivals, so iterators to it stay valid while they are used
+        typedef std::map<std::string, Channel> ChannelMap;
+
+        void evict() {
+            while (_bytes > _maxBytes && !_arrivals.empty()) {
+                typename ChannelMap::iterator it = _arrivals.front();
+                std::deque<Message>& messages = it->second.messages;
+                _arrivals.pop_front();
+
+                // messages on a channel arrive in the same order as across channels, so the
+                // oldest message overall is the oldest on its channel
+                _bytes -= messages.front().bytes;
+                messages.pop_front();
+
+                if (messages.empty()) {
+                    _forgottenThrough = std::max(_forgottenThrough, it->second.lastSeq);
+                    _channels.erase(it);
+                }
+            }
+        }
+
+        size_t _maxBytes;
+        size_t _bytes;
+        ChannelMap _channels;
+
+        // the channel of every message held, oldest first
+        std::deque<typename ChannelMap::iterator> _arrivals;
+
+        // highest sequence number of the channels erased so far
+        unsigned long long _forgottenThrough;
+    };
+
+}  // namespace mongo
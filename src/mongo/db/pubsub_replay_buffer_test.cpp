@@ -0,0 +1,152 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_replay_buffer.h"
+
+#include <string>
+#include <vector>
+
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+
+    TEST(ReplayBufferTest, FindsRange) {
+        ReplayBuffer<int> buffer(1000);
+        for (int i = 1; i <= 10; i++)
+            ASSERT_EQUALS(buffer.add("a", 1, i), static_cast<unsigned long long>(i));
+
+        std::vector<int> found;
+        ASSERT_EQUALS(buffer.find("a", 3, 6, &found), 3ULL);
+        ASSERT_EQUALS(found.size(), 3U);
+        for (int i = 0; i < 3; i++)
+            ASSERT_EQUALS(found[i], 4 + i);
+
+        found.clear();
+        ASSERT_EQUALS(buffer.find("a", 10, 10, &found), 10ULL);
+        ASSERT_TRUE(found.empty());
+
+        found.clear();
+        ASSERT_EQUALS(buffer.find("b", 0, 5, &found), 5ULL);
+        ASSERT_TRUE(found.empty());
+    }
+
+    TEST(ReplayBufferTest, EvictsOldestAcrossChannels) {
+        ReplayBuffer<int> buffer(4);
+        ASSERT_EQUALS(buffer.add("a", 1, 1), 1ULL);
+        ASSERT_EQUALS(buffer.add("b", 1, 2), 1ULL);
+        ASSERT_EQUALS(buffer.add("a", 1, 3), 2ULL);
+        ASSERT_EQUALS(buffer.add("b", 1, 4), 2ULL);
+        ASSERT_EQUALS(buffer.bytes(), 4U);
+
+        // evicts a:1 then b:1
+        ASSERT_EQUALS(buffer.add("a", 2, 5), 3ULL);
+        ASSERT_EQUALS(buffer.bytes(), 4U);
+
+        std::vector<int> found;
+        ASSERT_EQUALS(buffer.find("a", 0, 3, &found), 1ULL);
+        ASSERT_EQUALS(found.size(), 2U);
+        ASSERT_EQUALS(found[0], 3);
+        ASSERT_EQUALS(found[1], 5);
+
+        found.clear();
+        ASSERT_EQUALS(buffer.find("b", 0, 2, &found), 1ULL);
+        ASSERT_EQUALS(found.size(), 1U);
+        ASSERT_EQUALS(found[0], 4);
+
+        // a range entirely after the evicted messages has no gap
+        found.clear();
+        ASSERT_EQUALS(buffer.find("b", 1, 2, &found), 1ULL);
+        ASSERT_EQUALS(found.size(), 1U);
+    }
+
+    TEST(ReplayBufferTest, ShrinkingEvicts) {
+        ReplayBuffer<int> buffer(100);
+        for (int i = 1; i <= 10; i++)
+            buffer.add("a", 10, i);
+        ASSERT_EQUALS(buffer.bytes(), 100U);
+
+        buffer.setMaxBytes(30);
+        ASSERT_EQUALS(buffer.bytes(), 30U);
+
+        std::vector<int> found;
+        ASSERT_EQUALS(buffer.find("a", 0, 10, &found), 7ULL);
+        ASSERT_EQUALS(found.size(), 3U);
+        ASSERT_EQUALS(found[0], 8);
+
+        // gaps are reported up to lastSeq only
+        found.clear();
+        ASSERT_EQUALS(buffer.find("a", 0, 5, &found), 5ULL);
+        ASSERT_TRUE(found.empty());
+    }
+
+    TEST(ReplayBufferTest, ForgetsEmptyChannels) {
+        ReplayBuffer<int> buffer(2);
+        for (int i = 0; i < 100; i++)
+            buffer.add(std::string(1, 'a' + i % 26) + static_cast<char>('0' + i / 26), 1, i);
+        ASSERT_EQUALS(buffer.numChannels(), 2U);
+
+        buffer.setMaxBytes(0);
+        ASSERT_EQUALS(buffer.bytes(), 0U);
+        ASSERT_EQUALS(buffer.numChannels(), 0U);
+    }
+
+    TEST(ReplayBufferTest, ForgottenChannelRestartsAfterAGap) {
+        ReplayBuffer<int> buffer(100);
+        for (int i = 1; i <= 5; i++)
+            buffer.add("a", 10, i);
+        buffer.add("b", 10, 6);
+
+        // a is forgotten once its messages are evicted, and restarts numbering after every
+        // number it was given, so a client which had seen up to 3 learns of the lost ones
+        buffer.setMaxBytes(10);
+        ASSERT_EQUALS(buffer.numChannels(), 1U);
+        buffer.setMaxBytes(100);
+        unsigned long long seq = buffer.add("a", 10, 7);
+        ASSERT_GREATER_THAN(seq, 5ULL);
+
+        std::vector<int> found;
+        ASSERT_EQUALS(buffer.find("a", 3, seq, &found), seq - 1);
+        ASSERT_EQUALS(found.size(), 1U);
+        ASSERT_EQUALS(found[0], 7);
+
+        // b was not forgotten, so keeps counting from its own last number
+        ASSERT_EQUALS(buffer.add("b", 10, 8), 2ULL);
+    }
+
+    TEST(ReplayBufferTest, NumbersIncreaseWhenNothingIsKept) {
+        ReplayBuffer<int> buffer(0);
+        unsigned long long last = 0;
+        for (int i = 0; i < 10; i++) {
+            unsigned long long seq = buffer.add(i % 2 ? "a" : "b", 1, i);
+            ASSERT_GREATER_THAN(seq, last);
+            last = seq;
+        }
+        ASSERT_EQUALS(buffer.numChannels(), 0U);
+    }
+
+}  // namespace mongo
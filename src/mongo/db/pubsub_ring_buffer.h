@@ -0,0 +1,135 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    /**
+     * Bounded FIFO queue stored in a contiguous array. Storage starts small and doubles as
+     * needed up to maxSize elements, after which pushing a new element overwrites the oldest
+     * one. Elements are kept in insertion order and can be read by index, so draining the
+     * buffer is a single linear pass with no reordering.
+     *
+     * Not thread safe. T must be default constructible and copyable. Slots that are popped
+     * or cleared are reset to T() so they do not keep references alive.
+     */
+    template <typename T>
+    class RingBuffer {
+    public:
+        explicit RingBuffer(size_t maxSize) : _maxSize(maxSize), _head(0), _size(0) {
+            verify(maxSize > 0);
+        }
+
+        /**
+         * Appends value. Returns false if the buffer was full and the oldest element was
+         * dropped to make room for it.
+         */
+        bool push_back(const T& value) {
+            if (_size == _slots.size() && _size < _maxSize)
+                grow();
+
+            if (_size == _slots.size()) {
+                // full: the slot of the oldest element becomes the slot of the newest
+                _slots[_head] = value;
+                _head = next(_head);
+                return false;
+            }
+
+            _slots[index(_size)] = value;
+            _size++;
+            return true;
+        }
+
+        void pop_front() {
+            dassert(_size > 0);
+            _slots[_head] = T();
+            _head = next(_head);
+            _size--;
+        }
+
+        const T& front() const { return at(0); }
+
+        // i-th oldest element
+        const T& at(size_t i) const {
+            dassert(i < _size);
+            return _slots[index(i)];
+        }
+
+        void clear() {
+            for (size_t i = 0; i < _size; i++)
+                _slots[index(i)] = T();
+            _head = 0;
+            _size = 0;
+        }
+
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+        bool full() const { return _size == _maxSize; }
+        size_t maxSize() const { return _maxSize; }
+
+        // number of allocated slots
+        size_t capacity() const { return _slots.size(); }
+
+    private:
+        size_t index(size_t i) const {
+            size_t pos = _head + i;
+            return pos < _slots.size() ? pos : pos - _slots.size();
+        }
+
+        size_t next(size_t pos) const {
+            return pos + 1 < _slots.size() ? pos + 1 : 0;
+        }
+
+        // reallocates the slots with the elements in order starting at slot 0
+        void grow() {
+            size_t newCapacity = _slots.empty() ? 8 : _slots.size() * 2;
+            if (newCapacity > _maxSize)
+                newCapacity = _maxSize;
+
+            std::vector<T> slots(newCapacity);
+            for (size_t i = 0; i < _size; i++)
+                slots[i] = _slots[index(i)];
+
+            _slots.swap(slots);
+            _head = 0;
+        }
+
+        std::vector<T> _slots;
+        size_t _maxSize;
+
+        // slot of the oldest element
+        size_t _head;
+        size_t _size;
+    };
+
+}  // namespace mongo
@@ -0,0 +1,132 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_ring_buffer.h"
+
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+
+    namespace {
+
+        std::vector<int> contents(const RingBuffer<int>& buffer) {
+            std::vector<int> out;
+            for (size_t i = 0; i < buffer.size(); i++)
+                out.push_back(buffer.at(i));
+            return out;
+        }
+
+    }
+
+    TEST(RingBufferTest, Empty) {
+        RingBuffer<int> buffer(4);
+        ASSERT_TRUE(buffer.empty());
+        ASSERT_FALSE(buffer.full());
+        ASSERT_EQUALS(0U, buffer.size());
+        ASSERT_EQUALS(0U, buffer.capacity());
+        ASSERT_EQUALS(4U, buffer.maxSize());
+    }
+
+    TEST(RingBufferTest, PushAndPopInOrder) {
+        RingBuffer<int> buffer(100);
+        for (int i = 0; i < 50; i++)
+            ASSERT_TRUE(buffer.push_back(i));
+        ASSERT_EQUALS(50U, buffer.size());
+
+        for (int i = 0; i < 50; i++) {
+            ASSERT_EQUALS(i, buffer.front());
+            buffer.pop_front();
+        }
+        ASSERT_TRUE(buffer.empty());
+    }
+
+    TEST(RingBufferTest, GrowsUpToMaxSize) {
+        RingBuffer<int> buffer(20);
+        ASSERT_TRUE(buffer.push_back(0));
+        ASSERT_EQUALS(8U, buffer.capacity());
+
+        for (int i = 1; i < 9; i++)
+            ASSERT_TRUE(buffer.push_back(i));
+        ASSERT_EQUALS(16U, buffer.capacity());
+
+        for (int i = 9; i < 20; i++)
+            ASSERT_TRUE(buffer.push_back(i));
+        ASSERT_EQUALS(20U, buffer.capacity());
+        ASSERT_TRUE(buffer.full());
+    }
+
+    TEST(RingBufferTest, GrowAfterWrapKeepsOrder) {
+        RingBuffer<int> buffer(32);
+        for (int i = 0; i < 8; i++)
+            buffer.push_back(i);
+        for (int i = 0; i < 5; i++)
+            buffer.pop_front();
+        for (int i = 8; i < 13; i++)
+            buffer.push_back(i);
+        ASSERT_EQUALS(8U, buffer.capacity());
+
+        // the elements wrap around the end of the slots when the buffer grows
+        buffer.push_back(13);
+        ASSERT_EQUALS(16U, buffer.capacity());
+
+        std::vector<int> out = contents(buffer);
+        ASSERT_EQUALS(9U, out.size());
+        for (size_t i = 0; i < out.size(); i++)
+            ASSERT_EQUALS(static_cast<int>(i) + 5, out[i]);
+    }
+
+    TEST(RingBufferTest, FullOverwritesOldest) {
+        RingBuffer<int> buffer(3);
+        ASSERT_TRUE(buffer.push_back(1));
+        ASSERT_TRUE(buffer.push_back(2));
+        ASSERT_TRUE(buffer.push_back(3));
+        ASSERT_FALSE(buffer.push_back(4));
+        ASSERT_FALSE(buffer.push_back(5));
+
+        std::vector<int> out = contents(buffer);
+        ASSERT_EQUALS(3U, out.size());
+        ASSERT_EQUALS(3, out[0]);
+        ASSERT_EQUALS(4, out[1]);
+        ASSERT_EQUALS(5, out[2]);
+    }
+
+    TEST(RingBufferTest, Clear) {
+        RingBuffer<int> buffer(8);
+        for (int i = 0; i < 6; i++)
+            buffer.push_back(i);
+        buffer.pop_front();
+        buffer.clear();
+        ASSERT_TRUE(buffer.empty());
+        ASSERT_EQUALS(8U, buffer.capacity());
+
+        buffer.push_back(7);
+        ASSERT_EQUALS(1U, buffer.size());
+        ASSERT_EQUALS(7, buffer.front());
+    }
+
+}  // namespace mongo
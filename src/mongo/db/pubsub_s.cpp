@@ -35,6 +35,7 @@
 #include "mongo/db/pubsub.h"
 #include "mongo/db/pubsub_sendsock.h"
 #include "mongo/s/mongos_options.h"
+#include "mongo/s/pubsub_mongos_peers.h"
 
 namespace mongo {
 
@@ -58,33 +59,29 @@ namespace mongo {
 
             try {
 
-                HostAndPort maxConfigHP;
-                maxConfigHP.setPort(0);
+                // listen (subscribe) to all mongoses and shards in the cluster, which
+                // connect to this endpoint once they find this mongos in config.mongos
+                const int port = serverGlobalParams.port;
+                const std::string kExtSubEndpoint = str::stream() << "tcp://*:" << port + 1234;
+                PubSub::extRecvSocket->bind(kExtSubEndpoint.c_str());
 
-                // connect to MAX PORT config server
-                // TODO: hook into config server when mongos is added/removed like with repl sets
+                // connect to own sub socket to publish messages to self
+                const std::string kExtPubEndpoint = str::stream() << "tcp://localhost:"
+                                                                  << port + 1234;
+                PubSubSendSocket::extSendSocket->connect(kExtPubEndpoint.c_str());
+                PubSubSendSocket::mongosPeerSocket = PubSubSendSocket::extSendSocket;
+
+                // also receive what the config servers publish or relay
                 std::vector<std::string> configServers = mongosGlobalParams.configdbs;
                 for (std::vector<std::string>::iterator it = configServers.begin();
                      it != configServers.end();
                      it++) {
                         HostAndPort configHP = HostAndPort(*it);
-                        if (configHP.port() > maxConfigHP.port())
-                            maxConfigHP = configHP;
-
                         HostAndPort configPubEndpoint = HostAndPort(configHP.host(),
                                                                     configHP.port() + 2345);
                         PubSub::extRecvSocket->connect(("tcp://" +
                                                          configPubEndpoint.toString()).c_str());
                 }
-
-                HostAndPort configPullEndpoint = HostAndPort(maxConfigHP.host(),
-                                                             maxConfigHP.port() + 1234);
-
-                PubSubSendSocket::extSendSocket->connect(("tcp://" +
-                                                 configPullEndpoint.toString()).c_str());
-
-                // publishes to client subscribe sockets
-                PubSub::intPubSocket.bind(PubSub::kIntPubSubEndpoint);
             }
             catch (zmq::error_t& e) {
                 log() << "Error initializing PubSub sockets. Turning off PubSub..."
@@ -94,12 +91,23 @@ namespace mongo {
                 return;
             }
 
-            // proxy incoming messages to internal publisher to be received by clients
-            boost::thread internalProxy(PubSub::proxy,
-                                        PubSub::extRecvSocket,
-                                        &PubSub::intPubSocket);
+            // send published messages from a single thread which owns the send sockets
+            boost::thread messageSender(PubSubSendSocket::sendMessages);
+
+            // publish to the other mongoses as they come and go
+            boost::thread mongosPeers(refreshPubSubMongosPeers);
+
+            // route received messages to subscription inboxes
+            PubSub::startDispatchers();
+
+            // serve getMore and killCursors on subscription cursors
+            pubsubGetMore = PubSub::getMore;
+            pubsubKillCursor = PubSub::killCursor;
+
+            // remove the subscriptions bound to a client connection when it closes
+            pubsubConnectionClosed = PubSub::connectionClosed;
 
-            // clean up subscriptions that have been inactive for at least 10 minutes
+            // remove subscriptions that have not been polled for their idle timeout
             boost::thread subscriptionCleanup(PubSub::subscriptionCleanup);
 
         }
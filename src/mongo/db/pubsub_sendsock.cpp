@@ -32,9 +32,12 @@
 
 #include <zmq.hpp>
 
+#include "mongo/db/jsobj.h"
+#include "mongo/db/pubsub_envelope.h"
 #include "mongo/db/server_options_helpers.h"
+#include "mongo/db/pubsub_stats.h"
 #include "mongo/db/server_parameters.h"
-#include "mongo/util/stringutils.h"
+#include "mongo/util/compress.h"
 
 namespace mongo {
 
@@ -43,77 +46,313 @@ namespace mongo {
     bool pubsubEnabled = true;
     MONGO_EXPORT_SERVER_PARAMETER(publishDataEvents, bool, false);
 
+    // Server Parameters for compressing message bodies of at least pubsubCompressionThreshold
+    // bytes with snappy before they are sent to other nodes
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubCompression, bool, false);
+    MONGO_EXPORT_SERVER_PARAMETER(pubsubCompressionThreshold, int, 1024);
+
+    QueryResult* (*pubsubGetMore)(long long cursorId, int ntoreturn) = NULL;
+    bool (*pubsubKillCursor)(long long cursorId) = NULL;
+    void (*pubsubConnectionClosed)(long long connectionId) = NULL;
+
     SimpleMutex PubSubSendSocket::sendMutex("zmqsend");
 
     zmq::context_t PubSubSendSocket::zmqContext(1);
     zmq::socket_t* PubSubSendSocket::extSendSocket = NULL;
     zmq::socket_t* PubSubSendSocket::dbEventSocket = NULL;
+    zmq::socket_t* PubSubSendSocket::mongosPeerSocket = NULL;
     std::map<HostAndPort, bool> PubSubSendSocket::rsMembers;
+    std::set<HostAndPort> PubSubSendSocket::mongosPeers;
+
+    PubSubLinkStats PubSubSendSocket::sendStats;
+    PubSubLinkStats PubSubSendSocket::dbEventStats;
+    PubSubLinkStats PubSubSendSocket::receiveStats;
+
+    void PubSubLinkStats::record(size_t bodyBytes, size_t sentBytes, bool compressed) {
+        messages.addAndFetch(1);
+        bytes.addAndFetch(bodyBytes);
+        wireBytes.addAndFetch(sentBytes);
+        if (compressed)
+            compressedMessages.addAndFetch(1);
+    }
+
+    void PubSubLinkStats::append(BSONObjBuilder* builder) const {
+        builder->append("messages", static_cast<long long>(messages.load()));
+        builder->append("compressedMessages", static_cast<long long>(compressedMessages.load()));
+        builder->append("bytes", static_cast<long long>(bytes.load()));
+        builder->append("wireBytes", static_cast<long long>(wireBytes.load()));
+    }
+
+    MPSCQueue<PubSubSendSocket::OutgoingMessage> PubSubSendSocket::sendQueue;
+    mongo::mutex PubSubSendSocket::sendQueueMutex("zmqsendqueue");
+    boost::condition PubSubSendSocket::sendQueueNotify;
 
     bool PubSubSendSocket::publish(const std::string& channel, const BSONObj& message) {
         uassert(18560, "PubSub should be enabled on all calls to publish!", pubsubEnabled);
 
-        unsigned long long timestamp = curTimeMicros64();
         try {
-            // zmq sockets are not thread-safe
-            SimpleMutex::scoped_lock lk(sendMutex);
-
-            // dbEventSocket is non-null iff mongod is in a sharded environment
-            // workaround to compile on mongos without including d_logic.cpp
-            if (!serverGlobalParams.configsvr &&
-                dbEventSocket != NULL &&
-                channel == "$events" &&
-                publishDataEvents) {
-                    // only publish database events to config servers
-                    dbEventSocket->send(channel.c_str(), channel.size() + 1, ZMQ_SNDMORE);
-                    dbEventSocket->send(message.objdata(), message.objsize(), ZMQ_SNDMORE);
-                    dbEventSocket->send(&timestamp, sizeof(timestamp));
-            }
-
-            // publications and writes to config servers are published normally
-            extSendSocket->send(channel.c_str(), channel.size() + 1, ZMQ_SNDMORE);
-            extSendSocket->send(message.objdata(), message.objsize(), ZMQ_SNDMORE);
-            extSendSocket->send(&timestamp, sizeof(timestamp));
+            queueMessage(channel, message, curTimeMicros64());
         }
         catch (zmq::error_t& e) {
             // can't uassert here - this method is used for database events.
             // don't want a db event command to fail because pubsub doesn't work
-            log() << "ZeroMQ failed to publish to pub socket." << causedBy(e);
+            log() << "ZeroMQ failed to queue message for publishing." << causedBy(e);
             return false;
         }
 
         return true;
     }
 
-    void PubSubSendSocket::initSharding(const std::string configServers) {
-        if (!pubsubEnabled)
+    bool PubSubSendSocket::publish(const std::vector<ChannelMessage>& messages) {
+        uassert(18595, "PubSub should be enabled on all calls to publish!", pubsubEnabled);
+
+        // messages in the batch get consecutive timestamps so that they keep their order
+        // when subscriptions drop their oldest messages
+        unsigned long long timestamp = curTimeMicros64();
+        try {
+            for (std::vector<ChannelMessage>::const_iterator it = messages.begin();
+                 it != messages.end();
+                 it++) {
+                    queueMessage(it->first, it->second, timestamp++);
+            }
+        }
+        catch (zmq::error_t& e) {
+            log() << "ZeroMQ failed to queue message for publishing." << causedBy(e);
+            return false;
+        }
+
+        return true;
+    }
+
+    void PubSubSendSocket::queueMessage(const std::string& channel,
+                                        const BSONObj& message,
+                                        unsigned long long timestamp) {
+        OutgoingMessage* outgoing = new OutgoingMessage();
+        try {
+            outgoing->channel = channel;
+            outgoing->body.rebuild(message.objsize());
+            memcpy(outgoing->body.data(), message.objdata(), message.objsize());
+
+            PubSubEnvelope envelope;
+            envelope.timestamp = timestamp;
+            envelope.computeFieldHashes(message);
+            envelope.encode(&outgoing->envelope);
+        }
+        catch (...) {
+            delete outgoing;
+            throw;
+        }
+
+        PubSubStats::add(PubSubStats::kPublished, 1);
+        PubSubStats::add(PubSubStats::kPublishedBytes, message.objsize());
+
+        if (sendQueue.push(outgoing)) {
+            // the sender thread may be waiting on an empty queue
+            mongo::mutex::scoped_lock lk(sendQueueMutex);
+            sendQueueNotify.notify_one();
+        }
+    }
+
+    void PubSubSendSocket::sendMessages() {
+        while (true) {
+            OutgoingMessage* batch = sendQueue.popAll();
+            if (batch == NULL) {
+                mongo::mutex::scoped_lock lk(sendQueueMutex);
+                while (sendQueue.empty())
+                    sendQueueNotify.wait(lk.boost());
+                continue;
+            }
+
+            // zmq sockets are not thread-safe. the frames of the whole batch are queued back
+            // to back, so zmq sends them in as few writes as it can.
+            SimpleMutex::scoped_lock lk(sendMutex);
+            while (batch != NULL) {
+                OutgoingMessage* next = batch->next;
+                try {
+                    sendMessage(batch);
+                }
+                catch (zmq::error_t& e) {
+                    log() << "ZeroMQ failed to publish to pub socket." << causedBy(e);
+                }
+                delete batch;
+                batch = next;
+            }
+        }
+    }
+
+    void PubSubSendSocket::sendMessage(OutgoingMessage* message) {
+        const std::string& channel = message->channel;
+
+        // the body is compressed once and the compressed frame goes out on every link.
+        // bodies which do not shrink are sent as they are.
+        char flags = 0;
+        size_t bodyBytes = message->body.size();
+        if (pubsubCompression &&
+            pubsubCompressionThreshold >= 0 &&
+            bodyBytes >= static_cast<size_t>(pubsubCompressionThreshold)) {
+                std::string compressed;
+                compress(static_cast<const char*>(message->body.data()), bodyBytes, &compressed);
+                if (compressed.size() < bodyBytes) {
+                    message->body.rebuild(compressed.size());
+                    memcpy(message->body.data(), compressed.data(), compressed.size());
+                    flags |= kBodyCompressed;
+                }
+        }
+        bool isCompressed = flags & kBodyCompressed;
+
+        // dbEventSocket is non-null iff mongod is in a sharded environment
+        // workaround to compile on mongos without including d_logic.cpp
+        if (!serverGlobalParams.configsvr &&
+            dbEventSocket != NULL &&
+            channel == "$events" &&
+            publishDataEvents) {
+                // only publish database events to the mongoses. the body is shared with
+                // the copy sent below rather than copied.
+                zmq::message_t body;
+                body.copy(&message->body);
+                sendChannel(dbEventSocket, channel, flags);
+                dbEventSocket->send(body, ZMQ_SNDMORE);
+                dbEventSocket->send(message->envelope.data(), message->envelope.size());
+                dbEventStats.record(bodyBytes, message->body.size(), isCompressed);
+        }
+
+        // publications and writes to config servers are published normally
+        size_t wireBytes = message->body.size();
+        sendChannel(extSendSocket, channel, flags);
+        extSendSocket->send(message->body, ZMQ_SNDMORE);
+        extSendSocket->send(message->envelope.data(), message->envelope.size());
+        sendStats.record(bodyBytes, wireBytes, isCompressed);
+    }
+
+    void PubSubSendSocket::sendChannel(zmq::socket_t* socket,
+                                       const std::string& channel,
+                                       char flags) {
+        // the channel name is sent with its terminating NUL, and the flags only if set so
+        // that uncompressed messages are framed as before
+        if (flags == 0) {
+            socket->send(channel.c_str(), channel.size() + 1, ZMQ_SNDMORE);
             return;
+        }
+
+        zmq::message_t frame(channel.size() + 2);
+        char* data = static_cast<char*>(frame.data());
+        memcpy(data, channel.c_str(), channel.size() + 1);
+        data[channel.size() + 1] = flags;
+        socket->send(frame, ZMQ_SNDMORE);
+    }
 
-        vector<string> configdbs;
-        splitStringDelim(configServers, &configdbs, ',');
+    char PubSubSendSocket::channelFlags(const zmq::message_t& channelFrame) {
+        const char* data = static_cast<const char*>(channelFrame.data());
+        size_t nameBytes = strnlen(data, channelFrame.size()) + 1;
+        return channelFrame.size() > nameBytes ? data[nameBytes] : 0;
+    }
 
-        // find config db we are using for pubsub
-        HostAndPort maxConfigHP;
-        maxConfigHP.setPort(0);
+    bool PubSubSendSocket::decodeBody(char flags, zmq::message_t* body) {
+        size_t wireBytes = body->size();
+        if (!(flags & kBodyCompressed)) {
+            receiveStats.record(wireBytes, wireBytes, false);
+            return true;
+        }
 
-        for (vector<string>::iterator it = configdbs.begin(); it != configdbs.end(); it++) {
-            HostAndPort configHP = HostAndPort(*it);
-            if (configHP.port() > maxConfigHP.port())
-                maxConfigHP = configHP;
+        std::string uncompressed;
+        if (!uncompress(static_cast<const char*>(body->data()), wireBytes, &uncompressed))
+            return false;
+
+        body->rebuild(uncompressed.size());
+        memcpy(body->data(), uncompressed.data(), uncompressed.size());
+        receiveStats.record(uncompressed.size(), wireBytes, true);
+        return true;
+    }
+
+    void PubSubSendSocket::appendLinkStats(BSONObjBuilder* builder) {
+        BSONObjBuilder links(builder->subobjStart("links"));
+
+        BSONObjBuilder send(links.subobjStart("send"));
+        sendStats.append(&send);
+        send.done();
+
+        // only shard mongods publish data events on their own socket, to every mongos
+        if (dbEventSocket != NULL) {
+            BSONObjBuilder dbEvents(links.subobjStart("dbEvents"));
+            dbEventStats.append(&dbEvents);
+            dbEvents.done();
+        }
+
+        BSONObjBuilder receive(links.subobjStart("receive"));
+        receiveStats.append(&receive);
+        receive.done();
+
+        if (mongosPeerSocket != NULL) {
+            BSONArrayBuilder peers(links.subarrayStart("mongosPeers"));
+            SimpleMutex::scoped_lock lk(sendMutex);
+            for (std::set<HostAndPort>::const_iterator it = mongosPeers.begin();
+                 it != mongosPeers.end();
+                 it++) {
+                    peers.append(it->toString());
+            }
+            peers.done();
         }
 
-        HostAndPort configPullEndpoint = HostAndPort(maxConfigHP.host(), maxConfigHP.port() + 1234);
+        links.done();
+    }
+
+    void PubSubSendSocket::initSharding(const std::string configServers) {
+        if (!pubsubEnabled)
+            return;
 
+        // data events are published to every mongos, which refreshPubSubMongosPeers
+        // connects this socket to
         try {
-            dbEventSocket = new zmq::socket_t(zmqContext, ZMQ_PUSH);
-            dbEventSocket->connect(("tcp://" + configPullEndpoint.toString()).c_str());
+            dbEventSocket = new zmq::socket_t(zmqContext, ZMQ_PUB);
+            mongosPeerSocket = dbEventSocket;
         }
         catch (zmq::error_t& e) {
-            log() << "PubSub could not connect to config server. Turning off db events..."
+            log() << "PubSub could not create the data event socket. Turning off db events..."
                   << causedBy(e);
             publishDataEvents = false;
         }
+    }
+
+    void PubSubSendSocket::setMongosPeers(const std::set<HostAndPort>& mongoses) {
+        if (!pubsubEnabled || mongosPeerSocket == NULL)
+            return;
+
+        SimpleMutex::scoped_lock lk(sendMutex);
+
+        std::set<HostAndPort>::iterator it = mongosPeers.begin();
+        while (it != mongosPeers.end()) {
+            if (mongoses.count(*it)) {
+                it++;
+                continue;
+            }
 
+            std::string endpoint = str::stream() << "tcp://" << it->host()
+                                                 << ":" << it->port() + 1234;
+            try {
+                mongosPeerSocket->disconnect(endpoint.c_str());
+            }
+            catch (zmq::error_t& e) {
+                log() << "PubSub error disconnecting from mongos." << causedBy(e);
+            }
+            mongosPeers.erase(it++);
+        }
+
+        for (std::set<HostAndPort>::const_iterator it = mongoses.begin();
+             it != mongoses.end();
+             it++) {
+                if (mongosPeers.count(*it))
+                    continue;
+
+                std::string endpoint = str::stream() << "tcp://" << it->host()
+                                                     << ":" << it->port() + 1234;
+                try {
+                    mongosPeerSocket->connect(endpoint.c_str());
+                    mongosPeers.insert(*it);
+                }
+                catch (zmq::error_t& e) {
+                    log() << "PubSub error connecting to mongos." << causedBy(e);
+                }
+        }
     }
 
     void PubSubSendSocket::updateReplSetMember(HostAndPort hp) {
@@ -28,8 +28,16 @@
 
 #pragma once
 
+#include <boost/thread/condition.hpp>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
 #include <zmq.hpp>
 
+#include "mongo/db/pubsub_mpsc_queue.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/mutex.h"
 #include "mongo/util/net/hostandport.h"
 
 namespace mongo {
@@ -39,14 +47,64 @@ namespace mongo {
     extern bool pubsubEnabled;
     extern bool publishDataEvents;
 
+    struct QueryResult;
+    class BSONObjBuilder;
+
+    // Counters for the messages carried by an external pubsub link. bytes is the size of the
+    // message bodies before compression and wireBytes their size as sent on the link.
+    struct PubSubLinkStats {
+        AtomicUInt64 messages;
+        AtomicUInt64 compressedMessages;
+        AtomicUInt64 bytes;
+        AtomicUInt64 wireBytes;
+
+        void record(size_t bodyBytes, size_t sentBytes, bool compressed);
+        void append(BSONObjBuilder* builder) const;
+    };
+
+    // Subscriptions created with a cursor can be read with getMore and closed with
+    // killCursors. Their cursor ids have the high 32 bits clear, which is never the case
+    // for ClientCursor ids on mongod (collection cache id 0 is never assigned) nor for
+    // ShardedClientCursor ids on mongos (high bits hold the process uptime in millis).
+    inline bool isPubSubCursorId(long long cursorId) {
+        return cursorId > 0 && (cursorId >> 32) == 0;
+    }
+
+    // Set by PubSub once pubsub is running, and NULL before. The getMore and killCursors
+    // paths of mongod and mongos call these for pubsub cursor ids. pubsubGetMore returns the
+    // reply to send, which the caller owns. pubsubKillCursor returns false if the cursor
+    // was not found.
+    extern QueryResult* (*pubsubGetMore)(long long cursorId, int ntoreturn);
+    extern bool (*pubsubKillCursor)(long long cursorId);
+
+    // Set by PubSub once pubsub is running, and NULL before. Called by mongod and mongos when
+    // a client connection closes, to remove the subscriptions bound to it.
+    extern void (*pubsubConnectionClosed)(long long connectionId);
+
     class PubSubSendSocket {
     public:
-        // for locking around publish, because it uses a non-thread-safe zmq socket
+        // for locking around the send sockets, because zmq sockets are not thread-safe.
+        // held by the sender thread while it sends and by replica set membership changes.
         static SimpleMutex sendMutex;
         static zmq::context_t zmqContext;
         static zmq::socket_t* dbEventSocket;
 
+        // Publish queues messages for the sender thread and returns without waiting for
+        // them to be sent, so publishers never wait on sendMutex. Errors sending a message
+        // are logged by the sender thread.
         static bool publish(const std::string& channel, const BSONObj& message);
+
+        // Publishes a batch of messages, each on its own channel. The messages are
+        // timestamped in order from a single clock reading.
+        typedef std::pair<std::string, BSONObj> ChannelMessage;
+        static bool publish(const std::vector<ChannelMessage>& messages);
+
+        // runs in a background thread, started once the send sockets are initialized.
+        // sends the messages queued by publish, draining the whole queue on each pass.
+        static void sendMessages();
+
+        // called once a mongod becomes a shard. creates dbEventSocket, which publishes the
+        // shard's data events to the mongoses.
         static void initSharding(const std::string configServers);
 
         // methods that update which members of a replica set are still connected.
@@ -56,13 +114,76 @@ namespace mongo {
         static void updateReplSetMember(HostAndPort hp);
         static void pruneReplSetMembers();
 
-        // zmq PUB socket connected to replica set members' SUB sockets
+        // zmq PUB socket connected to replica set members' SUB sockets, or on mongos to the
+        // SUB sockets of all mongoses
         static zmq::socket_t* extSendSocket;
 
+        // Sharded clusters publish straight to every mongos rather than relaying through a
+        // config server. setMongosPeers connects mongosPeerSocket to the pubsub endpoint of
+        // each mongos given and disconnects it from those no longer given. mongosPeerSocket
+        // is extSendSocket on mongos, dbEventSocket on shard mongods and NULL otherwise.
+        static zmq::socket_t* mongosPeerSocket;
+        static void setMongosPeers(const std::set<HostAndPort>& mongoses);
+
+        // mongoses mongosPeerSocket is connected to. protected by sendMutex.
+        static std::set<HostAndPort> mongosPeers;
+
         // list of other replica set members we are connected to for pubsub
         // bool is set to indicate live or not live during each call to initFromConfig
         // after which pruneReplSetMembers (above) removes the not live members
         static std::map<HostAndPort, bool> rsMembers;
+
+        // On external links the channel frame of a message holds the channel name and its
+        // terminating NUL, followed by a byte of the flags below if any are set. Bodies are
+        // only compressed when the pubsubCompression server parameter is set, which all
+        // nodes exchanging messages must support.
+        static const char kBodyCompressed = 0x01;
+
+        // Returns the flags in a channel frame received from an external link.
+        static char channelFlags(const zmq::message_t& channelFrame);
+
+        // Decompresses body in place if flags say it is compressed, and counts it in
+        // receiveStats. Returns false if the body could not be decompressed.
+        static bool decodeBody(char flags, zmq::message_t* body);
+
+        // messages sent on extSendSocket, on dbEventSocket, and received from either
+        static PubSubLinkStats sendStats;
+        static PubSubLinkStats dbEventStats;
+        static PubSubLinkStats receiveStats;
+
+        // appends the counters of all links and the mongoses published to as a "links"
+        // subobject
+        static void appendLinkStats(BSONObjBuilder* builder);
+
+    private:
+        // a message waiting in sendQueue. the body is copied into a zmq frame and the
+        // PubSubEnvelope is encoded when it is queued, and both are sent as they are.
+        struct OutgoingMessage {
+            std::string channel;
+            zmq::message_t body;
+            std::string envelope;
+            OutgoingMessage* next;
+        };
+
+        // queues a single message for the sender thread. the envelope is built here, on the
+        // publishing thread, rather than by the single sender thread.
+        static void queueMessage(const std::string& channel,
+                                 const BSONObj& message,
+                                 unsigned long long timestamp);
+
+        // sends a single message to the sockets it should go out on, compressing its body
+        // first if it is large enough. must be called with sendMutex held.
+        static void sendMessage(OutgoingMessage* message);
+
+        // sends the channel frame of a message followed by its flags
+        static void sendChannel(zmq::socket_t* socket, const std::string& channel, char flags);
+
+        static MPSCQueue<OutgoingMessage> sendQueue;
+
+        // the sender thread waits on sendQueueNotify while the queue is empty. publishers
+        // only lock sendQueueMutex to notify it when they push to an empty queue.
+        static mongo::mutex sendQueueMutex;
+        static boost::condition sendQueueNotify;
     };
 
 }
@@ -0,0 +1,265 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pubsub_stats.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/threadlocal.h"
+#include "mongo/util/histogram.h"
+
+namespace mongo {
+
+    /**
+     * The counters of one thread. Only that thread writes them, so it adds with a plain load
+     * and store. When the thread exits they are added to the totals of exited threads.
+     */
+    struct PubSubThreadCounters {
+        PubSubThreadCounters();
+        ~PubSubThreadCounters();
+
+        AtomicUInt64 counts[PubSubStats::kNumCounters];
+    };
+
+    namespace {
+
+        // protects liveThreadCounters and exitedThreadCounts
+        SimpleMutex threadCountersMutex("pubsubthreadstats");
+        std::set<PubSubThreadCounters*> liveThreadCounters;
+        unsigned long long exitedThreadCounts[PubSubStats::kNumCounters];
+
+        const char* const kCounterNames[PubSubStats::kNumCounters] = {
+            "published",
+            "publishedBytes",
+            "returned",
+            "returnedBytes"
+        };
+
+        struct RoutedCounters {
+            RoutedCounters()
+                : messages(0), bytes(0), deliveries(0), filtersEvaluated(0), filtersRejected(0) {}
+
+            void add(size_t messageBytes,
+                     size_t messageDeliveries,
+                     size_t evaluated,
+                     size_t rejected) {
+                messages++;
+                bytes += messageBytes;
+                deliveries += messageDeliveries;
+                filtersEvaluated += evaluated;
+                filtersRejected += rejected;
+            }
+
+            void add(const RoutedCounters& other) {
+                messages += other.messages;
+                bytes += other.bytes;
+                deliveries += other.deliveries;
+                filtersEvaluated += other.filtersEvaluated;
+                filtersRejected += other.filtersRejected;
+            }
+
+            void append(BSONObjBuilder* builder) const {
+                builder->append("messages", static_cast<long long>(messages));
+                builder->append("bytes", static_cast<long long>(bytes));
+                builder->append("deliveries", static_cast<long long>(deliveries));
+                builder->append("filtersEvaluated", static_cast<long long>(filtersEvaluated));
+                builder->append("filtersRejected", static_cast<long long>(filtersRejected));
+            }
+
+            unsigned long long messages;
+            unsigned long long bytes;
+            unsigned long long deliveries;
+            unsigned long long filtersEvaluated;
+            unsigned long long filtersRejected;
+        };
+
+        // buckets of 1, 2, 4, ... 2^19 microseconds and above
+        Histogram::Options filterMicrosOptions() {
+            Histogram::Options options;
+            options.numBuckets = 21;
+            options.bucketSize = 1;
+            options.exponential = true;
+            return options;
+        }
+
+        // The routing counters are split into stripes by channel, each with its own mutex,
+        // so that dispatchers routing different channels rarely wait on each other.
+        struct RoutedStripe {
+            RoutedStripe() : mutex("pubsubroutedstats"), filterMicros(filterMicrosOptions()) {}
+
+            // protects the members below
+            SimpleMutex mutex;
+            RoutedCounters totals;
+            std::map<std::string, RoutedCounters> byChannel;
+            Histogram filterMicros;
+        };
+
+        const size_t kNumStripes = 16;
+        RoutedStripe routedStripes[kNumStripes];
+
+        RoutedStripe& stripeFor(const std::string& channel) {
+            return routedStripes[StringData::Hasher()(channel) % kNumStripes];
+        }
+
+        // channels are counted separately up to this many per stripe, the rest together as
+        // kOtherChannels
+        const size_t kMaxChannelsPerStripe = 10000 / kNumStripes;
+        const std::string kOtherChannels = "$other";
+
+        bool byMessagesDescending(
+                const std::pair<std::string, RoutedCounters>& a,
+                const std::pair<std::string, RoutedCounters>& b) {
+            return a.second.messages > b.second.messages;
+        }
+
+    }
+
+    TSP_DECLARE(PubSubThreadCounters, pubsubThreadCounters)
+    TSP_DEFINE(PubSubThreadCounters, pubsubThreadCounters)
+
+    PubSubThreadCounters::PubSubThreadCounters() {
+        SimpleMutex::scoped_lock lk(threadCountersMutex);
+        liveThreadCounters.insert(this);
+    }
+
+    PubSubThreadCounters::~PubSubThreadCounters() {
+        SimpleMutex::scoped_lock lk(threadCountersMutex);
+        for (int i = 0; i < PubSubStats::kNumCounters; i++)
+            exitedThreadCounts[i] += counts[i].load();
+        liveThreadCounters.erase(this);
+    }
+
+    void PubSubStats::add(Counter counter, unsigned long long n) {
+        AtomicUInt64& count = pubsubThreadCounters.getMake()->counts[counter];
+        count.store(count.load() + n);
+    }
+
+    void PubSubStats::recordRouted(const std::string& channel,
+                                   size_t bytes,
+                                   size_t deliveries,
+                                   size_t filtersEvaluated,
+                                   size_t filtersRejected,
+                                   unsigned long long filterMicrosSpent) {
+        RoutedStripe& stripe = stripeFor(channel);
+        SimpleMutex::scoped_lock lk(stripe.mutex);
+        stripe.totals.add(bytes, deliveries, filtersEvaluated, filtersRejected);
+        std::map<std::string, RoutedCounters>::iterator it = stripe.byChannel.find(channel);
+        if (it == stripe.byChannel.end()) {
+            const std::string& key = stripe.byChannel.size() < kMaxChannelsPerStripe ?
+                                         channel : kOtherChannels;
+            it = stripe.byChannel.insert(std::make_pair(key, RoutedCounters())).first;
+        }
+        it->second.add(bytes, deliveries, filtersEvaluated, filtersRejected);
+        if (filtersEvaluated > 0) {
+            stripe.filterMicros.insert(static_cast<uint32_t>(
+                std::min(filterMicrosSpent, 0xffffffffULL)));
+        }
+    }
+
+    void PubSubStats::appendTotals(BSONObjBuilder* builder) {
+        unsigned long long counts[kNumCounters];
+        {
+            SimpleMutex::scoped_lock lk(threadCountersMutex);
+            std::copy(exitedThreadCounts, exitedThreadCounts + kNumCounters, counts);
+            for (std::set<PubSubThreadCounters*>::const_iterator it =
+                     liveThreadCounters.begin();
+                 it != liveThreadCounters.end();
+                 it++) {
+                    for (int i = 0; i < kNumCounters; i++)
+                        counts[i] += (*it)->counts[i].load();
+            }
+        }
+
+        for (int i = 0; i < kNumCounters; i++)
+            builder->append(kCounterNames[i], static_cast<long long>(counts[i]));
+
+        RoutedCounters routedTotals;
+        for (size_t i = 0; i < kNumStripes; i++) {
+            SimpleMutex::scoped_lock lk(routedStripes[i].mutex);
+            routedTotals.add(routedStripes[i].totals);
+        }
+
+        BSONObjBuilder routed(builder->subobjStart("routed"));
+        routedTotals.append(&routed);
+        routed.done();
+    }
+
+    void PubSubStats::appendChannels(BSONObjBuilder* builder, size_t maxChannels) {
+        // every stripe may have counted some channels as kOtherChannels
+        std::map<std::string, RoutedCounters> byChannel;
+        for (size_t i = 0; i < kNumStripes; i++) {
+            SimpleMutex::scoped_lock lk(routedStripes[i].mutex);
+            for (std::map<std::string, RoutedCounters>::const_iterator it =
+                     routedStripes[i].byChannel.begin();
+                 it != routedStripes[i].byChannel.end();
+                 it++) {
+                    byChannel[it->first].add(it->second);
+            }
+        }
+        std::vector<std::pair<std::string, RoutedCounters> > channels(byChannel.begin(),
+                                                                      byChannel.end());
+
+        size_t numChannels = std::min(maxChannels, channels.size());
+        std::partial_sort(channels.begin(),
+                          channels.begin() + numChannels,
+                          channels.end(),
+                          byMessagesDescending);
+
+        for (size_t i = 0; i < numChannels; i++) {
+            BSONObjBuilder channel(builder->subobjStart(channels[i].first));
+            channels[i].second.append(&channel);
+            channel.done();
+        }
+    }
+
+    void PubSubStats::appendFilterMicros(BSONObjBuilder* builder) {
+        std::vector<unsigned long long> counts(routedStripes[0].filterMicros.getBucketsNum());
+        for (size_t i = 0; i < kNumStripes; i++) {
+            SimpleMutex::scoped_lock lk(routedStripes[i].mutex);
+            for (uint32_t j = 0; j < counts.size(); j++)
+                counts[j] += routedStripes[i].filterMicros.getCount(j);
+        }
+
+        BSONArrayBuilder buckets(builder->subarrayStart("filterMicros"));
+        for (uint32_t i = 0; i < counts.size(); i++) {
+            long long boundary = routedStripes[0].filterMicros.getBoundary(i);
+            buckets.append(BSON("micros" << boundary
+                             << "count" << static_cast<long long>(counts[i])));
+        }
+        buckets.done();
+    }
+
+}  // namespace mongo
@@ -0,0 +1,81 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <string>
+
+namespace mongo {
+
+    class BSONObjBuilder;
+
+    /**
+     * Counters describing pubsub on this node, reported by serverStatus and pubsubStats.
+     *
+     * Publishes and polls are counted by many threads at once, so each thread adds to its own
+     * counters without locking or atomic read-modify-writes, and readers sum the counters of
+     * all threads. Routing is counted by the dispatcher threads under mutexes striped by
+     * channel, so dispatchers routing different channels rarely contend.
+     */
+    class PubSubStats {
+    public:
+        enum Counter {
+            kPublished,         // messages published on this node, including data events
+            kPublishedBytes,
+            kReturned,          // messages returned by poll and getMore
+            kReturnedBytes,
+            kNumCounters
+        };
+
+        // Adds n to counter for the calling thread.
+        static void add(Counter counter, unsigned long long n);
+
+        // Counts a message routed by a dispatcher on channel: its size, the number of
+        // subscriptions it was delivered to, the number of distinct filters evaluated on it
+        // and rejecting it, and the time spent evaluating them.
+        static void recordRouted(const std::string& channel,
+                                 size_t bytes,
+                                 size_t deliveries,
+                                 size_t filtersEvaluated,
+                                 size_t filtersRejected,
+                                 unsigned long long filterMicros);
+
+        // Appends the counters above and the routing totals across all channels.
+        static void appendTotals(BSONObjBuilder* builder);
+
+        // Appends the routing counters of the maxChannels channels which received the most
+        // messages, keyed on channel. Once many channels have been counted, messages on new
+        // channels are counted together under "$other".
+        static void appendChannels(BSONObjBuilder* builder, size_t maxChannels);
+
+        // Appends the histogram of the time spent evaluating filters per routed message, as
+        // an array of { micros: <upper bound>, count: <messages> } buckets.
+        static void appendFilterMicros(BSONObjBuilder* builder);
+    };
+
+}  // namespace mongo
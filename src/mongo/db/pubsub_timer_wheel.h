@@ -0,0 +1,164 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "mongo/util/assert_util.h"
+
+namespace mongo {
+
+    /**
+     * Hierarchical timer wheel. Items are scheduled to expire at a deadline in milliseconds
+     * and handed back by advance once the clock passes it. Time is divided into ticks of
+     * tickMillis, and each level of the wheel has kSlots slots covering kSlots times the
+     * span of the level below it. An item goes in the lowest level whose span reaches its
+     * deadline. Whenever the level below wraps around, the items of the next slot of a
+     * level are moved down, until they reach the lowest level and expire on their tick.
+     *
+     * Scheduling is O(1), and advancing costs O(1) per tick plus O(1) per item expired or
+     * moved down a level, of which there are a few per item. Deadlines further away than
+     * the wheel spans are parked in its furthest slot until they come within its span.
+     *
+     * Not thread safe. An item scheduled more than once is handed back once per schedule.
+     */
+    template <typename T>
+    class TimerWheel {
+    public:
+        static const int kSlotBits = 6;
+        static const size_t kSlots = 1 << kSlotBits;
+        static const int kLevels = 4;
+
+        TimerWheel(long long tickMillis, long long nowMillis)
+            : _tickMillis(tickMillis), _now(nowMillis / tickMillis), _size(0) {
+            verify(tickMillis > 0);
+        }
+
+        /**
+         * Schedules item to expire at deadlineMillis. A deadline which has already passed
+         * expires on the next tick.
+         */
+        void schedule(const T& item, long long deadlineMillis) {
+            Entry entry;
+            entry.item = item;
+            // rounded up so that items never expire early
+            entry.deadline = (deadlineMillis + _tickMillis - 1) / _tickMillis;
+            if (entry.deadline <= _now)
+                entry.deadline = _now + 1;
+            insert(entry);
+            _size++;
+        }
+
+        /**
+         * Advances the clock to nowMillis and appends the items whose deadline it reached or
+         * passed to expired, in deadline order. Returns the number of items appended.
+         */
+        size_t advance(long long nowMillis, std::vector<T>* expired) {
+            long long target = nowMillis / _tickMillis;
+            size_t numExpired = 0;
+            while (_now < target) {
+                if (_size == 0) {
+                    _now = target;
+                    break;
+                }
+
+                _now++;
+
+                // each level whose span starts over on this tick moves its next slot down
+                for (int level = 1; level < kLevels; level++) {
+                    if ((_now & mask(level - 1)) != 0)
+                        break;
+                    cascade(level);
+                }
+
+                std::vector<Entry> due;
+                due.swap(_slots[0][_now & (kSlots - 1)]);
+                for (size_t i = 0; i < due.size(); i++) {
+                    if (due[i].deadline <= _now) {
+                        expired->push_back(due[i].item);
+                        numExpired++;
+                        _size--;
+                    }
+                    else {
+                        insert(due[i]);
+                    }
+                }
+            }
+            return numExpired;
+        }
+
+        // number of items scheduled and not yet expired
+        size_t size() const { return _size; }
+
+        long long tickMillis() const { return _tickMillis; }
+
+    private:
+        struct Entry {
+            T item;
+            long long deadline;
+        };
+
+        // the ticks within one slot of level
+        static long long mask(int level) {
+            return (1LL << (kSlotBits * (level + 1))) - 1;
+        }
+
+        void insert(const Entry& entry) {
+            long long delta = entry.deadline - _now;
+            long long deadline = entry.deadline;
+            int level = 0;
+            while (level < kLevels - 1 && delta > mask(level))
+                level++;
+
+            // parked in the furthest slot and placed again when it is reached
+            if (delta > mask(kLevels - 1))
+                deadline = _now + mask(kLevels - 1);
+
+            size_t slot = (deadline >> (kSlotBits * level)) & (kSlots - 1);
+            _slots[level][slot].push_back(entry);
+        }
+
+        void cascade(int level) {
+            std::vector<Entry> entries;
+            entries.swap(_slots[level][(_now >> (kSlotBits * level)) & (kSlots - 1)]);
+            for (size_t i = 0; i < entries.size(); i++)
+                insert(entries[i]);
+        }
+
+        const long long _tickMillis;
+
+        // the last tick advanced to
+        long long _now;
+
+        size_t _size;
+
+        std::vector<Entry> _slots[kLevels][kSlots];
+    };
+
+}  // namespace mongo
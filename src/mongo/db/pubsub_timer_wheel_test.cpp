@@ -0,0 +1,145 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/pubsub_timer_wheel.h"
+
+#include "mongo/unittest/unittest.h"
+
+namespace mongo {
+
+    TEST(TimerWheelTest, Empty) {
+        TimerWheel<int> wheel(10, 0);
+        std::vector<int> expired;
+        ASSERT_EQUALS(0U, wheel.advance(1000 * 1000, &expired));
+        ASSERT_TRUE(expired.empty());
+        ASSERT_EQUALS(0U, wheel.size());
+    }
+
+    TEST(TimerWheelTest, ExpiresOnDeadline) {
+        TimerWheel<int> wheel(10, 0);
+        wheel.schedule(1, 50);
+        ASSERT_EQUALS(1U, wheel.size());
+
+        std::vector<int> expired;
+        wheel.advance(49, &expired);
+        ASSERT_TRUE(expired.empty());
+
+        wheel.advance(50, &expired);
+        ASSERT_EQUALS(1U, expired.size());
+        ASSERT_EQUALS(1, expired[0]);
+        ASSERT_EQUALS(0U, wheel.size());
+    }
+
+    TEST(TimerWheelTest, NeverExpiresEarly) {
+        // deadlines are rounded up to the next tick
+        TimerWheel<int> wheel(10, 0);
+        wheel.schedule(1, 55);
+
+        std::vector<int> expired;
+        wheel.advance(59, &expired);
+        ASSERT_TRUE(expired.empty());
+
+        wheel.advance(60, &expired);
+        ASSERT_EQUALS(1U, expired.size());
+    }
+
+    TEST(TimerWheelTest, PastDeadlineExpiresOnNextTick) {
+        TimerWheel<int> wheel(10, 1000);
+        wheel.schedule(1, 0);
+
+        std::vector<int> expired;
+        wheel.advance(1000, &expired);
+        ASSERT_TRUE(expired.empty());
+
+        wheel.advance(1010, &expired);
+        ASSERT_EQUALS(1U, expired.size());
+    }
+
+    TEST(TimerWheelTest, ExpiresInDeadlineOrderAcrossLevels) {
+        // deadlines on every level of the wheel, scheduled out of order, checked one tick
+        // at a time
+        TimerWheel<int> wheel(1, 7);
+        const int deadlines[] = { 100 * 1000, 9, 70, 5000, 64, 4096 + 7, 300 * 1000, 63 };
+        const size_t numDeadlines = sizeof(deadlines) / sizeof(deadlines[0]);
+        for (size_t i = 0; i < numDeadlines; i++)
+            wheel.schedule(deadlines[i], deadlines[i]);
+
+        std::vector<int> expired;
+        for (long long now = 8; now <= 300 * 1000; now++) {
+            size_t before = expired.size();
+            wheel.advance(now, &expired);
+            for (size_t i = before; i < expired.size(); i++)
+                ASSERT_EQUALS(now, expired[i]);
+        }
+        ASSERT_EQUALS(numDeadlines, expired.size());
+        ASSERT_EQUALS(0U, wheel.size());
+    }
+
+    TEST(TimerWheelTest, AdvancesOverManyTicksAtOnce) {
+        TimerWheel<int> wheel(1, 0);
+        for (int i = 1; i <= 10000; i++)
+            wheel.schedule(i, i * 37);
+
+        std::vector<int> expired;
+        wheel.advance(10000 * 37 - 1, &expired);
+        ASSERT_EQUALS(9999U, expired.size());
+        for (int i = 0; i < 9999; i++)
+            ASSERT_EQUALS(i + 1, expired[i]);
+
+        wheel.advance(10000 * 37, &expired);
+        ASSERT_EQUALS(10000U, expired.size());
+    }
+
+    TEST(TimerWheelTest, BeyondSpan) {
+        // 64^4 ticks is the span of the wheel
+        TimerWheel<int> wheel(1, 0);
+        long long span = 1LL << (TimerWheel<int>::kSlotBits * TimerWheel<int>::kLevels);
+        wheel.schedule(1, 3 * span + 5);
+
+        std::vector<int> expired;
+        wheel.advance(3 * span + 4, &expired);
+        ASSERT_TRUE(expired.empty());
+        ASSERT_EQUALS(1U, wheel.size());
+
+        wheel.advance(3 * span + 5, &expired);
+        ASSERT_EQUALS(1U, expired.size());
+    }
+
+    TEST(TimerWheelTest, ScheduledTwice) {
+        TimerWheel<int> wheel(10, 0);
+        wheel.schedule(1, 100);
+        wheel.schedule(1, 200);
+
+        std::vector<int> expired;
+        wheel.advance(100, &expired);
+        ASSERT_EQUALS(1U, expired.size());
+        wheel.advance(200, &expired);
+        ASSERT_EQUALS(2U, expired.size());
+    }
+
+}  // namespace mongo
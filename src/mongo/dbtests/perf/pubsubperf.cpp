@@ -0,0 +1,303 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+/**
+ * End to end benchmark of pubsub within one process: messages go from
+ * PubSubSendSocket::publish through the sender thread, the proxy and the dispatcher to
+ * PubSub::poll, over the same sockets and threads as a standalone mongod except that the
+ * external link is inproc instead of loopback TCP. There is one dispatcher thread, since
+ * all messages of a run are on one channel.
+ *
+ * For every combination of subscriber count, message size, filter selectivity and
+ * projection it reports
+ *  - the p50, p99 and p999 latency from publish to the poll returning the message, with
+ *    messages published at a steady rate below saturation, and
+ *  - the messages and deliveries per second when publishing as fast as possible.
+ *
+ * Each test runs the matrix for one subscriber count and prints a line per combination. Run
+ * one of them with e.g. pubsubperf --filter "Matrix<100>".
+ */
+
+#include "mongo/pch.h"
+
+#include <algorithm>
+#include <boost/thread/thread.hpp>
+#include <set>
+#include <zmq.hpp>
+
+#include "mongo/base/initializer.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/pubsub.h"
+#include "mongo/db/pubsub_sendsock.h"
+#include "mongo/dbtests/framework.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/time_support.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+    // This specifies default dbpath for our testing framework
+    const std::string default_test_dbpath = "/data/db/pubsubperf";
+}  // namespace mongo
+
+namespace PubSubPerf {
+
+    using namespace mongo;
+
+    // external link between the send socket and the receive socket, in place of the
+    // tcp port a mongod binds
+    const char* const kExtEndpoint = "inproc://pubsubperf";
+
+    // messages published per configuration when measuring latency, and the interval
+    // between them
+    const int kLatencyMessages = 2000;
+    const int kLatencyIntervalMicros = 200;
+
+    // messages published per configuration when measuring throughput
+    const int kThroughputMessages = 10000;
+
+    // a poll returning nothing for this long after the last publish ends a run
+    const long kIdleMillis = 2000;
+
+    enum Selectivity {
+        kUnfiltered = -1,
+        kAll = 100,
+        kTenth = 10
+    };
+
+    // Starts the pubsub threads of a standalone mongod, see pubsub_d.cpp, and waits until
+    // a published message reaches a subscription.
+    void startPubSub() {
+        static bool started = false;
+        if (started)
+            return;
+        started = true;
+
+        PubSubSendSocket::extSendSocket = PubSub::initSendSocket();
+        PubSub::extRecvSocket = PubSub::initRecvSocket();
+        verify(pubsubEnabled);
+
+        PubSub::extRecvSocket->bind(kExtEndpoint);
+        PubSubSendSocket::extSendSocket->connect(kExtEndpoint);
+
+        boost::thread messageSender(PubSubSendSocket::sendMessages);
+        PubSub::startDispatchers();
+
+        // subscribers connect asynchronously, so publish until the dispatcher is listening
+        SubscriptionId warmup = PubSub::subscribe("pubsubperf.warmup",
+                                                  BSONObj(),
+                                                  BSONObj(),
+                                                  SubscriptionLimits::defaults());
+        std::set<SubscriptionId> ids;
+        ids.insert(warmup);
+        while (true) {
+            PubSubSendSocket::publish("pubsubperf.warmup", BSONObj());
+
+            long long millisPolled = 0;
+            bool pollAgain = false;
+            std::map<SubscriptionId, std::string> errors;
+            std::map<SubscriptionId, long long> droppedMessages;
+            if (!PubSub::poll(ids, 100, millisPolled, pollAgain, errors, droppedMessages,
+                              0, 0).empty())
+                break;
+        }
+        std::map<SubscriptionId, std::string> errors;
+        PubSub::unsubscribe(warmup, errors);
+    }
+
+    // Publishes numMessages messages of about messageBytes bytes each on channel, waiting
+    // intervalMicros between them. Field k of message i is i % 100.
+    void publishMessages(const std::string& channel,
+                         int numMessages,
+                         int messageBytes,
+                         int intervalMicros) {
+        std::string payload(messageBytes, 'x');
+        for (int i = 0; i < numMessages; i++) {
+            PubSubSendSocket::publish(channel, BSON("k" << i % 100 << "payload" << payload));
+            if (intervalMicros > 0)
+                sleepmicros(intervalMicros);
+        }
+    }
+
+    template <int NumSubscribers>
+    class Matrix {
+    public:
+        void run() {
+            startPubSub();
+
+            const int messageSizes[] = { 64, 1024, 16384 };
+            const Selectivity selectivities[] = { kUnfiltered, kAll, kTenth };
+            for (size_t size = 0; size < sizeof(messageSizes) / sizeof(int); size++) {
+                for (size_t sel = 0; sel < sizeof(selectivities) / sizeof(Selectivity); sel++) {
+                    runConfiguration(messageSizes[size], selectivities[sel], false);
+                    runConfiguration(messageSizes[size], selectivities[sel], true);
+                }
+            }
+        }
+
+    private:
+        struct Result {
+            Result() : deliveries(0), droppedMessages(0), micros(0) {}
+
+            std::vector<unsigned long long> latencies;
+            long long deliveries;
+            long long droppedMessages;
+            unsigned long long micros;
+        };
+
+        void runConfiguration(int messageBytes, Selectivity selectivity, bool projection) {
+            Result latency = runOnce(messageBytes, selectivity, projection,
+                                     kLatencyMessages, kLatencyIntervalMicros);
+            Result throughput = runOnce(messageBytes, selectivity, projection,
+                                        kThroughputMessages, 0);
+
+            std::sort(latency.latencies.begin(), latency.latencies.end());
+            double seconds = throughput.micros / 1000000.0;
+
+            BSONObjBuilder b;
+            b.append("subscribers", NumSubscribers);
+            b.append("messageBytes", messageBytes);
+            b.append("selectivity", selectivity == kUnfiltered ?
+                                        std::string("unfiltered") :
+                                        std::string(str::stream()
+                                                        << static_cast<int>(selectivity) << "%"));
+            b.append("projection", projection);
+            b.append("p50Micros", percentile(latency.latencies, 0.5));
+            b.append("p99Micros", percentile(latency.latencies, 0.99));
+            b.append("p999Micros", percentile(latency.latencies, 0.999));
+            b.append("messagesPerSec", seconds > 0 ? kThroughputMessages / seconds : 0.0);
+            b.append("deliveriesPerSec", seconds > 0 ? throughput.deliveries / seconds : 0.0);
+            b.append("droppedMessages", latency.droppedMessages + throughput.droppedMessages);
+            cout << b.obj().jsonString() << endl;
+        }
+
+        static long long percentile(const std::vector<unsigned long long>& sorted, double p) {
+            if (sorted.empty())
+                return 0;
+            size_t i = std::min(static_cast<size_t>(sorted.size() * p), sorted.size() - 1);
+            return static_cast<long long>(sorted[i]);
+        }
+
+        Result runOnce(int messageBytes,
+                       Selectivity selectivity,
+                       bool projection,
+                       int numMessages,
+                       int intervalMicros) {
+            // a channel of its own, so messages left over from another run are not counted
+            static int runs = 0;
+            std::string channel = str::stream() << "pubsubperf." << runs++;
+
+            // unlimited queues, so every message is delivered
+            SubscriptionLimits limits = SubscriptionLimits::defaults();
+            limits.maxMessages = 0;
+            limits.maxBytes = 0;
+
+            // each subscriber's filter differs so that it is evaluated separately
+            std::set<SubscriptionId> ids;
+            for (int i = 0; i < NumSubscribers; i++) {
+                BSONObj filter;
+                if (selectivity != kUnfiltered) {
+                    filter = BSON("k" << BSON("$lt" << static_cast<int>(selectivity))
+                               << "subscriber" << BSON("$ne" << i));
+                }
+                ids.insert(PubSub::subscribe(channel,
+                                             filter,
+                                             projection ? BSON("k" << 1) : BSONObj(),
+                                             limits));
+            }
+
+            long long expected = static_cast<long long>(numMessages) * NumSubscribers;
+            if (selectivity != kUnfiltered)
+                expected = expected * selectivity / 100;
+
+            Result result;
+            result.latencies.reserve(expected);
+
+            Timer timer;
+            boost::thread publisher(publishMessages,
+                                    channel,
+                                    numMessages,
+                                    messageBytes,
+                                    intervalMicros);
+
+            Timer idle;
+            while (result.deliveries + result.droppedMessages < expected) {
+                long long millisPolled = 0;
+                bool pollAgain = false;
+                std::map<SubscriptionId, std::string> errors;
+                std::map<SubscriptionId, long long> droppedMessages;
+                std::vector<SubscriptionMessage> messages =
+                    PubSub::poll(ids, 100, millisPolled, pollAgain, errors, droppedMessages,
+                                 0, 0);
+
+                unsigned long long now = curTimeMicros64();
+                for (size_t i = 0; i < messages.size(); i++)
+                    result.latencies.push_back(now - messages[i].timestamp());
+                result.deliveries += messages.size();
+                for (std::map<SubscriptionId, long long>::const_iterator it =
+                         droppedMessages.begin();
+                     it != droppedMessages.end();
+                     it++) {
+                        result.droppedMessages += it->second;
+                }
+
+                if (!messages.empty() || !droppedMessages.empty())
+                    idle.reset();
+                else if (idle.millis() > kIdleMillis)
+                    break;
+            }
+            result.micros = timer.micros();
+            publisher.join();
+
+            std::map<SubscriptionId, std::string> errors;
+            for (std::set<SubscriptionId>::const_iterator it = ids.begin();
+                 it != ids.end();
+                 it++) {
+                    PubSub::unsubscribe(*it, errors);
+            }
+
+            return result;
+        }
+    };
+
+    class All : public unittest::Suite {
+    public:
+        All() : Suite("pubsub") {}
+
+        void setupTests() {
+            add< Matrix<1> >();
+            add< Matrix<10> >();
+            add< Matrix<100> >();
+        }
+    } all;
+
+}  // namespace PubSubPerf
+
+int main(int argc, char** argv, char** envp) {
+    mongo::runGlobalInitializersOrDie(argc, argv, envp);
+    return mongo::dbtests::runDbTests(argc, argv);
+}
@@ -44,6 +44,7 @@
 #include "mongo/db/dur_stats.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/json.h"
+#include "mongo/db/pubsub_channel_trie.h"
 #include "mongo/db/structure/btree/key.h"
 #include "mongo/db/lasterror.h"
 #include "mongo/db/taskqueue.h"
@@ -956,6 +957,37 @@ namespace PerfTests {
         }
     };
 
+    // test speed of routing a published message to its subscribers with 100k subscriptions
+    // spread over 10k channels. each lookup should only touch the subscriptions on the
+    // channel and on the channels that are a prefix of it.
+    class PubSubChannelRoute : public B {
+    public:
+        enum { NumChannels = 10000, NumSubscriptions = 100000 };
+        string name() { return "pubsub-channel-route"; }
+        virtual int howLongMillis() { return 3000; }
+        virtual bool showDurStats() { return false; }
+        void prep() {
+            for (int i = 0; i < NumChannels; i++) {
+                channels.push_back(string(str::stream() << "channel." << i));
+            }
+            for (int i = 0; i < NumSubscriptions; i++) {
+                trie.insert(channels[i % NumChannels], i);
+            }
+        }
+        void timed() {
+            matches.clear();
+            trie.findPrefixesOf(channels[rand() % NumChannels], &matches);
+            dontOptimizeOutHopefully += matches.size();
+        }
+        void post() {
+            ASSERT_EQUALS(static_cast<size_t>(NumSubscriptions), trie.size());
+        }
+    private:
+        ChannelTrie<int> trie;
+        vector<string> channels;
+        vector<int> matches;
+    };
+
     // test speed of checksum method
     class ChecksumTest : public B {
     public:
@@ -1369,6 +1401,7 @@ namespace PerfTests {
             else {
                 add< Dummy >();
                 add< ChecksumTest >();
+                add< PubSubChannelRoute >();
                 add< Compress >();
                 add< TLS >();
 #if defined(_WIN32)
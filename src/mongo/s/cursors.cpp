@@ -45,6 +45,7 @@
 #include "mongo/db/commands.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/max_time.h"
+#include "mongo/db/pubsub_sendsock.h"
 #include "mongo/util/concurrency/task.h"
 #include "mongo/util/net/listen.h"
 
@@ -334,6 +335,12 @@ namespace mongo {
                 continue;
             }
 
+            // subscription cursors are served by this mongos
+            if ( pubsubKillCursor && isPubSubCursorId( id ) ) {
+                pubsubKillCursor( id );
+                continue;
+            }
+
             string server;
             {
                 scoped_lock lk( _mutex );
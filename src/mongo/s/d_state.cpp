@@ -36,6 +36,7 @@
 
 #include "mongo/pch.h"
 
+#include <boost/thread/thread.hpp>
 #include <map>
 #include <string>
 #include <vector>
@@ -56,6 +57,7 @@
 #include "mongo/s/config.h"
 #include "mongo/s/d_logic.h"
 #include "mongo/s/metadata_loader.h"
+#include "mongo/s/pubsub_mongos_peers.h"
 #include "mongo/s/shard.h"
 #include "mongo/util/queue.h"
 #include "mongo/util/concurrency/mutex.h"
@@ -90,6 +92,9 @@ namespace mongo {
         configServer.init(server);
 
         PubSubSendSocket::initSharding(server);
+
+        // publish data events to the mongoses as they come and go
+        boost::thread mongosPeers(refreshPubSubMongosPeers);
     }
 
     // TODO: Consolidate and eliminate these various ways of setting / validating shard names
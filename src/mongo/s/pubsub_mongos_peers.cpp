@@ -0,0 +1,92 @@
+/**
+ *    Copyright (C) 2014 MongoDB Inc.
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/s/pubsub_mongos_peers.h"
+
+#include <set>
+#include <string>
+
+#include "mongo/client/connpool.h"
+#include "mongo/db/pubsub_sendsock.h"
+#include "mongo/s/config.h"
+#include "mongo/s/type_mongos.h"
+#include "mongo/util/net/sock.h"
+
+namespace mongo {
+
+    namespace {
+
+        // mongoses ping config.mongos every 30 seconds or less while they are up, so those
+        // which have not pinged for longer than this are considered gone
+        const int kMongosPingWindowSecs = 120;
+
+        const int kRefreshIntervalSecs = 5;
+
+    }
+
+    void refreshPubSubMongosPeers() {
+        if (!pubsubEnabled || PubSubSendSocket::mongosPeerSocket == NULL)
+            return;
+
+        // a mongos is registered under the same name its balancer pings with. it publishes
+        // to itself through its own endpoint.
+        std::string self = str::stream() << getHostNameCached() << ":"
+                                         << serverGlobalParams.port;
+
+        while (!inShutdown()) {
+            try {
+                ScopedDbConnection conn(configServer.getPrimary().getConnString(), 30);
+
+                Date_t since(jsTime().millis - kMongosPingWindowSecs * 1000LL);
+                auto_ptr<DBClientCursor> cursor =
+                    conn->query(MongosType::ConfigNS,
+                                BSON(MongosType::ping() << BSON("$gte" << since)));
+
+                std::set<HostAndPort> mongoses;
+                while (cursor->more()) {
+                    BSONObj mongos = cursor->nextSafe();
+                    std::string name = mongos[MongosType::name()].str();
+                    if (!name.empty() && name != self)
+                        mongoses.insert(HostAndPort(name));
+                }
+                conn.done();
+
+                PubSubSendSocket::setMongosPeers(mongoses);
+            }
+            catch (const DBException& e) {
+                // keep publishing to the last known mongoses until the config servers answer
+                log() << "PubSub could not refresh the list of mongoses." << causedBy(e);
+            }
+
+            sleepsecs(kRefreshIntervalSecs);
+        }
+    }
+
+}  // namespace mongo
@@ -51,6 +51,7 @@
 #include "mongo/db/lasterror.h"
 #include "mongo/db/log_process_details.h"
 #include "mongo/db/pubsub_s.h"
+#include "mongo/db/pubsub_sendsock.h"
 #include "mongo/platform/process_id.h"
 #include "mongo/s/balance.h"
 #include "mongo/s/chunk.h"
@@ -176,7 +177,9 @@ namespace mongo {
         }
 
         virtual void disconnected( AbstractMessagingPort* p ) {
-            // all things are thread local
+            // all things are thread local, except for subscriptions bound to the connection
+            if ( pubsubConnectionClosed )
+                pubsubConnectionClosed( p->connectionId() );
         }
     };
 
@@ -43,6 +43,7 @@
 #include "mongo/db/server_parameters.h"
 #include "mongo/db/structure/catalog/index_details.h"
 #include "mongo/db/namespace_string.h"
+#include "mongo/db/pubsub_sendsock.h"
 #include "mongo/db/query/lite_parsed_query.h"
 #include "mongo/db/stats/counters.h"
 #include "mongo/s/client_info.h"
@@ -457,6 +458,13 @@ namespace mongo {
         audit::logGetMoreAuthzCheck( client, nsString, id, status.code() );
         uassertStatusOK(status);
 
+        if ( pubsubGetMore && isPubSubCursorId( id ) ) {
+            // subscription cursors are served by this mongos
+            Message response( pubsubGetMore( id, ntoreturn ), true );
+            r.p()->reply( r.m(), response, r.id() );
+            return;
+        }
+
         if( !host.empty() ){
 
             LOG(3) << "single getmore: " << ns << endl;
@@ -13,15 +13,38 @@ if (PS === undefined) {
 }
 
 PS.prototype.help = function() {
-    print("\tps.publish(channel, message)    publishes message to given channel");
-    print("\tps.subscribe(channel)           <ObjectId> subscribes to channel");
-    print("\tps.poll(id, [timeout])          checks for messages on the subscription id " +
-                                             "given, waiting for <timeout> msecs if specified");
+    print("\tps.publish(channel, message)    publishes message to given channel. message may " +
+                                             "be an array of messages to publish as a batch, " +
+                                             "each { message : {}, [channel : <channel>] }");
+    print("\tps.subscribe(channel, [filter], [projection], [options])");
+    print("\t                                <Subscription> subscribes to channel. options " +
+                                             "may set maxQueueMessages, maxQueueBytes, " +
+                                             "overflowPolicy, idleTimeout, ephemeral, cursor " +
+                                             "and startAt. channel may " +
+                                             "be a pattern such as orders.*.eu");
+    print("\tps.poll(id, [timeout], [afterSeq], [limits])");
+    print("\t                                checks for messages on the subscription id " +
+                                             "given, waiting for <timeout> msecs if specified. " +
+                                             "afterSeq returns messages after { channel: seq } " +
+                                             "again. limits may set maxMessages and maxBytes");
     print("\tps.pollAll([timeout])           polls for messages on all subscriptions issed by " +
                                              "this instance of PS");
     print("\tps.unsubscribe(id)              unsubscribes from subscription id given");
     print("\tps.unsubscribeAll()             unsubscribes from all subscriptions issued by " +
                                              "this instance of PS");
+    print("\tps.createDurableChannel(channel, size, [max])");
+    print("\t                                stores messages on channel in a capped collection " +
+                                             "of size bytes, so subscriptions can startAt a " +
+                                             "past message's storedId or date");
+}
+
+PS.prototype.createDurableChannel = function(channel, size, max) {
+    var cmdObj = { createDurableChannel: channel, size: size };
+    if (max !== undefined)
+        cmdObj.max = max;
+    var res = this._db.runCommand(cmdObj);
+    assert.commandWorked(res);
+    return res;
 }
 
 PS.prototype.publish = function(channel, message) {
@@ -33,12 +56,17 @@ PS.prototype.publish = function(channel, message) {
     if (messageType != "object")
         throw Error("The message argument to the publish command must be a document but was a " +
                      messageType);
-    var res = this._db.runCommand({ publish: channel, message: message });
+    var cmdObj = { publish: channel };
+    if (Array.isArray(message))
+        cmdObj.messages = message;
+    else
+        cmdObj.message = message;
+    var res = this._db.runCommand(cmdObj);
     assert.commandWorked(res);
     return res;
 }
 
-PS.prototype.subscribe = function(channel, filter, projection) {
+PS.prototype.subscribe = function(channel, filter, projection, options) {
     channelType = typeof channel;
     if (channelType != "string")
         throw Error("The channel argument to the subscribe command must be a string but was a " +
@@ -52,24 +80,45 @@ PS.prototype.subscribe = function(channel, filter, projection) {
         throw Error("The projection argument to the subscribe command must be an object " +
                     "but was a " +
                     projectionType);
+    optionsType = typeof options;
+    if (optionsType != "undefined" && optionsType != "object")
+        throw Error("The options argument to the subscribe command must be an object " +
+                    "but was a " +
+                    optionsType);
 
     var cmdObj = {subscribe: channel};
     if (filter)
         cmdObj.filter = filter;
     if (projection)
         cmdObj.projection = projection;
+    if (options) {
+        for (var option in options)
+            cmdObj[option] = options[option];
+    }
     var res = this._db.runCommand(cmdObj) ;
     assert.commandWorked(res)
-    return new Subscription(res.subscriptionId, this);
+    var subscription = new Subscription(res.subscriptionId, this);
+    if (res.cursor)
+        subscription._cursor = new DBCommandCursor(this._db.getMongo(), res);
+    return subscription;
 }
 
-PS.prototype.poll = function(id, timeout) {
+PS.prototype.poll = function(id, timeout, afterSeq, limits) {
     timeoutType = typeof timeout;
     if (timeoutType != "undefined" && timeoutType != "number")
         throw Error("The timeout argument to the poll command must be " +
                     "a number but was a " + timeoutType);
+    limitsType = typeof limits;
+    if (limitsType != "undefined" && limitsType != "object")
+        throw Error("The limits argument to the poll command must be " +
+                    "an object but was a " + limitsType);
     var dbCommand = { poll: id };
     if (timeout) dbCommand.timeout = timeout;
+    if (afterSeq) dbCommand.afterSeq = afterSeq;
+    if (limits) {
+        for (var limit in limits)
+            dbCommand[limit] = limits[limit];
+    }
     var res = this._db.runCommand(dbCommand);
     assert.commandWorked(res);
     return res;
@@ -95,14 +144,21 @@ if (Subscription === undefined) {
     }
 }
 
-Subscription.prototype.poll = function(timeout) {
-    return this._ps.poll(this._id, timeout);
+Subscription.prototype.poll = function(timeout, afterSeq, limits) {
+    return this._ps.poll(this._id, timeout, afterSeq, limits);
 }
 
 Subscription.prototype.getId = function() {
     return this._id;
 }
 
+// returns the cursor opened by subscribing with the cursor option
+Subscription.prototype.getCursor = function() {
+    if (this._cursor === undefined)
+        throw Error("The subscription was not created with the cursor option");
+    return this._cursor;
+}
+
 Subscription.prototype.forEach = function(callback) {
     while (true) {
         var res = this.poll(10000); // 10 second timeout by default